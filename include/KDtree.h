@@ -11,6 +11,7 @@ a given point, or to a ray).
 Note that in order to be generic, this *doesn't* use Vecs and the like...
 */
 
+#include "sharedarray.h"
 #include <vector>
 namespace trimesh {
 
@@ -35,6 +36,8 @@ public:
 	// Constructor from a vector of points
 	template <class T> KDtree(const std::vector<T> &v)
 		{ build((const float *) &v[0], v.size()); }
+	template <class T, class A> KDtree(const SharedArray<T, A> &v)
+		{ build((const float *) &v[0], v.size()); }
 
 	// Destructor - recursively frees the tree
 	~KDtree();
@@ -13,19 +13,20 @@ class TetMesh {
  public:
 
   struct Element {
-    int v[4];
+    index_t v[4];
     
     Element() {}
-    Element(const int &v0, const int &v1, const int &v2, const int &v3)
+    Element(const index_t &v0, const index_t &v1, const index_t &v2,
+	    const index_t &v3)
     { v[0] = v0; v[1] = v1; v[2] = v2; v[3] = v3;}
-    Element(const int *v_)
+    Element(const index_t *v_)
     { v[0] = v_[0]; v[1] = v_[1]; v[2] = v_[2]; v[3] = v_[3];}
 
-    int &operator[] (int i) { return v[i]; }
-    operator const int * () const { return &(v[0]); }
-    operator const int * () { return &(v[0]); }
-    operator int * () { return &(v[0]); }
-    int indexof(int v_) const
+    index_t &operator[] (int i) { return v[i]; }
+    operator const index_t * () const { return &(v[0]); }
+    operator const index_t * () { return &(v[0]); }
+    operator index_t * () { return &(v[0]); }
+    int indexof(index_t v_) const
     {
       return (v[0] == v_) ? 0 :
 	(v[1] == v_) ? 1 :
@@ -51,12 +52,12 @@ class TetMesh {
   // element/tetrahedron volume
   std::vector<float> tetravolumes;
   std::vector<float> pointvolumes;
-  // facetarea[i][j]: the j-th facet of the i-th elements
-  std::vector< std::vector<float> > facetareas;
+  // facetareas[i][j]: area of the facet of element i opposite node j
+  std::vector< Vec<4,float> > facetareas;
 
 
 
-  std::vector< std::vector<int> > neighbors;
+  AdjList neighbors;
   std::vector< std::vector<int> > adjacentelements;
   TriMesh surface;
 
@@ -69,11 +70,14 @@ class TetMesh {
   void need_facetareas();
 
 
-  bool write(const char *filename);
-
   //
   // Input and Output
   //
+  // Formats are tetgen output (example.1.node, together with
+  // example.1.ele and example.1.face) and tmb, our own binary format,
+  // which is read straight out of a memory map.
+  bool write(const char *filename);
+
  protected:  
   static bool read_helper(const char *filename, TetMesh* mesh);
  public:
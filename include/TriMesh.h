@@ -11,8 +11,19 @@ Class for triangle meshes.
 #include "Vec.h"
 #include "Box.h"
 #include "Color.h"
+#include "adjlist.h"
+#include "sharedarray.h"
+#include "mempool.h"
 #include <vector>
+#include <string>
+#include <utility>
+#include <cstdio>
+#ifdef _OPENMP
+# include <omp.h>
+#endif
 namespace trimesh {
+class MappedFile;
+struct PlyHeader;
 #ifndef M_PIf
 # define M_PIf 3.1415927f
 #endif
@@ -24,21 +35,21 @@ public:
 	// Types
 	//
 	struct Face {
-		int v[3];
+		index_t v[3];
 
 		Face() {}
-		Face(const int &v0, const int &v1, const int &v2)
+		Face(const index_t &v0, const index_t &v1, const index_t &v2)
 			{ v[0] = v0; v[1] = v1; v[2] = v2; }
-		Face(const int *v_)
+		Face(const index_t *v_)
 			{ v[0] = v_[0]; v[1] = v_[1]; v[2] = v_[2]; }
 		template <class S> explicit Face(const S &x)
 			{ v[0] = x[0];  v[1] = x[1];  v[2] = x[2]; }
-		int &operator[] (int i) { return v[i]; }
-		const int &operator[] (int i) const { return v[i]; }
-		operator const int * () const { return &(v[0]); }
-		operator const int * () { return &(v[0]); }
-		operator int * () { return &(v[0]); }
-		int indexof(int v_) const
+		index_t &operator[] (int i) { return v[i]; }
+		const index_t &operator[] (int i) const { return v[i]; }
+		operator const index_t * () const { return &(v[0]); }
+		operator const index_t * () { return &(v[0]); }
+		operator index_t * () { return &(v[0]); }
+		int indexof(index_t v_) const
 		{
 			return (v[0] == v_) ? 0 :
 			       (v[1] == v_) ? 1 :
@@ -67,51 +78,120 @@ public:
 	//
 	// Constructor
 	//
-	TriMesh() : grid_width(-1), grid_height(-1), flag_curr(0)
+	TriMesh() : grid_width(-1), grid_height(-1), flag_curr(0),
+		nonmanifold_edges(0), flipped_edges(0)
 		{}
 
 	//
-	// Members
+	// Members.  The arrays are SharedArrays (see sharedarray.h), which act
+	// like std::vectors but are copy-on-write, so copying a TriMesh only
+	// duplicates the arrays that are later changed.
 	//
 
 	// The basics: vertices and faces
-	std::vector<point> vertices;
-	std::vector<Face> faces;
+	SharedArray<point> vertices;
+	SharedArray<Face> faces;
 
 	// Triangle strips
-	std::vector<int> tstrips;
+	SharedArray<int> tstrips;
 
 	// Grid, if present
-	std::vector<int> grid;
+	SharedArray<int> grid;
 	int grid_width, grid_height;
 
 	// Other per-vertex properties
-	std::vector<Color> colors;
-	std::vector<float> confidences;
-	std::vector<unsigned> flags;
+	SharedArray<Color> colors;
+	SharedArray<float> confidences;
+	SharedArray<unsigned> flags;
 	unsigned flag_curr;
 
 	// Computed per-vertex properties
-	std::vector<vec> normals;
-	std::vector<vec> pdir1, pdir2;
-	std::vector<float> curv1, curv2;
-	std::vector< Vec<4,float> > dcurv;
-	std::vector<vec> cornerareas;
-	std::vector<float> pointareas;
+	SharedArray<vec> normals;
+	SharedArray<vec> pdir1, pdir2;
+	SharedArray<float> curv1, curv2;
+	SharedArray< Vec<4,float> > dcurv;
+	SharedArray<vec> cornerareas;
+	SharedArray<float> pointareas;
+
+	// Other named per-vertex values, such as per-vertex quality or
+	// labels.  Each channel holds ncomp floats per vertex, one vertex
+	// after another.  Binary ply files written with an attr: prefix carry
+	// all channels, and reading a binary ply file picks up the channels
+	// whose names were passed to register_ply_channel() beforehand.
+	struct Channel {
+		std::string name;
+		int ncomp;
+		SharedArray<float> values;
+		Channel(const std::string &name_ = std::string(), int ncomp_ = 1) :
+			name(name_), ncomp(ncomp_)
+			{}
+	};
+	std::vector<Channel> channels;
+	// The channel with the given name, or NULL if there isn't one
+	Channel *channel(const char *name);
+	const Channel *channel(const char *name) const;
+	// The channel with the given name, added if necessary, with room
+	// for ncomp values for each vertex
+	Channel &add_channel(const char *name, int ncomp = 1);
 
 	// Bounding structures
 	box bbox;
 	BSphere bsphere;
 
 	// Connectivity structures:
-	//  For each vertex, all neighboring vertices
-	std::vector< std::vector<int> > neighbors;
+	//  neighbors and adjacentfaces are AdjLists (see adjlist.h), read-only
+	//  lists that used to be std::vector< std::vector<int> >.  Code that
+	//  changed them in place needs AdjList::to_vectors() / from_vectors().
+	//  For each vertex, all neighboring vertices (in increasing order)
+	AdjList neighbors;
 	//  For each vertex, all neighboring faces
-	std::vector< std::vector<int> > adjacentfaces;
+	AdjList adjacentfaces;
 	//  For each face, the three faces attached to its edges
 	//  (for example, across_edge[3][2] is the number of the face
-	//   that's touching the edge opposite vertex 2 of face 3)
-	std::vector<Face> across_edge;
+	//   that's touching the edge opposite vertex 2 of face 3).
+	//  -1 on boundaries, and at edges that are non-manifold or have
+	//  faces with inconsistent orientations on either side.
+	SharedArray<Face> across_edge;
+	//  Corner table: corner c is vertex c%3 of face c/3.  For each corner,
+	//  the corner across the edge opposite it (-1 wherever across_edge
+	//  is -1), and for each vertex, one of its corners (-1 if none).
+	//  For boundary vertices, that is the first corner counterclockwise,
+	//  so swinging from it visits the whole fan.
+	SharedArray< index_t, HookAlloc<index_t> > corner_opposite;
+	SharedArray< index_t, HookAlloc<index_t> > vertex_corner;
+	//  The number of edges that need_across_edge() or need_corners()
+	//  (whichever ran last) left as -1 because they were non-manifold
+	//  (more than two faces) or had faces with inconsistent orientations
+	//  on either side.  Both are 0 for a clean manifold mesh.
+	index_t nonmanifold_edges, flipped_edges;
+
+	// Change tracking.  Code that moves vertices should call
+	// geometry_changed(), and code that changes faces should call
+	// topology_changed().  Each computed property remembers the
+	// generation it was computed from, and need_* recomputes it only
+	// if something it depends on has changed since - so connectivity,
+	// which depends only on topology, survives moving vertices.  Code
+	// that updates a computed property itself can mark it as current
+	// (e.g., normals_gen = generation).
+	struct Generation {
+		unsigned geometry, topology;
+		Generation() : geometry(0), topology(0)
+			{}
+	};
+	Generation generation;
+	Generation normals_gen, pointareas_gen, curv_gen, dcurv_gen;
+	Generation bbox_gen, bsphere_gen, edgelengths_gen, faceareas_gen;
+	Generation neighbors_gen, adjacentfaces_gen, across_edge_gen, corners_gen;
+	void geometry_changed()
+		{ generation.geometry++; }
+	void topology_changed()
+		{ generation.topology++; }
+	bool geometry_current(const Generation &g) const
+		{ return g.geometry == generation.geometry; }
+	bool topology_current(const Generation &g) const
+		{ return g.topology == generation.topology; }
+	bool is_current(const Generation &g) const
+		{ return geometry_current(g) && topology_current(g); }
 
 	//
 	// Compute all this stuff...
@@ -138,71 +218,376 @@ public:
 	void need_neighbors();
 	void need_adjacentfaces();
 	void need_across_edge();
+	void need_corners();
+
+	// Incremental updates after moving only a few vertices.
+	// vertices_moved() calls geometry_changed(), then brings normals,
+	// point areas, curvatures, and dcurv back up to date (those that
+	// were up to date before) by recomputing them only near the moved
+	// vertices: within the 1-ring, 2-ring, and 3-ring respectively.
+	// The update_* functions it uses recompute the given property at
+	// just the listed vertices.
+	void vertices_moved(const std::vector<index_t> &moved);
+	void update_normals(const std::vector<index_t> &verts);
+	void update_pointareas(const std::vector<index_t> &verts);
+	void update_curvatures(const std::vector<index_t> &verts);
+	void update_dcurv(const std::vector<index_t> &verts);
+
+	// Whether parallel loops would run on just one thread
+	static bool one_thread()
+	{
+#ifdef _OPENMP
+		return omp_get_max_threads() == 1;
+#else
+		return true;
+#endif
+	}
 
-	// added by bobye
-	float * vertices_tightpacked;
-	float * normals_tightpacked;
-	void recompute_normals_tightpacked();
+	// Add up per-corner values into per-vertex ones: corner_vals holds
+	// 3 values per face (corner j of face i is at 3*i+j), and vert_vals
+	// gets one per vertex.  Rather than scattering from faces to
+	// vertices, each vertex gathers from its adjacent faces in order of
+	// face index, so there are no races or atomics and the result is
+	// the same for any number of threads.  On one thread, scattering
+	// in order of face index adds up the same values in the same order,
+	// and doesn't need adjacentfaces, so that is done instead.
+	template <class T>
+	void sum_corners(const T *corner_vals, T *vert_vals)
+	{
+		const TriMesh *mesh = this;
+		index_t nv = vertices.size();
+		if (one_thread()) {
+			std::fill(vert_vals, vert_vals + nv, T());
+			index_t nf = faces.size();
+			for (index_t i = 0; i < nf; i++) {
+				for (int j = 0; j < 3; j++) {
+					index_t v = mesh->faces[i][j];
+					if (v >= 0 && v < nv)
+						vert_vals[v] += corner_vals[3*i+j];
+				}
+			}
+			return;
+		}
+		need_adjacentfaces();
+		bool have_adj = !adjacentfaces.empty();
+#pragma omp parallel for
+		for (index_t i = 0; i < nv; i++) {
+			T sum = T();
+			if (have_adj) {
+				AdjList::Range a = mesh->adjacentfaces[i];
+				for (size_t k = 0; k < a.size(); k++) {
+					const Face &f = mesh->faces[a[k]];
+					for (int j = 0; j < 3; j++)
+						if (f[j] == i)
+							sum += corner_vals[3*a[k]+j];
+				}
+			}
+			vert_vals[i] = sum;
+		}
+	}
+
+	//
+	// Corner table navigation (see need_corners).  corner_swing and
+	// corner_unswing step counterclockwise and clockwise around the vertex
+	// of corner c, and return -1 at the boundary.  To visit the corners
+	// around vertex v:
+	//	index_t c0 = vertex_corner[v], c = c0;
+	//	if (c0 >= 0) do {
+	//		...
+	//		c = corner_swing(c);
+	//	} while (c >= 0 && c != c0);
+	//
+	static index_t corner_next(index_t c)
+		{ return (c % 3 == 2) ? c - 2 : c + 1; }
+	static index_t corner_prev(index_t c)
+		{ return (c % 3 == 0) ? c + 2 : c - 1; }
+	index_t corner_vertex(index_t c) const
+		{ return faces[c / 3][c % 3]; }
+	index_t corner_swing(index_t c) const
+	{
+		index_t o = corner_opposite[corner_next(c)];
+		return (o < 0) ? -1 : corner_next(o);
+	}
+	index_t corner_unswing(index_t c) const
+	{
+		index_t o = corner_opposite[corner_prev(c)];
+		return (o < 0) ? -1 : corner_prev(o);
+	}
 
-	unsigned int *face_indices_tightpacked;
+	// Edit the mesh in place through the corner table (built if needed):
+	// flip the edge opposite corner c (returns false if that is impossible
+	// or would create a duplicate edge), or split it with a new vertex at
+	// p (returns the new vertex, with normals, colors, and confidences
+	// interpolated).  Both keep faces and the corner table up to date,
+	// and throw away other connectivity and per-face data.
+	bool flip_edge(index_t c);
+	index_t split_edge(index_t c, const point &p);
+
+	// Flat arrays of vertex positions, normals, and face indices (3 per
+	// vertex or face), e.g. for handing to a GPU.  These are views of
+	// vertices, normals, and faces, not copies: they are null if the
+	// array is empty, and are invalidated by anything that changes or
+	// reallocates it.  With TRIMESH_64BIT_INDICES, face_data() packs the
+	// faces into 32-bit indices in tightpacked_faces, and returns that.
+	// allocate_data_tightpacked() gets everything ready (faces and
+	// normals), and recompute_normals_tightpacked() recomputes normals
+	// after vertices have been changed in place (these two are from the
+	// old interface added by bobye).
+	const float *vertex_data() const
+		{ return vertices.empty() ? 0 : &vertices[0][0]; }
+	const float *normal_data() const
+		{ return normals.empty() ? 0 : &normals[0][0]; }
+	const unsigned int *face_data();
+	SharedArray< unsigned int, HookAlloc<unsigned int> > tightpacked_faces;
+	void allocate_data_tightpacked();
+	void recompute_normals_tightpacked();
 
-	// allocate memory for tightly packed data
-	void allocate_data_tightpacked()
+	// Interleaved vertex streams.  Each vertex gets the attributes selected
+	// by attribs, as 3 floats each in the order position, normal, color,
+	// so that vertex i starts at buf[i * stream_stride(attribs)].  Normals
+	// are computed if needed; missing colors are written as white.
+	// pack_vertex_stream() resizes buf to hold all vertices, but only
+	// (re)packs vertices [first, first + n), so that after moving or
+	// recoloring some vertices only that range needs refreshing (and
+	// uploading).  n < 0 means through the last vertex.
+	enum { STREAM_POSITION = 1, STREAM_NORMAL = 2, STREAM_COLOR = 4 };
+	static int stream_stride(int attribs)
+	{
+		return 3 * (!!(attribs & STREAM_POSITION) +
+			    !!(attribs & STREAM_NORMAL) +
+			    !!(attribs & STREAM_COLOR));
+	}
+	void pack_vertex_stream(std::vector<float> &buf, int attribs,
+		ptrdiff_t first = 0, ptrdiff_t n = -1);
+
+	// Compact geometry, for keeping big meshes around for viewing.
+	// compact_geometry() quantizes vertex positions to 16 bits per axis
+	// within the bounding box, encodes normals (if present) octahedrally
+	// in 32 bits, and frees vertices and normals: 6 or 10 bytes per
+	// vertex instead of 12 or 24.  expand_geometry() brings them back.
+	// While compact, vertex i is at pos_xf * (quantized position i), and
+	// its normal is normalize(norm_xf * (decoded normal i)), with both
+	// transforms in column-major order as in XForm, so apply_xform only
+	// needs to update those.  need_bbox() and pack_vertex_stream() work
+	// on compact meshes, as do decode_positions() and decode_normals(),
+	// which decode n vertices starting at first, need_normals(), which
+	// computes normals from the decoded positions and encodes them, and
+	// the connectivity functions.  need_vertices() expands a compact
+	// mesh.  The other need_* functions, write(), write_cache(),
+	// split_edge(), ICP, and find_overlap call it, so they leave the
+	// mesh expanded.  Other code that reads vertices (e.g., to build a
+	// KDtree) should call it first.  While compact, normals_gen tells
+	// whether the encoded normals are up to date.
+	struct CompactGeometry {
+		SharedArray<unsigned short> pos;	// 3 per vertex
+		SharedArray<unsigned> norms;		// 1 per vertex, or none
+		float pos_xf[16], norm_xf[16];
+	};
+	CompactGeometry compact;
+	bool is_compact() const
+		{ return !compact.pos.empty(); }
+	void compact_geometry();
+	void expand_geometry();
+	void need_vertices()
 	{
-	  int nv = vertices.size();
-	  int fn = faces.size();
-
-	  vertices_tightpacked = (float*) malloc(3*nv*sizeof(float));
-	  face_indices_tightpacked = (unsigned int*) malloc(3*fn*sizeof(unsigned int));
-
-	  for (int i=0; i<nv; ++i) {
-	    vertices_tightpacked[3*i]   = vertices[i][0];
-	    vertices_tightpacked[3*i+1] = vertices[i][1];
-	    vertices_tightpacked[3*i+2] = vertices[i][2];
-	  }
-
-	  for (int i=0; i<fn; ++i) {
-	    face_indices_tightpacked[3*i]   = faces[i][0];
-	    face_indices_tightpacked[3*i+1] = faces[i][1];
-	    face_indices_tightpacked[3*i+2] = faces[i][2];
-	  }
-
-	  normals_tightpacked  = (float*) malloc( 3*nv*sizeof(float));
-	  recompute_normals_tightpacked();
+		if (is_compact())
+			expand_geometry();
 	}
+	void decode_positions(size_t first, size_t n, point *out) const;
+	void decode_normals(size_t first, size_t n, vec *out) const;
 
-	// added by @bobye
-	std::vector<std::vector<float> > edgelengths; 
-	std::vector<float>               faceareas;
+	// Per-face edge lengths (edgelengths[i][j] is the length of the edge
+	// opposite vertex j of face i) and areas.  Added by @bobye.
+	SharedArray< vec, HookAlloc<vec> > edgelengths;
+	SharedArray< float, HookAlloc<float> > faceareas;
 
 	void need_edgelengths();
 	void need_faceareas();
 
 	//
-	// Delete everything
+	// Delete everything, giving the memory back
 	//
-	void clear()
-	{
-		vertices.clear(); faces.clear(); tstrips.clear();
-		grid.clear(); grid_width = grid_height = -1;
-		colors.clear(); confidences.clear();
-		flags.clear(); flag_curr = 0;
-		normals.clear(); pdir1.clear(); pdir2.clear();
-		curv1.clear(); curv2.clear(); dcurv.clear();
-		cornerareas.clear(); pointareas.clear();
-		bbox.valid = bsphere.valid = false;
-		neighbors.clear(); adjacentfaces.clear(); across_edge.clear();
-	}
+	void clear();
+
+	//
+	// Memory accounting and management.  memory_usage() returns the bytes
+	// allocated for the mesh (counting the capacity of each array, not
+	// just its size, and counting arrays shared with copies of the mesh
+	// in full), and if breakdown is given, appends an entry with the
+	// name and size of each member that holds any memory.
+	// release_derived() frees everything that the need_* functions can
+	// recompute: connectivity, curvatures, areas, edge lengths, and the
+	// 32-bit copy of the faces.  Normals are kept, since they often come
+	// from the file.  shrink() gives back memory that arrays have
+	// reserved beyond their current sizes (e.g., after push_back), except
+	// in arrays that are shared.  The connectivity and per-face arrays
+	// that the need_* functions build (neighbors, adjacentfaces, the
+	// corner table, edgelengths, faceareas, and tightpacked_faces) get
+	// their memory through HookAlloc, so set_array_alloc_hooks() can put
+	// them in an arena or in huge pages (see mempool.h).
+	//
+	typedef std::pair<const char *, size_t> MemoryItem;
+	size_t memory_usage(std::vector<MemoryItem> *breakdown = 0) const;
+	void release_derived();
+	void shrink();
+
+	// Exchange the contents of two meshes in O(1), without copying any
+	// arrays.  (Copying a mesh is O(1) as well, since the copy shares the
+	// arrays until either mesh changes them, and moving one never copies.)
+	void swap(TriMesh &m);
 
 	//
 	// Input and output
 	//
 protected:
 	static bool read_helper(const char *filename, TriMesh *mesh);
+	void need_compact_normals();
 public:
 	static TriMesh *read(const char *filename);
 	bool write(const char *filename);
 
+	// Have reads of binary ply files load the per-vertex channel with the
+	// given name and number of components (1 to 9) into channels.  Its
+	// components are float properties called name (for 1 component),
+	// namex, namey, namez (for 3), or name0, name1, ... (otherwise), in
+	// any order.  Not thread-safe: register channels before reading.
+	static void register_ply_channel(const char *name, int ncomp = 1);
+
+	// What can be learned about a mesh file without reading all of it.
+	// nfaces counts faces as stored, so a polygon is one face.  ntris
+	// is the number of triangles read() would make of them, or -1 if
+	// that can't be told without reading the faces (e.g., for files
+	// with triangle strips or range grids).
+	struct FileInfo {
+		const char *format;	// "ply", "off", "sm", "stl", or "obj"
+		bool binary, big_endian;
+		int nverts, nfaces, ntris;
+		bool has_normals, has_colors, has_confidences;
+		bool has_tstrips, has_grid;
+		int grid_width, grid_height;
+		bool counted;		// Counts came from scanning the file,
+					// since it has no header
+		FileInfo() : format(""), binary(false), big_endian(false),
+			nverts(0), nfaces(0), ntris(-1),
+			has_normals(false), has_colors(false),
+			has_confidences(false),
+			has_tstrips(false), has_grid(false),
+			grid_width(-1), grid_height(-1), counted(false)
+			{}
+	};
+
+	// Fill in info by parsing just the header of a ply, off, sm, or stl
+	// file, and by counting lines of an obj file.  Returns false for
+	// other formats, for standard input, and for weld: prefixes, since
+	// the answer then depends on reading everything.
+	static bool probe(const char *filename, FileInfo &info);
+
+	// Caching of meshes, together with everything computed from them,
+	// in tmc format.  read_cached() reads the cache if it was made from
+	// the current version of filename, and otherwise reads filename.
+	// The default cache name is filename.tmc.
+	static TriMesh *read_cached(const char *filename,
+		const char *cache_filename = NULL);
+	bool write_cache(const char *filename,
+		const char *cache_filename = NULL);
+
+	// Read-only view of the vertices of a ply file, used straight out
+	// of a memory map without being copied.  Only possible for
+	// native-endian binary files whose vertex records hold nothing
+	// but float x, y, z.
+	class MappedVerts {
+	private:
+		MappedFile *map;
+		const point *verts;
+		size_t nverts;
+		MappedVerts(const MappedVerts &);
+		MappedVerts &operator = (const MappedVerts &);
+		friend class TriMesh;
+	public:
+		MappedVerts() : map(0), verts(0), nverts(0)
+			{}
+		~MappedVerts()
+			{ release(); }
+		void release();
+		bool empty() const { return !nverts; }
+		size_t size() const { return nverts; }
+		const point *begin() const { return verts; }
+		const point *end() const { return verts + nverts; }
+		const point &operator [] (size_t i) const { return verts[i]; }
+	};
+	static bool map_verts(const char *filename, MappedVerts &view);
+
+	// Streaming access to ply files too big to fit in memory.
+	// A PlyReader hands out the vertices, then the faces, of a file in
+	// chunks, each stored in a TriMesh.  Face indices are relative to
+	// the whole file, and triangle strips come out as faces.  Since
+	// vertex positions aren't at hand, polygons are split into fans.
+	//	TriMesh::PlyReader in;
+	//	TriMesh chunk;
+	//	if (in.open(filename)) {
+	//		while (in.read_verts(&chunk, 65536))
+	//			...
+	//		while (in.read_faces(&chunk, 65536))
+	//			...
+	//	}
+	class PlyReader {
+	private:
+		FILE *f;
+		PlyHeader *h;
+		index_t verts_left, faces_left;
+		int strip_len, strip_v0, strip_v1;
+		bool in_faces, ok;
+		bool start_faces();
+		void add_strip(const int *inds, int n, std::vector<Face> &faces);
+		PlyReader(const PlyReader &);
+		PlyReader &operator = (const PlyReader &);
+	public:
+		PlyReader() : f(0), h(0), ok(false)
+			{}
+		~PlyReader()
+			{ close(); }
+		bool open(const char *filename);
+		void close();
+		// Counts from the header.  For files with triangle strips,
+		// nfaces() is 0.
+		index_t nverts() const;
+		index_t nfaces() const;
+		bool has_normals() const;
+		bool has_colors() const;
+		bool has_confidences() const;
+		// Read up to n vertices, or n face records (n strip indices
+		// for files with triangle strips), replacing the contents of
+		// chunk.  Return false at the end of the vertices or faces,
+		// or on error, after which failed() is true.
+		bool read_verts(TriMesh *chunk, int n);
+		bool read_faces(TriMesh *chunk, int n);
+		bool failed() const { return !ok; }
+	};
+
+	// A PlyWriter writes chunks of vertices, then faces, to a ply file
+	// on disk, and fills in the counts in its header on close().
+	// Normals, colors, and confidences are written if the first chunk
+	// of vertices has them, and must then be present in every chunk.
+	class PlyWriter {
+	private:
+		FILE *f;
+		bool binary, ok, header_done, in_faces;
+		bool with_norm, with_color, with_conf;
+		index_t nverts, nfaces;
+		bool write_header();
+		PlyWriter(const PlyWriter &);
+		PlyWriter &operator = (const PlyWriter &);
+	public:
+		PlyWriter() : f(0), ok(false)
+			{}
+		~PlyWriter()
+			{ close(); }
+		bool open(const char *filename, bool binary = true);
+		bool write_verts(TriMesh *chunk);
+		bool write_faces(TriMesh *chunk);
+		bool close();
+	};
+
 
 	//
 	// Useful queries
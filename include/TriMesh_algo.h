@@ -51,6 +51,28 @@ extern void remap_verts(TriMesh *mesh, const std::vector<int> &remap_table);
 // they are referenced by the tstrips or faces.
 extern void reorder_verts(TriMesh *mesh);
 
+// Reorder vertices along a space-filling curve (Hilbert or Morton order)
+// through the bounding box, so that nearby vertices are nearby in memory,
+// then reorder faces to match.  This makes loops over vertex neighborhoods
+// (normals, curvatures, smoothing, subdivision, ...) much more cache-friendly
+// on meshes whose vertices come in no particular order.
+enum { REORDER_MORTON, REORDER_HILBERT };
+extern void reorder_verts_spatial(TriMesh *mesh, int curve = REORDER_HILBERT);
+
+// Reorder faces by their lowest-numbered vertex
+extern void reorder_faces(TriMesh *mesh);
+
+// Reorder faces for a post-transform vertex cache holding cache_size
+// vertices (Tipsify), then vertices in the order the faces use them.
+// Triangle strips and grids are unpacked to faces and dropped.
+extern void optimize_vertex_cache(TriMesh *mesh, int cache_size = 16);
+
+// Average cache miss ratio (transformed vertices per face) and average
+// transform to vertex ratio (transformed vertices per vertex) of the faces,
+// in order, through a FIFO vertex cache of the given size
+extern void vertex_cache_stats(TriMesh *mesh, int cache_size,
+	float &acmr, float &atvr);
+
 // Perform one iteration of subdivision on a mesh.
 enum { SUBDIV_PLANAR, SUBDIV_LOOP, SUBDIV_LOOP_ORIG, SUBDIV_LOOP_NEW,
        SUBDIV_BUTTERFLY, SUBDIV_BUTTERFLY_MODIFIED };
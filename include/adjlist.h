@@ -0,0 +1,180 @@
+#ifndef ADJLIST_H
+#define ADJLIST_H
+/*
+Szymon Rusinkiewicz
+Princeton University
+
+adjlist.h
+A list of lists of indices, stored in compressed-sparse-row form: one flat
+array holding all the lists back to back, plus an array of offsets at
+which each list starts.  Used for per-vertex connectivity in TriMesh and TetMesh.
+
+Usage:
+	AdjList a;
+	a.build(n, counts);   // counts[i] = length of list i
+	...fill a.items[a.offsets[i]] .. a.items[a.offsets[i+1]-1]...
+or
+	a.build_neighbors(nverts, &faces[0][0], faces.size(), 3);
+	a.build_incident(nverts, &faces[0][0], faces.size(), 3);
+
+	for (size_t i = 0; i < a.size(); i++)
+		for (size_t j = 0; j < a[i].size(); j++)
+			use(a[i][j]);
+
+a[i] is a lightweight Range (a pair of pointers) that behaves like a
+const std::vector<index_t>: it has size(), empty(), operator [], and
+begin() and end(), and can be converted to a std::vector<index_t> if a
+copy is needed.  index_t is int unless TRIMESH_64BIT_INDICES is defined.
+
+The lists can't be changed in place.  TriMesh::neighbors and adjacentfaces
+used to be std::vector< std::vector<int> >, which is an API change for code
+that modified them (e.g., a[i].push_back(j)) or passed them on as vectors:
+such code can convert with a.to_vectors(v), and back with a.from_vectors(v).
+Copying an AdjList shares its arrays until either copy changes them (see
+sharedarray.h).
+*/
+
+#include "sharedarray.h"
+#include "mempool.h"
+#include <vector>
+#include <cstddef>
+#include <algorithm>
+
+namespace trimesh {
+
+// The type of vertex and element indices, here and in TriMesh and TetMesh.
+// These are ints unless TRIMESH_64BIT_INDICES is defined (which must be
+// done consistently for the library and everything using it), for meshes
+// with 2^31 or more vertices or faces.
+#ifdef TRIMESH_64BIT_INDICES
+typedef long long index_t;
+#else
+typedef int index_t;
+#endif
+
+
+class AdjList {
+public:
+	// One of the lists
+	class Range {
+	private:
+		const index_t *first, *last;
+	public:
+		typedef index_t value_type;
+		typedef const index_t *iterator;
+		typedef const index_t *const_iterator;
+
+		Range(const index_t *first_, const index_t *last_) :
+			first(first_), last(last_)
+			{}
+		size_t size() const
+			{ return last - first; }
+		bool empty() const
+			{ return first == last; }
+		const index_t &operator [] (size_t i) const
+			{ return first[i]; }
+		const index_t *begin() const
+			{ return first; }
+		const index_t *end() const
+			{ return last; }
+		const index_t &front() const
+			{ return *first; }
+		const index_t &back() const
+			{ return last[-1]; }
+		operator std::vector<index_t> () const
+			{ return std::vector<index_t>(first, last); }
+	};
+
+	// List i is items[offsets[i]] through items[offsets[i+1]-1].
+	// offsets has one more entry than there are lists (or is empty).
+	SharedArray< size_t, HookAlloc<size_t> > offsets;
+	SharedArray< index_t, HookAlloc<index_t> > items;
+
+	// Number of lists
+	size_t size() const
+		{ return offsets.empty() ? 0 : offsets.size() - 1; }
+	bool empty() const
+		{ return offsets.size() <= 1; }
+
+	// Free all memory
+	void clear()
+	{
+		SharedArray< size_t, HookAlloc<size_t> >().swap(offsets);
+		SharedArray< index_t, HookAlloc<index_t> >().swap(items);
+	}
+
+	// Bytes allocated, and giving back any extra capacity
+	size_t memory_usage() const
+	{
+		return offsets.capacity() * sizeof(size_t) +
+		       items.capacity() * sizeof(index_t);
+	}
+	void shrink()
+	{
+		offsets.shrink_to_fit();
+		items.shrink_to_fit();
+	}
+
+	// Exchange contents with another AdjList, without copying
+	void swap(AdjList &a)
+	{
+		offsets.swap(a.offsets);
+		items.swap(a.items);
+	}
+
+	// List i.  The pointers are computed without indexing items, so
+	// this is safe even for empty lists at the end.
+	Range operator [] (size_t i) const
+	{
+		const index_t *p = items.empty() ? 0 : &items[0];
+		return Range(p + offsets[i], p + offsets[i+1]);
+	}
+
+	// Set up n lists with the given lengths (a prefix sum of counts).
+	// The contents of items are left to the caller to fill in.
+	template <class T>
+	void build(size_t n, const T *counts)
+	{
+		offsets.resize(n + 1);
+		offsets[0] = 0;
+		for (size_t i = 0; i < n; i++)
+			offsets[i+1] = offsets[i] + counts[i];
+		items.resize(offsets[n]);
+	}
+
+	// Copy the lists out to, or in from, one std::vector per list
+	void to_vectors(std::vector< std::vector<index_t> > &v) const
+	{
+		size_t n = size();
+		v.resize(n);
+		for (size_t i = 0; i < n; i++)
+			v[i] = (*this)[i];
+	}
+	void from_vectors(const std::vector< std::vector<index_t> > &v)
+	{
+		size_t n = v.size();
+		offsets.resize(n + 1);
+		offsets[0] = 0;
+		for (size_t i = 0; i < n; i++)
+			offsets[i+1] = offsets[i] + v[i].size();
+		items.resize(offsets[n]);
+		for (size_t i = 0; i < n; i++)
+			std::copy(v[i].begin(), v[i].end(),
+				items.begin() + offsets[i]);
+	}
+
+	// Set up lists of the neighbors of each of n vertices, in increasing
+	// order, given nelems elements (triangles, tetrahedra, ...) of k
+	// vertex indices each, stored consecutively.  Built in parallel.
+	void build_neighbors(size_t n, const index_t *elems, size_t nelems,
+		int k);
+
+	// Set up lists of the elements touching each of n vertices, in
+	// increasing order, given elements as above.  Built in parallel.
+	void build_incident(size_t n, const index_t *elems, size_t nelems,
+		int k);
+};
+
+} // end namespace trimesh
+
+#endif
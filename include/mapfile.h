@@ -0,0 +1,184 @@
+#ifndef MAPFILE_H
+#define MAPFILE_H
+/*
+mapfile.h
+Read-only memory mapping of a whole file.
+
+Usage:
+	MappedFile m;
+	if (m.open(filename)) {  // or m.open(f), given an open FILE *
+		const unsigned char *p = m.data();
+		size_t n = m.size();
+		...
+	}
+
+copy_mapped(dst, src, n) copies n bytes out of a mapping, touching the
+pages from several threads at once.
+
+Only regular files can be mapped: open() returns false for pipes,
+terminals, and the like, and callers should fall back on ordinary reads.
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+#ifdef _WIN32
+# ifndef WIN32_LEAN_AND_MEAN
+#  define WIN32_LEAN_AND_MEAN
+# endif
+# include <windows.h>
+# include <io.h>
+#else
+# include <sys/types.h>
+# include <sys/stat.h>
+# include <sys/mman.h>
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
+namespace trimesh {
+
+class MappedFile {
+private:
+	const unsigned char *ptr;
+	size_t len;
+
+	// Not copyable
+	MappedFile(const MappedFile &);
+	MappedFile &operator = (const MappedFile &);
+
+#ifdef _WIN32
+	bool map_handle(HANDLE h)
+	{
+		LARGE_INTEGER sz;
+		if (GetFileType(h) != FILE_TYPE_DISK || !GetFileSizeEx(h, &sz))
+			return false;
+		if (sz.QuadPart <= 0 || (unsigned long long) sz.QuadPart > (size_t) -1)
+			return false;
+		HANDLE hmap = CreateFileMapping(h, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (!hmap)
+			return false;
+		ptr = (const unsigned char *) MapViewOfFile(hmap, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(hmap);
+		if (!ptr)
+			return false;
+		len = (size_t) sz.QuadPart;
+		return true;
+	}
+#else
+	bool map_fd(int fd)
+	{
+		struct stat st;
+		if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0)
+			return false;
+		void *p = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (p == MAP_FAILED)
+			return false;
+# ifdef MADV_WILLNEED
+		madvise(p, (size_t) st.st_size, MADV_WILLNEED);
+# endif
+		ptr = (const unsigned char *) p;
+		len = (size_t) st.st_size;
+		return true;
+	}
+#endif
+
+public:
+	MappedFile() : ptr(0), len(0)
+		{}
+	~MappedFile()
+		{ close(); }
+
+	// Map the file with the given name
+	bool open(const char *filename)
+	{
+		close();
+#ifdef _WIN32
+		HANDLE h = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ,
+			NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (h == INVALID_HANDLE_VALUE)
+			return false;
+		bool ok = map_handle(h);
+		CloseHandle(h);
+		return ok;
+#else
+		int fd = ::open(filename, O_RDONLY);
+		if (fd < 0)
+			return false;
+		bool ok = map_fd(fd);
+		::close(fd);
+		return ok;
+#endif
+	}
+
+	// Map the file underlying an open stdio stream.  The stream's
+	// position is not affected.
+	bool open(FILE *f)
+	{
+		close();
+#ifdef _WIN32
+		return map_handle((HANDLE) _get_osfhandle(_fileno(f)));
+#else
+		return map_fd(fileno(f));
+#endif
+	}
+
+	void close()
+	{
+		if (!ptr)
+			return;
+#ifdef _WIN32
+		UnmapViewOfFile((LPCVOID) ptr);
+#else
+		munmap((void *) ptr, len);
+#endif
+		ptr = 0;
+		len = 0;
+	}
+
+	bool valid() const
+		{ return ptr != 0; }
+	const unsigned char *data() const
+		{ return ptr; }
+	size_t size() const
+		{ return len; }
+};
+
+
+// Position of a stdio stream, as a 64-bit quantity even where long is 32 bits
+static inline long long ftell64(FILE *f)
+{
+#ifdef _WIN32
+	return _ftelli64(f);
+#else
+	return (long long) ftello(f);
+#endif
+}
+
+static inline int fseek64(FILE *f, long long offset, int whence)
+{
+#ifdef _WIN32
+	return _fseeki64(f, offset, whence);
+#else
+	return fseeko(f, (off_t) offset, whence);
+#endif
+}
+
+
+// Copy a big block out of a memory map.  Done in pieces from several
+// threads, so that page faults get serviced in parallel.
+static inline void copy_mapped(void *dst, const unsigned char *src, size_t n)
+{
+	const size_t block = 1 << 20;
+	long long nblocks = (long long) ((n + block - 1) / block);
+#pragma omp parallel for
+	for (long long i = 0; i < nblocks; i++) {
+		size_t start = size_t(i) * block;
+		memcpy((unsigned char *) dst + start, src + start,
+		       std::min(block, n - start));
+	}
+}
+
+} // end namespace trimesh
+#endif
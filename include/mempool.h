@@ -22,10 +22,23 @@ Sample usage:
 Does *no* error checking.
 Make sure sizeof(MyClass) is larger than sizeof(void *).
 Based on the description of the Pool class in _Effective C++_ by Scott Meyers.
+
+Also HookAlloc, an allocator for std::vector that gets its memory from
+functions the program can supply, e.g. to use an arena or huge pages:
+	void *my_alloc(size_t n) { ... }
+	void my_free(void *p, size_t n) { ... }
+	set_array_alloc_hooks(my_alloc, my_free);
+The hooks are called with the full size of each block, and must return
+memory aligned as malloc's is.  Each block remembers which free function
+goes with it, so the hooks may be changed (or reset with null pointers)
+at any time, but not while other threads might be allocating.  TriMesh
+uses HookAlloc for the arrays that its need_* functions build.
 */
 
 #include <vector>
 #include <algorithm>
+#include <new>
+#include <cstddef>
 namespace trimesh {
 
 #define POOL_MEMBLOCK 4088
@@ -86,5 +99,86 @@ public:
 	}
 };
 
+
+// The hooks used by HookAlloc (null for operator new and delete)
+extern void *(*array_alloc_hook)(size_t);
+extern void (*array_free_hook)(void *, size_t);
+void set_array_alloc_hooks(void *(*alloc)(size_t),
+	void (*free)(void *, size_t));
+
+
+template <class T>
+class HookAlloc {
+private:
+	// Each block starts with the free function to give it back with,
+	// padded to keep the data aligned
+	union Header {
+		void (*free)(void *, size_t);
+		double d;
+		long double ld;
+		void *p;
+		long long ll;
+	};
+
+public:
+	typedef T value_type;
+	typedef T *pointer;
+	typedef const T *const_pointer;
+	typedef T &reference;
+	typedef const T &const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+	template <class U> struct rebind { typedef HookAlloc<U> other; };
+
+	HookAlloc()
+		{}
+	template <class U> HookAlloc(const HookAlloc<U> &)
+		{}
+
+	pointer address(reference x) const
+		{ return &x; }
+	const_pointer address(const_reference x) const
+		{ return &x; }
+	size_type max_size() const
+		{ return (size_t(-1) - sizeof(Header)) / sizeof(T); }
+
+	pointer allocate(size_type n, const void * = 0)
+	{
+		if (n > max_size())
+			throw std::bad_alloc();
+		size_t bytes = sizeof(Header) + n * sizeof(T);
+		void *(*hook_alloc)(size_t) = array_alloc_hook;
+		void (*hook_free)(void *, size_t) = array_free_hook;
+		void *p = hook_alloc ? hook_alloc(bytes) : ::operator new(bytes);
+		if (!p)
+			throw std::bad_alloc();
+		Header *h = (Header *) p;
+		h->free = hook_alloc ? hook_free : 0;
+		return (pointer) (h + 1);
+	}
+	void deallocate(pointer p, size_type n)
+	{
+		if (!p)
+			return;
+		Header *h = (Header *) p - 1;
+		if (h->free)
+			h->free(h, sizeof(Header) + n * sizeof(T));
+		else
+			::operator delete(h);
+	}
+
+	void construct(pointer p, const T &x)
+		{ new ((void *) p) T(x); }
+	void destroy(pointer p)
+		{ p->~T(); }
+};
+
+template <class T, class U>
+inline bool operator == (const HookAlloc<T> &, const HookAlloc<U> &)
+	{ return true; }
+template <class T, class U>
+inline bool operator != (const HookAlloc<T> &, const HookAlloc<U> &)
+	{ return false; }
+
 } // end namespace trimesh
 #endif
@@ -0,0 +1,98 @@
+#ifndef RADIXSORT_H
+#define RADIXSORT_H
+/*
+Szymon Rusinkiewicz
+Princeton University
+
+radixsort.h
+Stable parallel LSD radix sort of 64-bit keys, carrying an array of
+indices along with them.
+
+Usage:
+	std::vector<unsigned long long> keys;
+	std::vector<index_t> vals;
+	...
+	radix_sort(keys, vals, lo_bits, hi_bits);
+
+sorts on the low lo_bits bits of the lower 32-bit half of each key and the
+low hi_bits bits of the upper half (bits above those are ignored, and
+should be zero).  The keys are split into a fixed number of blocks, so the
+result does not depend on the number of threads.
+*/
+
+#include "adjlist.h"
+#include <vector>
+#include <algorithm>
+
+namespace trimesh {
+
+#define RADIX_BITS 11
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_MAX_BLOCKS 64
+#define RADIX_MIN_BLOCK 65536
+
+static inline void radix_sort(std::vector<unsigned long long> &keys,
+	std::vector<index_t> &vals, int lo_bits, int hi_bits)
+{
+	size_t n = keys.size();
+	int nblocks = std::min((size_t) RADIX_MAX_BLOCKS,
+		(n + RADIX_MIN_BLOCK - 1) / RADIX_MIN_BLOCK);
+	std::vector<unsigned long long> tmpkeys(n);
+	std::vector<index_t> tmpvals(n);
+	std::vector<size_t> hist((size_t) nblocks * RADIX_BUCKETS);
+
+	std::vector<int> shifts;
+	for (int s = 0; s < lo_bits; s += RADIX_BITS)
+		shifts.push_back(s);
+	for (int s = 0; s < hi_bits; s += RADIX_BITS)
+		shifts.push_back(32 + s);
+
+	for (size_t pass = 0; pass < shifts.size(); pass++) {
+		int shift = shifts[pass];
+
+		// Histogram each block
+#pragma omp parallel for
+		for (int b = 0; b < nblocks; b++) {
+			size_t *h = &hist[(size_t) b * RADIX_BUCKETS];
+			std::fill(h, h + RADIX_BUCKETS, 0);
+			size_t start = n * b / nblocks, end = n * (b+1) / nblocks;
+			for (size_t i = start; i < end; i++)
+				h[(keys[i] >> shift) & (RADIX_BUCKETS-1)]++;
+		}
+
+		// Where each block's share of each bucket starts
+		size_t sum = 0;
+		for (int d = 0; d < RADIX_BUCKETS; d++) {
+			for (int b = 0; b < nblocks; b++) {
+				size_t &h = hist[(size_t) b * RADIX_BUCKETS + d];
+				size_t count = h;
+				h = sum;
+				sum += count;
+			}
+		}
+
+		// Scatter
+#pragma omp parallel for
+		for (int b = 0; b < nblocks; b++) {
+			size_t *h = &hist[(size_t) b * RADIX_BUCKETS];
+			size_t start = n * b / nblocks, end = n * (b+1) / nblocks;
+			for (size_t i = start; i < end; i++) {
+				size_t &pos = h[(keys[i] >> shift) & (RADIX_BUCKETS-1)];
+				tmpkeys[pos] = keys[i];
+				tmpvals[pos] = vals[i];
+				pos++;
+			}
+		}
+		keys.swap(tmpkeys);
+		vals.swap(tmpvals);
+	}
+}
+
+#undef RADIX_BITS
+#undef RADIX_BUCKETS
+#undef RADIX_MAX_BLOCKS
+#undef RADIX_MIN_BLOCK
+
+} // namespace trimesh
+
+#endif
@@ -0,0 +1,281 @@
+#ifndef SHAREDARRAY_H
+#define SHAREDARRAY_H
+/*
+Szymon Rusinkiewicz
+Princeton University
+
+sharedarray.h
+A reference-counted, copy-on-write std::vector.  Copying a SharedArray
+just shares the underlying vector, in O(1), and the vector is copied only
+when one of the sharers changes it.  Used for the arrays in TriMesh, so
+that copying a mesh is cheap and duplicates only what is later modified.
+
+SharedArray<T> has the commonly-used parts of the std::vector interface,
+and converts to a std::vector<T> & for code that wants one.  (Function
+templates taking a std::vector<T> & can't deduce T from it, though: they
+need an overload for SharedArray<T>, or an explicit conversion.)  An
+optional second template argument gives the vector an allocator other
+than std::allocator<T>.
+
+As with other copy-on-write containers, all of the following count as
+changing a SharedArray, and copy the vector first if it is shared:
+ - non-const operator [], at(), front(), back(), begin(), and end(), even
+   if only used for reading (use a const SharedArray & to avoid this),
+ - converting to a non-const std::vector<T> &,
+ - resize(), push_back(), and the like (except that clear() and
+   assignment don't copy anything: they just stop sharing).
+References, pointers, and iterators into the array must not be used to
+change it after the array has been copied, since they would change the
+copy as well.  Elements may be written by several threads of an OpenMP
+parallel region at once, even if that causes the copy; other changes are
+not thread-safe, just as with std::vector.  Different SharedArrays that
+share a vector may be used from different threads.
+
+	SharedArray<point> a(n), b;
+	b = a;          // a and b share the same n points
+	b[0] = p;       // b gets its own copy, then changes it
+*/
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+
+namespace trimesh {
+
+template <class T, class A = std::allocator<T> >
+class SharedArray {
+public:
+	typedef std::vector<T, A> vector_type;
+	typedef typename vector_type::value_type value_type;
+	typedef typename vector_type::size_type size_type;
+	typedef typename vector_type::difference_type difference_type;
+	typedef typename vector_type::reference reference;
+	typedef typename vector_type::const_reference const_reference;
+	typedef typename vector_type::iterator iterator;
+	typedef typename vector_type::const_iterator const_iterator;
+	typedef typename vector_type::reverse_iterator reverse_iterator;
+	typedef typename vector_type::const_reverse_iterator
+		const_reverse_iterator;
+
+private:
+	// The vector, the number of SharedArrays using it, and the one that
+	// may write it without checking further (if any)
+	struct Block {
+		vector_type v;
+		int refs;
+		const SharedArray *owner;
+		Block(const SharedArray *o) : refs(1), owner(o)
+			{}
+		Block(const vector_type &v_, const SharedArray *o) :
+			v(v_), refs(1), owner(o)
+			{}
+	};
+	Block *b;
+
+	// Empty arrays all point to this Block, which is never written or
+	// freed.  Having b never be null keeps read() free of tests.
+	static Block empty_block;
+
+	static void retain(Block *p)
+	{
+		if (p == &empty_block)
+			return;
+#pragma omp atomic
+		p->refs++;
+		p->owner = 0;
+	}
+	static void release(Block *p)
+	{
+		if (p == &empty_block)
+			return;
+		int r;
+#pragma omp atomic capture
+		r = --p->refs;
+		if (!r)
+			delete p;
+	}
+
+	// Whether this is the only array using b
+	bool unique() const
+		{ return b != &empty_block && b->refs == 1; }
+
+	// After b changes hands, make sure the owner is still right
+	void adopt(const SharedArray *from)
+	{
+		if (b->owner == from)
+			b->owner = this;
+	}
+
+	// Make this array the owner of its Block, copying the vector first
+	// if it is shared.  Several threads writing elements may get here at
+	// once, so this is done under a lock.  A thread that saw the old
+	// Block won't write to it, since it isn't this array's to write.
+	vector_type &make_unique()
+	{
+		Block *p;
+#pragma omp critical (trimesh_sharedarray)
+		{
+			p = b;
+			if (p->owner != this) {
+				if (unique()) {
+					p->owner = this;
+				} else {
+					Block *n = new Block(p->v, this);
+#pragma omp flush
+					b = n;
+					release(p);
+					p = n;
+				}
+			}
+		}
+		return p->v;
+	}
+
+	// The vector, for reading or for writing
+	const vector_type &read() const
+		{ return b->v; }
+	vector_type &write()
+		{ return (b->owner == this) ? b->v : make_unique(); }
+
+public:
+	// Constructors and destructor
+	SharedArray() : b(&empty_block)
+		{}
+	explicit SharedArray(size_type n, const T &x = T()) :
+		b(n ? new Block(this) : &empty_block)
+		{ if (n) b->v.assign(n, x); }
+	explicit SharedArray(const vector_type &v) :
+		b(v.empty() ? &empty_block : new Block(v, this))
+		{}
+	template <class I> SharedArray(I first, I last) : b(new Block(this))
+		{ b->v.assign(first, last); }
+	SharedArray(const SharedArray &a) : b(a.b)
+		{ retain(b); }
+	~SharedArray()
+		{ release(b); }
+
+	// Assignment: shares a's vector, or copies v
+	SharedArray &operator = (const SharedArray &a)
+		{ SharedArray tmp(a); swap(tmp); return *this; }
+	SharedArray &operator = (const vector_type &v)
+		{ SharedArray tmp(v); swap(tmp); return *this; }
+#if __cplusplus >= 201103L
+	SharedArray(SharedArray &&a) : b(a.b)
+		{ a.b = &empty_block; adopt(&a); }
+	SharedArray &operator = (SharedArray &&a)
+		{ SharedArray tmp(std::move(a)); swap(tmp); return *this; }
+#endif
+
+	// Exchange contents, without copying
+	void swap(SharedArray &a)
+		{ std::swap(b, a.b); adopt(&a); a.adopt(this); }
+	void swap(vector_type &v)
+		{ write().swap(v); }
+
+	// Whether the vector is shared with another SharedArray
+	bool shared() const
+		{ return b != &empty_block && b->refs != 1; }
+
+	// Conversion to std::vector
+	operator const vector_type & () const
+		{ return read(); }
+	operator vector_type & ()
+		{ return write(); }
+
+	// Size
+	size_type size() const
+		{ return read().size(); }
+	bool empty() const
+		{ return read().empty(); }
+	size_type capacity() const
+		{ return read().capacity(); }
+	size_type max_size() const
+		{ return read().max_size(); }
+
+	// Element access
+	const_reference operator [] (size_type i) const
+		{ return read()[i]; }
+	reference operator [] (size_type i)
+		{ return write()[i]; }
+	const_reference at(size_type i) const
+		{ return read().at(i); }
+	reference at(size_type i)
+		{ return write().at(i); }
+	const_reference front() const
+		{ return read().front(); }
+	reference front()
+		{ return write().front(); }
+	const_reference back() const
+		{ return read().back(); }
+	reference back()
+		{ return write().back(); }
+
+	// Iterators
+	const_iterator begin() const
+		{ return read().begin(); }
+	iterator begin()
+		{ return write().begin(); }
+	const_iterator end() const
+		{ return read().end(); }
+	iterator end()
+		{ return write().end(); }
+	const_reverse_iterator rbegin() const
+		{ return read().rbegin(); }
+	reverse_iterator rbegin()
+		{ return write().rbegin(); }
+	const_reverse_iterator rend() const
+		{ return read().rend(); }
+	reverse_iterator rend()
+		{ return write().rend(); }
+
+	// Changing the size and contents.  Clearing a shared array (or
+	// assigning to it) just drops this array's reference.
+	void clear()
+	{
+		if (unique()) {
+			b->v.clear();
+		} else {
+			release(b);
+			b = &empty_block;
+		}
+	}
+	void resize(size_type n)
+		{ write().resize(n); }
+	void resize(size_type n, const T &x)
+		{ write().resize(n, x); }
+	void reserve(size_type n)
+		{ write().reserve(n); }
+	void push_back(const T &x)
+		{ write().push_back(x); }
+	void pop_back()
+		{ write().pop_back(); }
+	void assign(size_type n, const T &x)
+		{ clear(); write().assign(n, x); }
+	template <class I> void assign(I first, I last)
+		{ vector_type v(first, last); clear(); write().swap(v); }
+	iterator insert(iterator pos, const T &x)
+		{ return write().insert(pos, x); }
+	void insert(iterator pos, size_type n, const T &x)
+		{ write().insert(pos, n, x); }
+	template <class I> void insert(iterator pos, I first, I last)
+		{ write().insert(pos, first, last); }
+	iterator erase(iterator pos)
+		{ return write().erase(pos); }
+	iterator erase(iterator first, iterator last)
+		{ return write().erase(first, last); }
+
+	// Give back memory reserved beyond the size, unless shared
+	void shrink_to_fit()
+	{
+		if (unique() && b->v.capacity() > b->v.size())
+			vector_type(b->v).swap(b->v);
+	}
+};
+
+template <class T, class A>
+typename SharedArray<T, A>::Block SharedArray<T, A>::empty_block(0);
+
+} // end namespace trimesh
+
+#endif
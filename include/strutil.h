@@ -12,11 +12,16 @@ Usage:
 	std::string s2 = replace_ext(s, "baz");  // "foo.baz"
 	begins_with("Foobar", "foo") // true
 	ends_with("foobar", "baz") // false
+
+	const char *p = "1.5 2", *end = p + strlen(p);
+	float x; int i;
+	parse_float(p, end, x) && parse_int(p, end, i)  // true, x = 1.5, i = 2
 */
 
 
 #include <string>
 #include <cstring>
+#include <cstdlib>
 namespace trimesh {
 
 #ifdef _WIN32
@@ -65,5 +70,131 @@ static inline bool ends_with(const std::string &s1, const std::string &s2)
 	return ends_with(s1.c_str(), s2.c_str());
 }
 
+
+// Is c white space, in the sense of isspace() in the "C" locale?
+static inline bool is_space(char c)
+{
+	return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+static inline bool is_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
+
+
+// Parse an integer from the text in [p, end), skipping leading white space.
+// Like sscanf(p, "%d", &x), but doesn't need p to be null-terminated.
+// On success, advances p past the number.
+static inline bool parse_int(const char *&p, const char *end, int &x)
+{
+	const char *q = p;
+	while (q < end && is_space(*q))
+		q++;
+	bool neg = false;
+	if (q < end && (*q == '-' || *q == '+'))
+		neg = (*q++ == '-');
+	if (q == end || !is_digit(*q))
+		return false;
+	long long val = 0;
+	while (q < end && is_digit(*q)) {
+		if (val < (1LL << 40))
+			val = 10 * val + (*q - '0');
+		q++;
+	}
+	x = int(neg ? -val : val);
+	p = q;
+	return true;
+}
+
+
+// Parse a floating-point number from the text in [p, end), skipping leading
+// white space.  Like sscanf(p, "%f", &x), but doesn't need p to be
+// null-terminated.  Numbers with few enough significant digits are converted
+// exactly with a single floating-point operation; anything else (long
+// mantissas, big exponents, inf, nan, hex) is handed to strtof.
+// On success, advances p past the number.
+static inline bool parse_float(const char *&p, const char *end, float &x)
+{
+	static const float powers_of_10[] = { 1e0f, 1e1f, 1e2f, 1e3f,
+		1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+
+	const char *q = p;
+	while (q < end && is_space(*q))
+		q++;
+	const char *start = q;
+	bool neg = false;
+	if (q < end && (*q == '-' || *q == '+'))
+		neg = (*q++ == '-');
+
+	// Mantissa
+	unsigned long long m = 0;
+	int e = 0;
+	bool any_digits = false, too_long = false;
+	for ( ; q < end && is_digit(*q); q++) {
+		any_digits = true;
+		if (m >= 100000000000000000ULL)
+			too_long = true;
+		else
+			m = 10 * m + (*q - '0');
+	}
+	if (q < end && *q == '.') {
+		for (q++; q < end && is_digit(*q); q++) {
+			any_digits = true;
+			if (m >= 100000000000000000ULL)
+				too_long = true;
+			else
+				m = 10 * m + (*q - '0'), e--;
+		}
+	}
+
+	// Exponent
+	if (any_digits && q < end && (*q == 'e' || *q == 'E')) {
+		const char *r = q + 1;
+		bool eneg = false;
+		if (r < end && (*r == '-' || *r == '+'))
+			eneg = (*r++ == '-');
+		if (r < end && is_digit(*r)) {
+			int ee = 0;
+			for ( ; r < end && is_digit(*r); r++)
+				if (ee < 10000)
+					ee = 10 * ee + (*r - '0');
+			e += eneg ? -ee : ee;
+			q = r;
+		}
+	}
+
+	// Fast path: mantissa and power of 10 both exactly representable
+	bool alnum_follows = (q < end && (*q == '.' || is_digit(*q) ||
+		((*q | 0x20) >= 'a' && (*q | 0x20) <= 'z')));
+	if (any_digits && !too_long && !alnum_follows &&
+	    m <= (1u << 24) && e >= -10 && e <= 10) {
+		float val = float(m);
+		if (e < 0)
+			val /= powers_of_10[-e];
+		else
+			val *= powers_of_10[e];
+		x = neg ? -val : val;
+		p = q;
+		return true;
+	}
+
+	// Slow path
+	char buf[64];
+	size_t len = 0;
+	while (start + len < end && len < sizeof(buf) - 1 &&
+	       !is_space(start[len]))
+		len++;
+	memcpy(buf, start, len);
+	buf[len] = '\0';
+	char *bufend;
+	float val = strtof(buf, &bufend);
+	if (bufend == buf)
+		return false;
+	x = val;
+	p = start + (bufend - buf);
+	return true;
+}
+
 } // end namespace trimesh
 #endif
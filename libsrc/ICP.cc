@@ -847,6 +847,8 @@ float ICP(TriMesh *s1, TriMesh *s2, const xform &xf1, xform &xf2,
 	  int verbose /* = 0 */,
 	  bool do_scale /* = false */, bool do_affine /* = false */)
 {
+	s1->need_vertices();
+	s2->need_vertices();
 	KDtree *kd1 = new KDtree(s1->vertices);
 	KDtree *kd2 = new KDtree(s2->vertices);
 	std::vector<float> weights1, weights2;
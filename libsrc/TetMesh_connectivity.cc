@@ -15,34 +15,9 @@ void TetMesh::need_neighbors()
 	need_elements();
 
 	dprintf("Finding vertex neighbors... ");
-	int nn = nodes.size(), ne = elements.size();
-
-	std::vector<int> numneighbors(nn);
-	for (int i = 0; i < ne; i++) {
-		numneighbors[elements[i][0]]++;
-		numneighbors[elements[i][1]]++;
-		numneighbors[elements[i][2]]++;
-		numneighbors[elements[i][3]]++;
-	}
-
-	neighbors.resize(nn);
-	for (int i = 0; i < nn; i++)
-	  neighbors[i].reserve(numneighbors[i]+3); // Slop for boundaries
-
-	for (int i = 0; i < ne; i++) {
-	  for (int j = 0; j < 4; j++) {
-	    std::vector<int> &me = neighbors[elements[i][j]];
-	    int n1 = elements[i][(j+1)%4];
-	    int n2 = elements[i][(j+2)%4];
-	    int n3 = elements[i][(j+3)%4];
-	    if (find(me.begin(), me.end(), n1) == me.end())
-	      me.push_back(n1);
-	    if (find(me.begin(), me.end(), n2) == me.end())
-	      me.push_back(n2);
-	    if (find(me.begin(), me.end(), n3) == me.end())
-	      me.push_back(n3);
-	  }
-	}
+	if (!elements.empty())
+	  neighbors.build_neighbors(nodes.size(), &elements[0][0],
+				    elements.size(), 4);
 
 	dprintf("Done.\n");
 }
@@ -7,122 +7,436 @@
 #include "TriMesh.h"
 #include "TetMesh.h"
 #include "strutil.h"
+#include "mapfile.h"
+#include <algorithm>
 
 namespace trimesh {
 
 #define dprintf TriMesh::dprintf
 #define eprintf TriMesh::eprintf
 
-  bool read_tetgen(const char* filename, TetMesh* mesh) {
-    int n, nothing;
+#define TETGEN_CHUNK_SIZE (4 << 20)
 
-    // read .node
-    std::vector<point> nodes_cpy;
-    std::vector<TetMesh::Element> elements_cpy;
+  // A tetgen file, in memory: mapped if possible, otherwise read in
+  struct TetgenText {
+    MappedFile map;
+    std::vector<char> buf;
+    const char *begin, *end;
 
-    FILE* f = fopen(filename, "rb");
-    if (!f) {
-      eprintf("Error opening [%s] for reading: %s.\n", filename,
-	      strerror(errno));
-      return false;    
+    bool open(const char *filename)
+    {
+      if (map.open(filename)) {
+	begin = (const char *) map.data();
+	end = begin + map.size();
+	return true;
+      }
+      FILE *f = fopen(filename, "rb");
+      if (!f) {
+	eprintf("Error opening [%s] for reading: %s.\n", filename,
+		strerror(errno));
+	return false;
+      }
+      char tmp[65536];
+      size_t n;
+      while ((n = fread(tmp, 1, sizeof(tmp), f)) > 0)
+	buf.insert(buf.end(), tmp, tmp + n);
+      bool ok = !ferror(f);
+      fclose(f);
+      buf.push_back('\n');
+      begin = &buf[0];
+      end = begin + buf.size();
+      return ok;
     }
-    
-    fscanf(f, "%d %d %d %d",  &n, &nothing, &nothing, &nothing);
-    dprintf("#nodes: %d\t", n);
-    for (int i=0; i<n; ++i) {
-      point p;
-      fscanf(f, "%d %f %f %f", &nothing, &p[0], &p[1], &p[2]);
-      nodes_cpy.push_back(p);
+  };
+
+
+  // Skip blank lines and # comments, returning the start of the next
+  // line with something on it, or end
+  static const char *tetgen_skip(const char *p, const char *end)
+  {
+    while (p < end) {
+      if (*p == '#') {
+	const char *eol = (const char *) memchr(p, '\n', end - p);
+	p = eol ? eol : end;
+      } else if (!isspace(*p)) {
+	break;
+      }
+      if (p < end)
+	p++;
     }
-    fclose(f);
+    return p;
+  }
 
-    // read .ele
-    f = fopen(replace_ext(filename,"ele").c_str(), "rb");
-    if (!f) {
-      eprintf("Error opening [%s] for reading: %s.\n", filename,
-	      strerror(errno));
-      return false;    
+
+  static inline const char *tetgen_eol(const char *p, const char *end)
+  {
+    const char *eol = (const char *) memchr(p, '\n', end - p);
+    return eol ? eol : end;
+  }
+
+
+  // Parse the header line of a tetgen file, which holds up to 4 numbers,
+  // and return the start of the first record
+  static const char *tetgen_header(const char *p, const char *end,
+				   int *vals, int nvals)
+  {
+    p = tetgen_skip(p, end);
+    const char *eol = tetgen_eol(p, end);
+    for (int i = 0; i < nvals; i++)
+      if (!parse_int(p, eol, vals[i]))
+	vals[i] = 0;
+    return eol;
+  }
+
+
+  // Parse the n records (one per line) that follow the header of a
+  // tetgen file.  The text is split into chunks, which are first counted
+  // and then parsed in parallel, each record going straight into its
+  // place.  parse(i, p, eol) parses record i from the line [p, eol).
+  template <class Parser>
+  static bool tetgen_records(const char *p, const char *end, int n,
+			     const Parser &parse)
+  {
+    std::vector<const char *> start(1, p);
+    while (size_t(end - start.back()) > TETGEN_CHUNK_SIZE) {
+      const char *q = tetgen_eol(start.back() + TETGEN_CHUNK_SIZE, end);
+      if (end - q <= 1)
+	break;
+      start.push_back(q + 1);
     }
-    
-    fscanf(f, "%d %d %d", &n, &nothing, &nothing);
-    dprintf("#elements: %d\t",n);
-    for (int i=0; i<n; ++i) {
-      TetMesh::Element e;
-      fscanf(f, "%d %d %d %d %d", &nothing, &e[0], &e[1], &e[2], &e[3]);
-      elements_cpy.push_back(e);
+    start.push_back(end);
+    int nchunks = start.size() - 1;
+
+    std::vector<int> first(nchunks + 1, 0);
+#pragma omp parallel for
+    for (int i = 0; i < nchunks; i++) {
+      int count = 0;
+      const char *q = tetgen_skip(start[i], start[i+1]);
+      while (q < start[i+1]) {
+	count++;
+	q = tetgen_skip(tetgen_eol(q, start[i+1]), start[i+1]);
+      }
+      first[i+1] = count;
+    }
+    for (int i = 0; i < nchunks; i++)
+      first[i+1] += first[i];
+    if (first[nchunks] < n) {
+      eprintf("Expected %d records, found %d.\n", n, first[nchunks]);
+      return false;
+    }
+
+    int nbad = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+ : nbad)
+    for (int i = 0; i < nchunks; i++) {
+      int rec = first[i];
+      const char *q = tetgen_skip(start[i], start[i+1]);
+      while (q < start[i+1] && rec < n) {
+	const char *eol = tetgen_eol(q, start[i+1]);
+	if (!parse(rec++, q, eol))
+	  nbad++;
+	q = tetgen_skip(eol, start[i+1]);
+      }
+    }
+    if (nbad) {
+      eprintf("Couldn't parse %d records.\n", nbad);
+      return false;
+    }
+    return true;
+  }
+
+
+  // Record parsers: each record starts with its own index, which is
+  // ignored except for the first node's, which says whether indices
+  // start at 0 or 1.
+  struct TetgenNodeParser {
+    point *nodes;
+    int *firstnumber;
+    bool operator () (int i, const char *p, const char *eol) const
+    {
+      int ind;
+      if (!parse_int(p, eol, ind))
+	return false;
+      if (i == 0)
+	*firstnumber = ind;
+      return parse_float(p, eol, nodes[i][0]) &&
+	parse_float(p, eol, nodes[i][1]) &&
+	parse_float(p, eol, nodes[i][2]);
+    }
+  };
+
+  struct TetgenIndexParser {
+    index_t *inds;
+    int ninds;
+    bool operator () (int i, const char *p, const char *eol) const
+    {
+      int ind;
+      if (!parse_int(p, eol, ind))
+	return false;
+      for (int j = 0; j < ninds; j++) {
+	if (!parse_int(p, eol, ind))
+	  return false;
+	inds[ninds*i+j] = ind;
+      }
+      return true;
+    }
+  };
+
+
+  // Read a mesh output by tetgen, as example.1.node together with
+  // example.1.ele and example.1.face.  Nodes are renumbered so that those
+  // on the boundary surface come first, in order of appearance in the
+  // faces, and mesh->surface holds the boundary.
+  bool read_tetgen(const char* filename, TetMesh* mesh) {
+    TetgenText node_text, ele_text, face_text;
+    if (!node_text.open(filename) ||
+	!ele_text.open(replace_ext(filename, "ele").c_str()) ||
+	!face_text.open(replace_ext(filename, "face").c_str()))
+      return false;
+
+    int node_header[4], ele_header[3], face_header[2];
+    const char *node_p = tetgen_header(node_text.begin, node_text.end,
+				       node_header, 4);
+    const char *ele_p = tetgen_header(ele_text.begin, ele_text.end,
+				      ele_header, 3);
+    const char *face_p = tetgen_header(face_text.begin, face_text.end,
+				       face_header, 2);
+    int nnodes = node_header[0], nele = ele_header[0];
+    int nfaces = face_header[0];
+    dprintf("#nodes: %d\t#elements: %d\t#faces: %d\n", nnodes, nele, nfaces);
+    if (nnodes <= 0 || nele < 0 || nfaces < 0)
+      return false;
+
+    // Read straight into preallocated arrays.  The node indices in
+    // elements and faces get fixed up below.
+    std::vector<point> nodes_in(nnodes);
+    mesh->elements.resize(nele);
+    mesh->surface.faces.resize(nfaces);
+    int firstnumber = 0;
+    TetgenNodeParser node_parser = { &nodes_in[0], &firstnumber };
+    if (!tetgen_records(node_p, node_text.end, nnodes, node_parser))
+      return false;
+    if (nele) {
+      TetgenIndexParser ele_parser = { &mesh->elements[0][0], 4 };
+      if (!tetgen_records(ele_p, ele_text.end, nele, ele_parser))
+	return false;
+    }
+    if (nfaces) {
+      TetgenIndexParser face_parser = { &mesh->surface.faces[0][0], 3 };
+      if (!tetgen_records(face_p, face_text.end, nfaces, face_parser))
+	return false;
     }
-    fclose(f);
 
-    // read .face
     // note for tetrahedron mesh generated from triangle mesh by tetgen
     //   ./tetgen -pq1.2Y test.off
     // the surface nodes are in first inserted to nodes array, and then
     // interior nodes are subsequently inserted thereafter.
-    f = fopen(replace_ext(filename,"face").c_str(), "rb");
-    if (!f) {
-      eprintf("Error opening [%s] for reading: %s.\n", filename,
-	      strerror(errno));
-      return false;    
-    }
-    fscanf(f, "%d %d", &n, &nothing);
-    dprintf("#faces: %d\n",n);
-    std::vector<int> nodes_on_surface(nodes_cpy.size(), -1);
-    int count=0, idx;
-    for (int i=0; i<n; ++i) {
-      fscanf(f, "%d", &nothing);
-      TriMesh::Face thisface;
-
-      for (int j=0; j<3; ++j) {
-	fscanf(f, "%d", &idx);
-
-	if (nodes_on_surface[idx] == -1) {
-	  nodes_on_surface[idx]=count++;
-	  mesh->surface.vertices.push_back(nodes_cpy[idx]);
+    std::vector<int> nodes_on_surface(nnodes, -1);
+    int count = 0;
+    for (int i = 0; i < nfaces; ++i) {
+      TriMesh::Face &thisface = mesh->surface.faces[i];
+      for (int j = 0; j < 3; ++j) {
+	int idx = thisface[j] - firstnumber;
+	if (idx < 0 || idx >= nnodes) {
+	  eprintf("Face %d refers to a nonexistent node.\n", i);
+	  return false;
 	}
-
+	if (nodes_on_surface[idx] == -1)
+	  nodes_on_surface[idx] = count++;
 	thisface[j] = nodes_on_surface[idx];
-
-	/*	
-		if (idx+1 > count) count = idx +1;
-		thisface[j] = idx;
-	*/
       }
-
-      while (1) {int c = fgetc(f);if (c == EOF || c == '\n') break;}
-
       //face flip
       std::swap(thisface[0], thisface[2]);
-            
-      mesh->surface.faces.push_back(thisface);
     }
-    dprintf("#nodes on boundary surface: %d\n", count);
-    
-    for (int i=0; i<nodes_cpy.size(); ++i)
+    int nsurface = count;
+    dprintf("#nodes on boundary surface: %d\n", nsurface);
+
+    for (int i = 0; i < nnodes; ++i)
       if (nodes_on_surface[i] == -1) nodes_on_surface[i] = count ++;
 
-    mesh->nodes.resize(nodes_cpy.size());
-    for (int i=0; i<nodes_cpy.size(); ++i)
-      mesh->nodes[nodes_on_surface[i]] = nodes_cpy[i];
+    mesh->nodes.resize(nnodes);
+#pragma omp parallel for
+    for (int i = 0; i < nnodes; ++i)
+      mesh->nodes[nodes_on_surface[i]] = nodes_in[i];
+    mesh->surface.vertices.assign(mesh->nodes.begin(),
+				  mesh->nodes.begin() + nsurface);
+
+    int nbad = 0;
+#pragma omp parallel for reduction(+ : nbad)
+    for (int i = 0; i < nele; ++i) {
+      for (int j = 0; j < 4; ++j) {
+	int idx = mesh->elements[i][j] - firstnumber;
+	if (idx < 0 || idx >= nnodes) {
+	  nbad++;
+	  idx = 0;
+	}
+	mesh->elements[i][j] = nodes_on_surface[idx];
+      }
+    }
+    if (nbad) {
+      eprintf("%d element indices out of range.\n", nbad);
+      return false;
+    }
 
-    mesh->elements.resize(elements_cpy.size());
-    for (int i=0; i<elements_cpy.size(); ++i) {
-      mesh->elements[i][0] = nodes_on_surface[elements_cpy[i][0]];
-      mesh->elements[i][1] = nodes_on_surface[elements_cpy[i][1]];
-      mesh->elements[i][2] = nodes_on_surface[elements_cpy[i][2]];
-      mesh->elements[i][3] = nodes_on_surface[elements_cpy[i][3]];
+    FILE *f = fopen("default_remap.txt","wb");
+    if (f) {
+      for (int i = 0; i < nnodes; ++i)
+	fprintf(f, "%d\n", nodes_on_surface[i]);
+      fclose(f);
     }
-    //    mesh->surface.vertices = std::vector<point> (mesh->nodes.begin(), mesh->nodes.begin() + count);
 
+    return true;
+  }
+
+
+  // The tmb format: a native binary dump of a TetMesh.  A 128-byte
+  // TmbHeader is followed by the nodes, the elements, and the vertices and
+  // faces of the boundary surface, each a raw array in native byte order
+  // starting at a multiple of 64 bytes, to be copied straight out of a
+  // memory map.
+#define TMB_VERSION 1
+#define TMB_BYTE_ORDER 0x01020304u
+#define TMB_ALIGN 64
+
+  enum { TMB_NODES, TMB_ELEMENTS, TMB_SURFACE_VERTS, TMB_SURFACE_FACES,
+	 TMB_NARRAYS };
+
+  struct TmbHeader {
+    char magic[4];		// "TMB\0"
+    unsigned version;
+    unsigned byte_order;	// TMB_BYTE_ORDER, as seen by the writer
+    unsigned reserved0;
+    unsigned long long count[TMB_NARRAYS];
+    unsigned long long offset[TMB_NARRAYS];	// From start of file
+    unsigned reserved[12];
+  };
+
+  static const size_t tmb_elem_size[TMB_NARRAYS] = {
+    sizeof(point), sizeof(TetMesh::Element),
+    sizeof(point), sizeof(TriMesh::Face)
+  };
+
+
+  // Read a tmb file
+  static bool read_tmb(const char *filename, TetMesh *mesh)
+  {
+    FILE *f = fopen(filename, "rb");
+    if (!f) {
+      eprintf("Error opening [%s] for reading: %s.\n", filename,
+	      strerror(errno));
+      return false;
+    }
+    TmbHeader h;
+    if (fread(&h, sizeof(h), 1, f) != 1 || memcmp(h.magic, "TMB", 4) ||
+	h.version != TMB_VERSION || h.byte_order != TMB_BYTE_ORDER) {
+      eprintf("Unknown file type, or unsupported version of tmb.\n");
+      fclose(f);
+      return false;
+    }
+
+    // Files on disk are copied out of a memory map, after making sure
+    // the arrays fit in it.  Otherwise, read through the stream,
+    // skipping the padding between arrays.
+    MappedFile map;
+    map.open(f);
+    for (int i = 0; i < TMB_NARRAYS && map.valid(); i++) {
+      unsigned long long n = h.count[i] * tmb_elem_size[i];
+      if (h.count[i] > map.size() || h.offset[i] > map.size() ||
+	  n > map.size() - h.offset[i]) {
+	eprintf("Truncated or corrupt tmb file.\n");
+	fclose(f);
+	return false;
+      }
+    }
+
+    void *dst[TMB_NARRAYS];
+    mesh->nodes.resize(h.count[TMB_NODES]);
+    mesh->elements.resize(h.count[TMB_ELEMENTS]);
+    mesh->surface.vertices.resize(h.count[TMB_SURFACE_VERTS]);
+    mesh->surface.faces.resize(h.count[TMB_SURFACE_FACES]);
+    dst[TMB_NODES] = mesh->nodes.empty() ? 0 : &mesh->nodes[0];
+    dst[TMB_ELEMENTS] = mesh->elements.empty() ? 0 : &mesh->elements[0];
+    dst[TMB_SURFACE_VERTS] = mesh->surface.vertices.empty() ? 0 :
+      &mesh->surface.vertices[0];
+    dst[TMB_SURFACE_FACES] = mesh->surface.faces.empty() ? 0 :
+      &mesh->surface.faces[0];
+    dprintf("\n  Reading %d nodes and %d elements... ",
+	    (int) mesh->nodes.size(), (int) mesh->elements.size());
+
+    unsigned long long pos = sizeof(h);
+    bool ok = true;
+    for (int i = 0; i < TMB_NARRAYS && ok; i++) {
+      unsigned long long n = h.count[i] * tmb_elem_size[i];
+      if (!n)
+	continue;
+      if (map.valid()) {
+	copy_mapped(dst[i], map.data() + h.offset[i], n);
+	continue;
+      }
+      char buf[TMB_ALIGN];
+      ok = (h.offset[i] >= pos);
+      while (ok && pos < h.offset[i]) {
+	size_t skip = std::min((unsigned long long) sizeof(buf),
+			       h.offset[i] - pos);
+	ok = (fread(buf, skip, 1, f) == 1);
+	pos += skip;
+      }
+      ok = ok && fread(dst[i], n, 1, f) == 1;
+      pos += n;
+    }
     fclose(f);
-    
-    f = fopen("default_remap.txt","wb");
-    for (int i=0; i<nodes_cpy.size(); ++i) 
-      fprintf(f, "%d\n", nodes_on_surface[i]);
-    fclose(f);
+    return ok;
+  }
 
-    return true;
+
+  // Write a tmb file
+  static bool write_tmb(TetMesh *mesh, const char *filename)
+  {
+    FILE *f = fopen(filename, "wb");
+    if (!f) {
+      eprintf("Error opening [%s] for writing: %s.\n", filename,
+	      strerror(errno));
+      return false;
+    }
+
+    TmbHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, "TMB", 4);
+    h.version = TMB_VERSION;
+    h.byte_order = TMB_BYTE_ORDER;
+    h.count[TMB_NODES] = mesh->nodes.size();
+    h.count[TMB_ELEMENTS] = mesh->elements.size();
+    h.count[TMB_SURFACE_VERTS] = mesh->surface.vertices.size();
+    h.count[TMB_SURFACE_FACES] = mesh->surface.faces.size();
+    const void *src[TMB_NARRAYS] = {
+      mesh->nodes.empty() ? 0 : &mesh->nodes[0],
+      mesh->elements.empty() ? 0 : &mesh->elements[0],
+      mesh->surface.vertices.empty() ? 0 : &mesh->surface.vertices[0],
+      mesh->surface.faces.empty() ? 0 : &mesh->surface.faces[0]
+    };
+    unsigned long long pos = sizeof(h);
+    for (int i = 0; i < TMB_NARRAYS; i++) {
+      pos = (pos + TMB_ALIGN - 1) / TMB_ALIGN * TMB_ALIGN;
+      h.offset[i] = pos;
+      pos += h.count[i] * tmb_elem_size[i];
+    }
+
+    bool ok = (fwrite(&h, sizeof(h), 1, f) == 1);
+    pos = sizeof(h);
+    static const char zeros[TMB_ALIGN] = { 0 };
+    for (int i = 0; i < TMB_NARRAYS && ok; i++) {
+      unsigned long long n = h.count[i] * tmb_elem_size[i];
+      if (h.offset[i] > pos)
+	ok = (fwrite(zeros, h.offset[i] - pos, 1, f) == 1);
+      if (ok && n)
+	ok = (fwrite(src[i], n, 1, f) == 1);
+      pos = h.offset[i] + n;
+    }
+    if (fclose(f) != 0)
+      ok = false;
+    return ok;
   }
 
+
   bool write_tetgen(TetMesh* mesh, const char* filename) {
     FILE *f = NULL;
 
@@ -140,9 +454,9 @@ namespace trimesh {
     }
 
 
-    fprintf(f,"%4d   3   0   0\n", (int) mesh->nodes.size());
-    for (int i = 0; i<mesh->nodes.size(); ++i) {
-      fprintf(f,"%4d    %.10f    %.10f    %.10f\n", i, 
+    fprintf(f,"%4lld   3   0   0\n", (long long) mesh->nodes.size());
+    for (size_t i = 0; i<mesh->nodes.size(); ++i) {
+      fprintf(f,"%4lld    %.10f    %.10f    %.10f\n", (long long) i, 
 	      mesh->nodes[i][0], mesh->nodes[i][1], mesh->nodes[i][2]);
     }
 
@@ -150,20 +464,23 @@ namespace trimesh {
     
     // write .ele
     f = fopen(replace_ext(filename, "ele").c_str(), "wb");
-    fprintf(f,"%4d    4    0\n", (int) mesh->elements.size());
-    for (int i = 0; i<mesh->elements.size(); ++i) {
-      fprintf(f, "%4d    %4d    %4d    %4d    %4d\n", i, 
-	   mesh->elements[i][0], mesh->elements[i][1], mesh->elements[i][2], mesh->elements[i][3]);
+    fprintf(f,"%4lld    4    0\n", (long long) mesh->elements.size());
+    for (size_t i = 0; i<mesh->elements.size(); ++i) {
+      fprintf(f, "%4lld    %4lld    %4lld    %4lld    %4lld\n", (long long) i,
+	   (long long) mesh->elements[i][0], (long long) mesh->elements[i][1],
+	   (long long) mesh->elements[i][2], (long long) mesh->elements[i][3]);
     }
     fclose(f);
 
     // write .face
     f = fopen(replace_ext(filename, "face").c_str(), "wb");
-    fprintf(f,"%4d    0\n", (int) mesh->surface.faces.size());
-    for (int i = 0; i<mesh->surface.faces.size(); ++i) {
+    fprintf(f,"%4lld    0\n", (long long) mesh->surface.faces.size());
+    for (size_t i = 0; i<mesh->surface.faces.size(); ++i) {
       // remember face flip
-      fprintf(f, "%4d    %4d    %4d    %4d\n", i,
-	      mesh->surface.faces[i][2], mesh->surface.faces[i][1], mesh->surface.faces[i][0]);
+      fprintf(f, "%4lld    %4lld    %4lld    %4lld\n", (long long) i,
+	      (long long) mesh->surface.faces[i][2],
+	      (long long) mesh->surface.faces[i][1],
+	      (long long) mesh->surface.faces[i][0]);
     }
     fclose(f);
 
@@ -184,8 +501,8 @@ namespace trimesh {
     if (!filename || *filename == '\0')
       return false;
     bool ok = false;
+    dprintf("Reading %s... ", filename);
 
-    
     // Read tetgen generated format 
 
     // read example.1.node
@@ -194,6 +511,9 @@ namespace trimesh {
       goto out;
     }
 
+    // Else our own binary format
+    ok = read_tmb(filename, mesh);
+
 out:
 	if (!ok || mesh->nodes.empty()) {
 		eprintf("Error reading file [%s].\n", filename);
@@ -218,11 +538,16 @@ out:
       return false;
     }
 
-    enum { TETGEN } filetype;
+    enum { TETGEN, TMB } filetype;
 
-    
-    if (ends_with(filename, ".node"))
+    if (ends_with(filename, ".node")) {
       filetype = TETGEN;
+    } else if (ends_with(filename, ".tmb")) {
+      filetype = TMB;
+    } else {
+      eprintf("Unknown file type [%s].\n", filename);
+      return false;
+    }
 
 
     dprintf("Writing %s... ", filename);
@@ -232,6 +557,9 @@ out:
     case TETGEN:
       ok = write_tetgen(this, filename);
       break;
+    case TMB:
+      ok = write_tmb(this, filename);
+      break;
     default:
       break;
     }
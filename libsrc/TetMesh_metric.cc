@@ -1,4 +1,7 @@
 #include "TetMesh.h"
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
 
 namespace trimesh {
   void TetMesh::need_tetravolumes() 
@@ -36,21 +39,46 @@ namespace trimesh {
     }    
   }
 
+  // Area of each facet of each element, with the 4 facets of an element
+  // done together: with SSE2, lane j holds the facet opposite node j.
   void TetMesh::need_facetareas()
   {
     int en = elements.size();
     if (facetareas.size() == en) return;
     else facetareas.resize(en);
 
-
 #pragma omp parallel for
     for (int i=0; i<en; ++i) {
+      const point &p0 = nodes[elements[i][0]], &p1 = nodes[elements[i][1]],
+	&p2 = nodes[elements[i][2]], &p3 = nodes[elements[i][3]];
+#ifdef __SSE2__
+      // Facet j is nodes (j+1, j+2, j+3) % 4
+      __m128 a[3], b[3], c[3];
+      for (int k=0; k<3; ++k) {
+	a[k] = _mm_setr_ps(p1[k], p2[k], p3[k], p0[k]);
+	b[k] = _mm_setr_ps(p2[k], p3[k], p0[k], p1[k]);
+	c[k] = _mm_setr_ps(p3[k], p0[k], p1[k], p2[k]);
+      }
+      __m128 v1[3], v2[3];
+      for (int k=0; k<3; ++k) {
+	v1[k] = _mm_sub_ps(b[k], a[k]);
+	v2[k] = _mm_sub_ps(c[k], a[k]);
+      }
+      __m128 nx = _mm_sub_ps(_mm_mul_ps(v1[1], v2[2]), _mm_mul_ps(v1[2], v2[1]));
+      __m128 ny = _mm_sub_ps(_mm_mul_ps(v1[2], v2[0]), _mm_mul_ps(v1[0], v2[2]));
+      __m128 nz = _mm_sub_ps(_mm_mul_ps(v1[0], v2[1]), _mm_mul_ps(v1[1], v2[0]));
+      __m128 l2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)),
+			     _mm_mul_ps(nz, nz));
+      _mm_storeu_ps(&facetareas[i][0],
+		    _mm_mul_ps(_mm_set1_ps(0.5f), _mm_sqrt_ps(l2)));
+#else
+      const point *p[4] = { &p0, &p1, &p2, &p3 };
       for (int j=0; j<4; ++j) {
-	vec v1 = nodes[elements[i][(j+2)%4]] - nodes[elements[i][(j+1)%4]],
-	  v2 = nodes[elements[i][(j+3)%4]] - nodes[elements[i][(j+1)%4]];
-	vec norm = v1 CROSS v2;
-	facetareas[i].push_back(std::fabs(norm DOT norm)/2.);
+	vec v1 = *p[(j+2)%4] - *p[(j+1)%4],
+	  v2 = *p[(j+3)%4] - *p[(j+1)%4];
+	facetareas[i][j] = 0.5f * len(v1 CROSS v2);
       }
+#endif
     }
   }
 }
@@ -16,17 +16,31 @@ namespace trimesh {
 // Find axis-aligned bounding box of the vertices
 void TriMesh::need_bbox()
 {
-	if (vertices.empty() || bbox.valid)
+	if ((vertices.empty() && !is_compact()) ||
+	    (bbox.valid && geometry_current(bbox_gen)))
 		return;
 
 	dprintf("Computing bounding box... ");
 
-	for (int i = 0; i < vertices.size(); i++)
+	bbox.clear();
+	if (is_compact()) {
+		// Decode a block at a time
+		point p[1024];
+		size_t nv = compact.pos.size() / 3;
+		for (size_t i = 0; i < nv; i += 1024) {
+			size_t n = std::min(nv - i, (size_t) 1024);
+			decode_positions(i, n, p);
+			for (size_t j = 0; j < n; j++)
+				bbox += p[j];
+		}
+	}
+	for (size_t i = 0; i < vertices.size(); i++)
 		bbox += vertices[i];
 
 	dprintf("Done.\n  x = %g .. %g, y = %g .. %g, z = %g .. %g\n",
 		bbox.min[0], bbox.max[0], bbox.min[1],
 		bbox.max[1], bbox.min[2], bbox.max[2]);
+	bbox_gen = generation;
 }
 
 
@@ -37,7 +51,8 @@ void TriMesh::need_bbox()
 // Compute bounding sphere of the vertices.
 void TriMesh::need_bsphere()
 {
-	if (vertices.empty() || bsphere.valid)
+	need_vertices();
+	if (vertices.empty() || (bsphere.valid && geometry_current(bsphere_gen)))
 		return;
 
 	dprintf("Computing bounding sphere... ");
@@ -48,6 +63,7 @@ void TriMesh::need_bsphere()
 	bsphere.center = mb.center();
 	bsphere.r = std::sqrt(mb.squared_radius());
 	bsphere.valid = true; 
+	bsphere_gen = generation;
 
 	dprintf("Done.\n  center = (%g, %g, %g), radius = %g\n",
 		bsphere.center[0], bsphere.center[1],
@@ -57,15 +73,15 @@ void TriMesh::need_bsphere()
 #else
 
 // Find extreme vertex in a given direction
-static int farthest_vertex_along(const TriMesh &t, const vec &dir)
+static size_t farthest_vertex_along(const TriMesh &t, const vec &dir)
 {
 	const vector<point> &v = t.vertices;
-	int nv = v.size();
+	size_t nv = v.size();
 
-	int farthest = 0;
+	size_t farthest = 0;
 	float farthest_dot = v[0] DOT dir;
 
-	for (int i = 1; i < nv; i++) {
+	for (size_t i = 1; i < nv; i++) {
 		float my_dot = v[i] DOT dir;
 		if (my_dot > farthest_dot)
 			farthest = i, farthest_dot = my_dot;
@@ -77,7 +93,8 @@ static int farthest_vertex_along(const TriMesh &t, const vec &dir)
 // Approximate bounding sphere code based on an algorithm by Ritter
 void TriMesh::need_bsphere()
 {
-	if (vertices.empty() || bsphere.valid)
+	need_vertices();
+	if (vertices.empty() || (bsphere.valid && geometry_current(bsphere_gen)))
 		return;
 
 	need_bbox();
@@ -92,7 +109,7 @@ void TriMesh::need_bsphere()
 	dirs.push_back(vec(1,-1,1));
 	dirs.push_back(vec(1,-1,-1));
 	dirs.push_back(vec(1,1,-1));
-	for (int i = 0; i < dirs.size(); i++) {
+	for (size_t i = 0; i < dirs.size(); i++) {
 		point p1 = vertices[farthest_vertex_along(*this, -dirs[i])];
 		point p2 = vertices[farthest_vertex_along(*this,  dirs[i])];
 		if (dist2(p1, p2) > dist2(best_min, best_max)) {
@@ -105,7 +122,7 @@ void TriMesh::need_bsphere()
 	float r2 = sqr(bsphere.r);
 
 	// Expand bsphere to contain all points
-	for (int i = 0; i < vertices.size(); i++) {
+	for (size_t i = 0; i < vertices.size(); i++) {
 		float d2 = dist2(vertices[i], bsphere.center);
 		if (d2 <= r2)
 			continue;
@@ -118,6 +135,7 @@ void TriMesh::need_bsphere()
 	}
 
 	bsphere.valid = true; 
+	bsphere_gen = generation;
 	dprintf("Done.\n  center = (%g, %g, %g), radius = %g\n",
 		bsphere.center[0], bsphere.center[1],
 		bsphere.center[2], bsphere.r);
@@ -0,0 +1,112 @@
+/*
+Szymon Rusinkiewicz
+Princeton University
+
+TriMesh_buffers.cc
+Flat and interleaved arrays of mesh data, e.g. for uploading to a GPU.
+*/
+
+#include "TriMesh.h"
+#include <algorithm>
+
+namespace trimesh {
+
+
+// The faces, as 3 unsigned ints each.  That is just a view of faces,
+// unless indices are 64-bit, in which case they are packed into
+// tightpacked_faces.
+const unsigned int *TriMesh::face_data()
+{
+	if (faces.empty())
+		return 0;
+#ifdef TRIMESH_64BIT_INDICES
+	ptrdiff_t nf = faces.size();
+	tightpacked_faces.resize(3 * nf);
+#pragma omp parallel for
+	for (ptrdiff_t i = 0; i < nf; i++)
+		for (int j = 0; j < 3; j++)
+			tightpacked_faces[3*i+j] = faces[i][j];
+	return &tightpacked_faces[0];
+#else
+	return (const unsigned int *) &faces[0][0];
+#endif
+}
+
+
+// Make sure there are faces and normals for face_data() and normal_data()
+void TriMesh::allocate_data_tightpacked()
+{
+	need_faces();
+	need_normals();
+}
+
+
+// Pack vertices [first, first + n) of an interleaved stream.  Compact
+// meshes are decoded a block at a time, straight into the stream.
+void TriMesh::pack_vertex_stream(std::vector<float> &buf, int attribs,
+	ptrdiff_t first /* = 0 */, ptrdiff_t n /* = -1 */)
+{
+	bool compacted = is_compact();
+	ptrdiff_t nv = compacted ? compact.pos.size() / 3 : vertices.size();
+	int stride = stream_stride(attribs);
+	buf.resize((size_t) nv * stride);
+	first = std::max(first, (ptrdiff_t) 0);
+	ptrdiff_t end = (n < 0) ? nv : std::min(first + n, nv);
+	if (first >= end || !stride)
+		return;
+
+	bool pos = !!(attribs & STREAM_POSITION);
+	bool norm = !!(attribs & STREAM_NORMAL);
+	bool col = !!(attribs & STREAM_COLOR) && (ptrdiff_t) colors.size() == nv;
+	bool white = !!(attribs & STREAM_COLOR) && !col;
+	if (norm)
+		need_normals();
+
+	const ptrdiff_t block = 256;
+	ptrdiff_t nblocks = (end - first + block - 1) / block;
+#pragma omp parallel for
+	for (ptrdiff_t b = 0; b < nblocks; b++) {
+		ptrdiff_t bfirst = first + b * block;
+		ptrdiff_t bend = std::min(bfirst + block, end);
+		point vbuf[block];
+		vec nbuf[block];
+		const point *v = pos ? &vbuf[0] : 0;
+		const vec *nrm = norm ? &nbuf[0] : 0;
+		if (compacted) {
+			if (pos)
+				decode_positions(bfirst, bend - bfirst, vbuf);
+			if (norm)
+				decode_normals(bfirst, bend - bfirst, nbuf);
+		} else {
+			if (pos)
+				v = &vertices[bfirst];
+			if (norm)
+				nrm = &normals[bfirst];
+		}
+
+		for (ptrdiff_t i = bfirst; i < bend; i++) {
+			float *p = &buf[(size_t) i * stride];
+			if (pos) {
+				p[0] = v[i-bfirst][0];
+				p[1] = v[i-bfirst][1];
+				p[2] = v[i-bfirst][2];
+				p += 3;
+			}
+			if (norm) {
+				p[0] = nrm[i-bfirst][0];
+				p[1] = nrm[i-bfirst][1];
+				p[2] = nrm[i-bfirst][2];
+				p += 3;
+			}
+			if (col) {
+				p[0] = colors[i][0];
+				p[1] = colors[i][1];
+				p[2] = colors[i][2];
+			} else if (white) {
+				p[0] = p[1] = p[2] = 1.0f;
+			}
+		}
+	}
+}
+
+} // end namespace trimesh
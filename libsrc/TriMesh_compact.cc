@@ -0,0 +1,313 @@
+/*
+Szymon Rusinkiewicz
+Princeton University
+
+TriMesh_compact.cc
+Compact (quantized) storage of vertex positions and normals.
+*/
+
+#include "TriMesh.h"
+#include "XForm.h"
+#include <algorithm>
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
+namespace trimesh {
+
+
+// Vertices are decoded this many at a time, e.g. into buffers on the stack
+#define DECODE_BLOCK 1024
+
+
+// Octahedral encoding of a normal: project onto the octahedron
+// |x| + |y| + |z| = 1, fold the lower half over the upper one, and store
+// x and y as 16-bit fixed point in the low and high halves.
+static inline unsigned oct_encode(const vec &n)
+{
+	float s = std::fabs(n[0]) + std::fabs(n[1]) + std::fabs(n[2]);
+	if (!(s > 0.0f))
+		return 0;
+	float x = n[0] / s, y = n[1] / s;
+	if (n[2] < 0.0f) {
+		float ox = x;
+		x = (1.0f - std::fabs(y)) * sgn(ox);
+		y = (1.0f - std::fabs(ox)) * sgn(y);
+	}
+	short qx = (short) std::floor(x * 32767.0f + 0.5f);
+	short qy = (short) std::floor(y * 32767.0f + 0.5f);
+	return (unsigned) (unsigned short) qx |
+		((unsigned) (unsigned short) qy << 16);
+}
+
+
+// Decode n octahedrally-encoded normals
+static void oct_decode(const unsigned *enc, size_t n, vec *out)
+{
+	size_t i = 0;
+#ifdef __SSE2__
+	// Four at a time
+	const __m128 k = _mm_set1_ps(1.0f / 32767.0f);
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 signbit = _mm_set1_ps(-0.0f);
+	const __m128 zero = _mm_setzero_ps();
+	for ( ; i + 4 <= n; i += 4) {
+		__m128i e = _mm_loadu_si128((const __m128i *) (enc + i));
+		__m128 x = _mm_mul_ps(_mm_cvtepi32_ps(
+			_mm_srai_epi32(_mm_slli_epi32(e, 16), 16)), k);
+		__m128 y = _mm_mul_ps(_mm_cvtepi32_ps(
+			_mm_srai_epi32(e, 16)), k);
+		__m128 ax = _mm_andnot_ps(signbit, x);
+		__m128 ay = _mm_andnot_ps(signbit, y);
+		__m128 z = _mm_sub_ps(_mm_sub_ps(one, ax), ay);
+
+		// Unfold the lower half
+		__m128 fold = _mm_cmplt_ps(z, zero);
+		__m128 fx = _mm_or_ps(_mm_sub_ps(one, ay),
+			_mm_and_ps(signbit, x));
+		__m128 fy = _mm_or_ps(_mm_sub_ps(one, ax),
+			_mm_and_ps(signbit, y));
+		x = _mm_or_ps(_mm_and_ps(fold, fx), _mm_andnot_ps(fold, x));
+		y = _mm_or_ps(_mm_and_ps(fold, fy), _mm_andnot_ps(fold, y));
+
+		__m128 l2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x),
+			_mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+		__m128 inv = _mm_div_ps(one, _mm_sqrt_ps(l2));
+		float xs[4], ys[4], zs[4];
+		_mm_storeu_ps(xs, _mm_mul_ps(x, inv));
+		_mm_storeu_ps(ys, _mm_mul_ps(y, inv));
+		_mm_storeu_ps(zs, _mm_mul_ps(z, inv));
+		for (int j = 0; j < 4; j++)
+			out[i+j] = vec(xs[j], ys[j], zs[j]);
+	}
+#endif
+	for ( ; i < n; i++) {
+		float x = (short) (enc[i] & 0xffffu) * (1.0f / 32767.0f);
+		float y = (short) (enc[i] >> 16) * (1.0f / 32767.0f);
+		float ax = std::fabs(x), ay = std::fabs(y);
+		float z = 1.0f - ax - ay;
+		if (z < 0.0f) {
+			x = (x < 0.0f) ? ay - 1.0f : 1.0f - ay;
+			y = (y < 0.0f) ? ax - 1.0f : 1.0f - ax;
+		}
+		out[i] = vec(x, y, z);
+		normalize(out[i]);
+	}
+}
+
+
+// Decode nvals quantized coordinates, starting with an x coordinate, as
+// q * scale + offset on each axis
+static void decode_scaled(const unsigned short *q, size_t nvals,
+	const float *scale, const float *offset, float *out)
+{
+	size_t i = 0;
+#ifdef __SSE2__
+	// Four vertices (12 values, or 3 registers) at a time, with the
+	// scales and offsets rotated to line up with x, y, and z
+	const __m128 s0 = _mm_setr_ps(scale[0], scale[1], scale[2], scale[0]);
+	const __m128 s1 = _mm_setr_ps(scale[1], scale[2], scale[0], scale[1]);
+	const __m128 s2 = _mm_setr_ps(scale[2], scale[0], scale[1], scale[2]);
+	const __m128 o0 = _mm_setr_ps(offset[0], offset[1], offset[2], offset[0]);
+	const __m128 o1 = _mm_setr_ps(offset[1], offset[2], offset[0], offset[1]);
+	const __m128 o2 = _mm_setr_ps(offset[2], offset[0], offset[1], offset[2]);
+	const __m128i zero = _mm_setzero_si128();
+	for ( ; i + 12 <= nvals; i += 12) {
+		__m128i a = _mm_loadu_si128((const __m128i *) (q + i));
+		__m128i b = _mm_loadl_epi64((const __m128i *) (q + i + 8));
+		__m128 f0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(a, zero));
+		__m128 f1 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(a, zero));
+		__m128 f2 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(b, zero));
+		_mm_storeu_ps(out + i, _mm_add_ps(_mm_mul_ps(f0, s0), o0));
+		_mm_storeu_ps(out + i + 4, _mm_add_ps(_mm_mul_ps(f1, s1), o1));
+		_mm_storeu_ps(out + i + 8, _mm_add_ps(_mm_mul_ps(f2, s2), o2));
+	}
+#endif
+	for ( ; i < nvals; i++)
+		out[i] = q[i] * scale[i % 3] + offset[i % 3];
+}
+
+
+// Decode n vertex positions starting at first
+void TriMesh::decode_positions(size_t first, size_t n, point *out) const
+{
+	if (!n)
+		return;
+	const float *xf = compact.pos_xf;
+	const unsigned short *q = &compact.pos[3 * first];
+
+	// Scale and translation only, as set up by compact_geometry()
+	// (and kept by apply_xform with scales and translations)?
+	if (!xf[1] && !xf[2] && !xf[3] && !xf[4] && !xf[6] && !xf[7] &&
+	    !xf[8] && !xf[9] && !xf[11] && xf[15] == 1.0f) {
+		const float scale[3] = { xf[0], xf[5], xf[10] };
+		decode_scaled(q, 3 * n, scale, xf + 12, &out[0][0]);
+		return;
+	}
+
+	xform pxf(xf);
+	for (size_t i = 0; i < n; i++, q += 3)
+		out[i] = pxf * point(q[0], q[1], q[2]);
+}
+
+
+// Decode n vertex normals starting at first
+void TriMesh::decode_normals(size_t first, size_t n, vec *out) const
+{
+	if (!n)
+		return;
+	oct_decode(&compact.norms[first], n, out);
+
+	xform nxf(compact.norm_xf);
+	if (nxf == xform())
+		return;
+	for (size_t i = 0; i < n; i++) {
+		out[i] = nxf * out[i];
+		normalize(out[i]);
+	}
+}
+
+
+// Quantize vertex positions relative to the bounding box and encode
+// normals, then free vertices and normals
+void TriMesh::compact_geometry()
+{
+	if (is_compact() || vertices.empty())
+		return;
+	need_bbox();
+
+	dprintf("Compacting geometry... ");
+	long long nv = vertices.size();
+	vec scale, inv;
+	for (int j = 0; j < 3; j++) {
+		float size = bbox.max[j] - bbox.min[j];
+		scale[j] = size / 65535.0f;
+		inv[j] = (size > 0.0f) ? 65535.0f / size : 0.0f;
+	}
+
+	compact.pos.resize(3 * nv);
+#pragma omp parallel for
+	for (long long i = 0; i < nv; i++) {
+		for (int j = 0; j < 3; j++) {
+			float q = (vertices[i][j] - bbox.min[j]) * inv[j];
+			compact.pos[3*i+j] = (unsigned short)
+				clamp(q + 0.5f, 0.0f, 65535.0f);
+		}
+	}
+	xform pxf = xform::trans(bbox.min) *
+		xform::scale(scale[0], scale[1], scale[2]);
+	std::copy(pxf.begin(), pxf.end(), compact.pos_xf);
+
+	compact.norms.clear();
+	if (normals.size() == vertices.size()) {
+		compact.norms.resize(nv);
+#pragma omp parallel for
+		for (long long i = 0; i < nv; i++)
+			compact.norms[i] = oct_encode(normals[i]);
+	}
+	xform nxf;
+	std::copy(nxf.begin(), nxf.end(), compact.norm_xf);
+
+	SharedArray<point>().swap(vertices);
+	SharedArray<vec>().swap(normals);
+
+	dprintf("Done.\n  %lu bytes per vertex\n",
+		(unsigned long) (compact.norms.empty() ? 6 : 10));
+}
+
+
+// Decode vertices and normals and free the compact storage
+void TriMesh::expand_geometry()
+{
+	if (!is_compact())
+		return;
+
+	dprintf("Expanding geometry... ");
+	long long nv = compact.pos.size() / 3;
+	long long nblocks = (nv + DECODE_BLOCK - 1) / DECODE_BLOCK;
+	vertices.resize(nv);
+	if (!compact.norms.empty())
+		normals.resize(nv);
+#pragma omp parallel for
+	for (long long b = 0; b < nblocks; b++) {
+		size_t first = b * DECODE_BLOCK;
+		size_t n = std::min((long long) DECODE_BLOCK, nv - b * DECODE_BLOCK);
+		decode_positions(first, n, &vertices[first]);
+		if (!compact.norms.empty())
+			decode_normals(first, n, &normals[first]);
+	}
+
+	// normals_gen already says whether the encoded normals were current
+	SharedArray<unsigned short>().swap(compact.pos);
+	SharedArray<unsigned>().swap(compact.norms);
+	dprintf("Done.\n");
+}
+
+
+// Compute normals of a compact mesh and encode them.  For meshes, the
+// per-corner contributions (as in need_normals) are found for a block of
+// faces at a time, from just their decoded vertices, and added up in face
+// order, so the only full-size temporary is one float normal per vertex.
+// Point clouds need all the positions at once (for the KDtree), so those
+// are decoded for the duration.
+void TriMesh::need_compact_normals()
+{
+	if (!compact.norms.empty() && is_current(normals_gen))
+		return;
+	if (faces.empty() && !tstrips.empty())
+		need_faces();
+
+	long long nv = compact.pos.size() / 3, nf = faces.size();
+	std::vector<vec> norms;
+	if (!nf) {
+		vertices.resize(nv);
+		for (long long i = 0; i < nv; i += DECODE_BLOCK)
+			decode_positions(i, std::min((long long) DECODE_BLOCK,
+				nv - i), &vertices[i]);
+
+		std::vector<unsigned short> pos;
+		pos.swap(compact.pos);
+		need_normals();
+		pos.swap(compact.pos);
+
+		SharedArray<point>().swap(vertices);
+		norms.swap(normals);
+	} else {
+		dprintf("Computing normals... ");
+		norms.resize(nv);
+		const long long block = 16 * DECODE_BLOCK;
+		std::vector<vec> cn(3 * std::min(block, nf));
+		for (long long first = 0; first < nf; first += block) {
+			long long n = std::min(block, nf - first);
+#pragma omp parallel for
+			for (long long i = 0; i < n; i++) {
+				const Face &f = faces[first + i];
+				point p[3];
+				for (int j = 0; j < 3; j++)
+					decode_positions(f[j], 1, &p[j]);
+				for (int j = 0; j < 3; j++) {
+					vec e1 = p[(j+1)%3] - p[j];
+					vec e2 = p[(j+2)%3] - p[j];
+					float l2e1 = len2(e1), l2e2 = len2(e2);
+					cn[3*i+j] = (!l2e1 || !l2e2) ? vec() :
+						(e1 CROSS e2) * (1.0f / (l2e1 * l2e2));
+				}
+			}
+			for (long long i = 0; i < 3 * n; i++)
+				norms[faces[first + i / 3][i % 3]] += cn[i];
+		}
+		dprintf("Done.\n");
+	}
+
+	compact.norms.resize(nv);
+#pragma omp parallel for
+	for (long long i = 0; i < nv; i++) {
+		normalize(norms[i]);
+		compact.norms[i] = oct_encode(norms[i]);
+	}
+	xform nxf;
+	std::copy(nxf.begin(), nxf.end(), compact.norm_xf);
+	normals_gen = generation;
+}
+
+} // end namespace trimesh
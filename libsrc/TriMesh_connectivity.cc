@@ -8,15 +8,24 @@ Manipulate data structures that describe connectivity between faces and verts.
 
 
 #include "TriMesh.h"
+#include "radixsort.h"
 #include <algorithm>
 
 namespace trimesh {
 
 
+// Number of vertices, including those of a compact mesh
+static inline size_t num_vertices(const TriMesh *mesh)
+{
+	return mesh->is_compact() ? mesh->compact.pos.size() / 3 :
+		mesh->vertices.size();
+}
+
+
 // Find the direct neighbors of each vertex
 void TriMesh::need_neighbors()
 {
-	if (!neighbors.empty())
+	if (!neighbors.empty() && topology_current(neighbors_gen))
 		return;
 
 	need_faces();
@@ -24,30 +33,9 @@ void TriMesh::need_neighbors()
 		return;
 
 	dprintf("Finding vertex neighbors... ");
-	int nv = vertices.size(), nf = faces.size();
-
-	std::vector<int> numneighbors(nv);
-	for (int i = 0; i < nf; i++) {
-		numneighbors[faces[i][0]]++;
-		numneighbors[faces[i][1]]++;
-		numneighbors[faces[i][2]]++;
-	}
-
-	neighbors.resize(nv);
-	for (int i = 0; i < nv; i++)
-		neighbors[i].reserve(numneighbors[i]+2); // Slop for boundaries
-
-	for (int i = 0; i < nf; i++) {
-		for (int j = 0; j < 3; j++) {
-			std::vector<int> &me = neighbors[faces[i][j]];
-			int n1 = faces[i][(j+1)%3];
-			int n2 = faces[i][(j+2)%3];
-			if (find(me.begin(), me.end(), n1) == me.end())
-				me.push_back(n1);
-			if (find(me.begin(), me.end(), n2) == me.end())
-				me.push_back(n2);
-		}
-	}
+	neighbors.build_neighbors(num_vertices(this), &faces[0][0],
+		faces.size(), 3);
+	neighbors_gen = generation;
 
 	dprintf("Done.\n");
 }
@@ -56,7 +44,7 @@ void TriMesh::need_neighbors()
 // Find the faces touching each vertex
 void TriMesh::need_adjacentfaces()
 {
-	if (!adjacentfaces.empty())
+	if (!adjacentfaces.empty() && topology_current(adjacentfaces_gen))
 		return;
 
 	need_faces();
@@ -64,72 +52,318 @@ void TriMesh::need_adjacentfaces()
 		return;
 
 	dprintf("Finding vertex to triangle maps... ");
-	int nv = vertices.size(), nf = faces.size();
+	adjacentfaces.build_incident(num_vertices(this), &faces[0][0],
+		faces.size(), 3);
+	adjacentfaces_gen = generation;
+	dprintf("Done.\n");
+}
+
 
-	std::vector<int> numadjacentfaces(nv);
-	for (int i = 0; i < nf; i++) {
-		numadjacentfaces[faces[i][0]]++;
-		numadjacentfaces[faces[i][1]]++;
-		numadjacentfaces[faces[i][2]]++;
+// Find the corner across the edge opposite each corner (-1 on boundary).
+// Each half-edge (the edge opposite corner c) gets a key made of its
+// (smaller, larger) vertex index, and the keys are sorted.  Two half-edges
+// with the same key and opposite orientations are across from each other.
+// Edges with more than two faces (non-manifold), pairs of faces whose
+// orientations disagree, and degenerate edges are all left as -1, and the
+// first two are counted in the mesh's nonmanifold_edges and flipped_edges.
+// The keys hold 32 bits of each vertex index, so meshes with 2^32 or more
+// vertices are not handled (only possible with TRIMESH_64BIT_INDICES).
+template <class A>
+static void find_opposite_corners(TriMesh *mesh,
+	std::vector<index_t, A> &opp)
+{
+	const std::vector<TriMesh::Face> &faces = mesh->faces;
+	index_t nv = num_vertices(mesh), nf = faces.size();
+	long long nhe = 3 * (long long) nf;
+	opp.clear();
+	opp.resize(nhe, -1);
+	mesh->nonmanifold_edges = mesh->flipped_edges = 0;
+	if ((unsigned long long) nv > 0xffffffffull) {
+		TriMesh::eprintf("Too many vertices to find opposite corners\n");
+		return;
 	}
+	int bits = 0;
+	while (bits < 32 && (1ll << bits) <= nv)
+		bits++;
 
-	adjacentfaces.resize(vertices.size());
-	for (int i = 0; i < nv; i++)
-		adjacentfaces[i].reserve(numadjacentfaces[i]);
+	std::vector<unsigned long long> keys(nhe);
+	std::vector<index_t> halfedges(nhe);
+#pragma omp parallel for
+	for (index_t i = 0; i < nf; i++) {
+		for (int j = 0; j < 3; j++) {
+			unsigned long long v1 = faces[i][(j+1)%3];
+			unsigned long long v2 = faces[i][(j+2)%3];
+			if (v1 == v2 || v1 >= (unsigned long long) nv ||
+			    v2 >= (unsigned long long) nv)
+				v1 = v2 = nv; // Sorts to the end, never matched
+			else if (v1 > v2)
+				std::swap(v1, v2);
+			keys[3*i+j] = ((unsigned long long) v1 << 32) | v2;
+			halfedges[3*i+j] = 3*i+j;
+		}
+	}
+	radix_sort(keys, halfedges, bits, bits);
 
-	for (int i = 0; i < nf; i++) {
-		for (int j = 0; j < 3; j++)
-			adjacentfaces[faces[i][j]].push_back(i);
+	const unsigned long long bad = ((unsigned long long) nv << 32) | nv;
+	long long nnonmanifold = 0, nflipped = 0;
+#pragma omp parallel for reduction(+ : nnonmanifold, nflipped)
+	for (long long i = 0; i < nhe; i++) {
+		if ((i > 0 && keys[i] == keys[i-1]) || keys[i] == bad)
+			continue;
+		long long end = i + 1;
+		while (end < nhe && keys[end] == keys[i])
+			end++;
+		if (end - i == 1)
+			continue;
+		if (end - i > 2) {
+			nnonmanifold++;
+			continue;
+		}
+		index_t c1 = halfedges[i], c2 = halfedges[i+1];
+		if (c1 / 3 == c2 / 3)
+			continue;
+		if (mesh->corner_vertex(TriMesh::corner_next(c1)) !=
+		    mesh->corner_vertex(TriMesh::corner_prev(c2))) {
+			nflipped++;
+			continue;
+		}
+		opp[c1] = c2;
+		opp[c2] = c1;
 	}
 
-	dprintf("Done.\n");
+	mesh->nonmanifold_edges = nnonmanifold;
+	mesh->flipped_edges = nflipped;
+	if (nnonmanifold)
+		TriMesh::dprintf("%lld non-manifold edges... ", nnonmanifold);
+	if (nflipped)
+		TriMesh::dprintf("%lld edges with inconsistent orientation... ",
+			nflipped);
 }
 
 
-// Find the face across each edge from each other face (-1 on boundary)
-// If topology is bad, not necessarily what one would expect...
+// Find the face across each edge from each other face (-1 on boundary,
+// and see find_opposite_corners)
 void TriMesh::need_across_edge()
 {
-	if (!across_edge.empty())
+	if (!across_edge.empty() && topology_current(across_edge_gen))
 		return;
 
-	need_adjacentfaces();
-	if (adjacentfaces.empty())
+	need_faces();
+	if (faces.empty())
 		return;
 
 	dprintf("Finding across-edge maps... ");
 
-	int nf = faces.size();
-	across_edge.resize(nf, Face(-1,-1,-1));
+	std::vector<index_t> opp;
+	find_opposite_corners(this, opp);
 
+	index_t nf = faces.size();
+	across_edge.resize(nf);
 #pragma omp parallel for
-	for (int i = 0; i < nf; i++) {
-		for (int j = 0; j < 3; j++) {
-			if (across_edge[i][j] != -1)
-				continue;
-			int v1 = faces[i][(j+1)%3];
-			int v2 = faces[i][(j+2)%3];
-			const std::vector<int> &a1 = adjacentfaces[v1];
-			const std::vector<int> &a2 = adjacentfaces[v2];
-			for (int k1 = 0; k1 < a1.size(); k1++) {
-				int other = a1[k1];
-				if (other == i)
-					continue;
-				std::vector<int>::const_iterator it =
-					find(a2.begin(), a2.end(), other);
-				if (it == a2.end())
-					continue;
-				int ind = (faces[other].indexof(v1)+1)%3;
-				if (faces[other][(ind+1)%3] != v2)
-					continue;
-				across_edge[i][j] = other;
-				across_edge[other][ind] = i;
-				break;
-			}
-		}
+	for (index_t i = 0; i < nf; i++)
+		for (int j = 0; j < 3; j++)
+			across_edge[i][j] = (opp[3*i+j] < 0) ? -1 : opp[3*i+j] / 3;
+	across_edge_gen = generation;
+
+	dprintf("Done.\n");
+}
+
+
+// Build the corner table
+void TriMesh::need_corners()
+{
+	if (!faces.empty() && corner_opposite.size() == 3 * faces.size() &&
+	    vertex_corner.size() == num_vertices(this) &&
+	    topology_current(corners_gen))
+		return;
+
+	need_faces();
+	if (faces.empty())
+		return;
+
+	dprintf("Building corner table... ");
+	find_opposite_corners< HookAlloc<index_t> >(this, corner_opposite);
+
+	// The first corner at each vertex, then back up to the start of the
+	// fan if on the boundary
+	index_t nv = num_vertices(this), nc = 3 * faces.size();
+	vertex_corner.clear();
+	vertex_corner.resize(nv, -1);
+	for (index_t c = nc - 1; c >= 0; c--) {
+		index_t v = corner_vertex(c);
+		if (v >= 0 && v < nv)
+			vertex_corner[v] = c;
+	}
+#pragma omp parallel for schedule(dynamic, 4096)
+	for (index_t i = 0; i < nv; i++) {
+		index_t c0 = vertex_corner[i];
+		if (c0 < 0)
+			continue;
+		index_t c = c0, u;
+		while ((u = corner_unswing(c)) >= 0 && u != c0)
+			c = u;
+		if (u < 0)
+			vertex_corner[i] = c;
 	}
+	corners_gen = generation;
 
 	dprintf("Done.\n");
 }
 
+
+// Throw away whatever is made stale by an edit to faces through the
+// corner table, which itself stays current
+static void corners_edited(TriMesh *mesh)
+{
+	mesh->topology_changed();
+	mesh->corners_gen = mesh->generation;
+	mesh->tstrips.clear();
+	mesh->neighbors.clear();
+	mesh->adjacentfaces.clear();
+	mesh->across_edge.clear();
+	mesh->cornerareas.clear();
+	mesh->edgelengths.clear();
+	mesh->faceareas.clear();
+}
+
+
+// Flip the edge opposite corner c.  With faces (a,b,cc) and (d,cc,b)
+// on either side of edge b-cc, they become (a,d,cc) and (d,a,b).
+bool TriMesh::flip_edge(index_t c)
+{
+	need_corners();
+	if (c < 0 || c >= (index_t) corner_opposite.size())
+		return false;
+	index_t o = corner_opposite[c];
+	if (o < 0)
+		return false;
+
+	index_t nc = corner_next(c), pc = corner_prev(c);
+	index_t no = corner_next(o), po = corner_prev(o);
+	index_t a = corner_vertex(c), b = corner_vertex(nc);
+	index_t cc = corner_vertex(pc), d = corner_vertex(o);
+	if (a == d)
+		return false;
+
+	// Don't create an edge that is already there
+	index_t c0 = vertex_corner[a], ca = c0;
+	if (c0 >= 0) do {
+		if (corner_vertex(corner_next(ca)) == d ||
+		    corner_vertex(corner_prev(ca)) == d)
+			return false;
+		ca = corner_swing(ca);
+	} while (ca >= 0 && ca != c0);
+
+	index_t x2 = corner_opposite[pc], x4 = corner_opposite[po];
+	faces[nc / 3][nc % 3] = d;
+	faces[no / 3][no % 3] = a;
+
+	corner_opposite[c] = x4;
+	if (x4 >= 0)
+		corner_opposite[x4] = c;
+	corner_opposite[o] = x2;
+	if (x2 >= 0)
+		corner_opposite[x2] = o;
+	corner_opposite[pc] = po;
+	corner_opposite[po] = pc;
+
+	// b and cc each lose a corner, and a and d each gain one that may
+	// now be the first around a boundary
+	if (vertex_corner[b] == nc)
+		vertex_corner[b] = po;
+	if (vertex_corner[cc] == no)
+		vertex_corner[cc] = pc;
+	if (vertex_corner[a] == c)
+		vertex_corner[a] = no;
+	if (vertex_corner[d] == o)
+		vertex_corner[d] = nc;
+
+	corners_edited(this);
+	return true;
+}
+
+
+// Append the average of two entries of a per-vertex array, if it has one
+// entry per vertex
+template <class T>
+static void interp_vert(SharedArray<T> &v, size_t nv, index_t i, index_t j)
+{
+	if (v.size() == nv)
+		v.push_back(0.5f * (v[i] + v[j]));
+}
+
+
+// Split the edge opposite corner c at a new vertex e.  With faces (a,b,cc)
+// and (d,cc,b) on either side of edge b-cc, they become (a,b,e), (d,cc,e),
+// and new faces (a,e,cc) and (d,e,b).  On the boundary, there is no d.
+index_t TriMesh::split_edge(index_t c, const point &p)
+{
+	need_vertices();
+	need_corners();
+	if (c < 0 || c >= (index_t) corner_opposite.size())
+		return -1;
+	index_t o = corner_opposite[c];
+	index_t nc = corner_next(c), pc = corner_prev(c);
+	index_t b = corner_vertex(nc), cc = corner_vertex(pc);
+
+	// The new vertex
+	size_t nv = vertices.size();
+	index_t e = nv;
+	interp_vert(normals, nv, b, cc);
+	if (normals.size() > nv)
+		normalize(normals[e]);
+	interp_vert(colors, nv, b, cc);
+	interp_vert(confidences, nv, b, cc);
+	if (flags.size() == nv)
+		flags.push_back(flags[b]);
+	vertices.push_back(p);
+
+	// Face (a,b,cc) becomes (a,b,e), plus new face (a,e,cc)
+	index_t a = corner_vertex(c);
+	index_t f3 = faces.size();
+	faces[pc / 3][pc % 3] = e;
+	faces.push_back(Face(a, e, cc));
+	index_t x1 = corner_opposite[nc];
+	corner_opposite.resize(3 * faces.size());
+	corner_opposite[3*f3+1] = x1;
+	if (x1 >= 0)
+		corner_opposite[x1] = 3*f3+1;
+	corner_opposite[3*f3+2] = nc;
+	corner_opposite[nc] = 3*f3+2;
+
+	if (o < 0) {
+		corner_opposite[c] = -1;
+		corner_opposite[3*f3] = -1;
+	} else {
+		// Face (d,cc,b) becomes (d,cc,e), plus new face (d,e,b)
+		index_t no = corner_next(o), po = corner_prev(o);
+		index_t d = corner_vertex(o);
+		index_t f4 = faces.size();
+		faces[po / 3][po % 3] = e;
+		faces.push_back(Face(d, e, b));
+		index_t x3 = corner_opposite[no];
+		corner_opposite.resize(3 * faces.size());
+		corner_opposite[3*f4+1] = x3;
+		if (x3 >= 0)
+			corner_opposite[x3] = 3*f4+1;
+		corner_opposite[3*f4+2] = no;
+		corner_opposite[no] = 3*f4+2;
+		corner_opposite[3*f4] = c;
+		corner_opposite[c] = 3*f4;
+		corner_opposite[3*f3] = o;
+		corner_opposite[o] = 3*f3;
+		if (vertex_corner[b] == po)
+			vertex_corner[b] = 3*f4+2;
+	}
+
+	// cc's corner in the first face went to e
+	if (vertex_corner[cc] == pc)
+		vertex_corner[cc] = 3*f3+2;
+	vertex_corner.push_back(3*f3+1);
+
+	geometry_changed();
+	corners_edited(this);
+	return e;
+}
+
 } // end namespace trimesh
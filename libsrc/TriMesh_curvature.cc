@@ -133,10 +133,97 @@ void diagonalize_curv(const vec &old_u, const vec &old_v,
 }
 
 
-// Compute principal curvatures and directions.
+// Estimate the curvature tensor of face i, from the variation of normals
+// along its edges, in a coordinate system t, b in the plane of the face.
+// Returns false if the least-squares fit fails.
+static bool face_curv(const TriMesh *mesh, ptrdiff_t i, vec &t, vec &b,
+	float m[3])
+{
+	// Edges
+	const TriMesh::Face &f = mesh->faces[i];
+	vec e[3] = { mesh->vertices[f[2]] - mesh->vertices[f[1]],
+		     mesh->vertices[f[0]] - mesh->vertices[f[2]],
+		     mesh->vertices[f[1]] - mesh->vertices[f[0]] };
+
+	// N-T-B coordinate system per face
+	t = e[0];
+	normalize(t);
+	vec n = e[0] CROSS e[1];
+	b = n CROSS t;
+	normalize(b);
+
+	// Estimate curvature based on variation of normals
+	// along edges
+	m[0] = m[1] = m[2] = 0.0f;
+	float w[3][3] = { {0,0,0}, {0,0,0}, {0,0,0} };
+	for (int j = 0; j < 3; j++) {
+		float u = e[j] DOT t;
+		float v = e[j] DOT b;
+		w[0][0] += u*u;
+		w[0][1] += u*v;
+		//w[1][1] += v*v + u*u; 
+		//w[1][2] += u*v; 
+		w[2][2] += v*v;
+		vec dn = mesh->normals[f[PREV(j)]] -
+			 mesh->normals[f[NEXT(j)]];
+		float dnu = dn DOT t;
+		float dnv = dn DOT b;
+		m[0] += dnu*u;
+		m[1] += dnu*v + dnv*u;
+		m[2] += dnv*v;
+	}
+	w[1][1] = w[0][0] + w[2][2];
+	w[1][2] = w[0][1];
+
+	// Least squares solution
+	float diag[3];
+	if (!ldltdc<float,3>(w, diag)) {
+		//dprintf("ldltdc failed!\n");
+		return false;
+	}
+	ldltsl<float,3>(w, diag, m, m);
+	return true;
+}
+
+
+// Set up an initial coordinate system at vertex v, perpendicular to its
+// normal: the edge e leaving v, crossed with the normal.
+static void initial_coord_sys(TriMesh *mesh, ptrdiff_t v, const vec &e)
+{
+	const vec &n = ((const TriMesh *) mesh)->normals[v];
+	vec &p1 = mesh->pdir1[v];
+	p1 = e CROSS n;
+	normalize(p1);
+	mesh->pdir2[v] = n CROSS p1;
+}
+
+
+// The same, using the edge leaving v in its highest-numbered face
+static void initial_coord_sys(TriMesh *mesh, ptrdiff_t v)
+{
+	vec e;
+	if (!mesh->adjacentfaces.empty()) {
+		AdjList::Range a = mesh->adjacentfaces[v];
+		if (!a.empty()) {
+			const TriMesh::Face &f = mesh->faces[a.back()];
+			int j = (f[2] == v) ? 2 : (f[1] == v) ? 1 : 0;
+			e = mesh->vertices[f[NEXT(j)]] - mesh->vertices[v];
+		}
+	}
+	initial_coord_sys(mesh, v, e);
+}
+
+
+// Compute principal curvatures and directions, unless they're all there
+// and up to date already (e.g., read in from a file).
 void TriMesh::need_curvatures()
 {
-	if (curv1.size() == vertices.size())
+	need_vertices();
+	if (curv1.size() == vertices.size() &&
+	    curv2.size() == vertices.size() &&
+	    pdir1.size() == vertices.size() &&
+	    pdir2.size() == vertices.size() &&
+	    is_current(curv_gen))
 		return;
 	need_faces();
 	need_normals();
@@ -145,186 +232,306 @@ void TriMesh::need_curvatures()
 	dprintf("Computing curvatures... ");
 
 	// Resize the arrays we'll be using
-	int nv = vertices.size(), nf = faces.size();
+	ptrdiff_t nv = vertices.size(), nf = faces.size();
 	curv1.clear(); curv1.resize(nv); curv2.clear(); curv2.resize(nv);
 	pdir1.clear(); pdir1.resize(nv); pdir2.clear(); pdir2.resize(nv);
-	std::vector<float> curv12(nv);
 
-	// Set up an initial coordinate system per vertex
-	for (int i = 0; i < nf; i++) {
-		pdir1[faces[i][0]] = vertices[faces[i][1]] -
-				     vertices[faces[i][0]];
-		pdir1[faces[i][1]] = vertices[faces[i][2]] -
-				     vertices[faces[i][1]];
-		pdir1[faces[i][2]] = vertices[faces[i][0]] -
-				     vertices[faces[i][2]];
-	}
+	// Reading through a const TriMesh and writing through plain vectors
+	// keeps the arrays' sharing checks out of the inner loops.
+	const TriMesh *mesh = this;
+	std::vector<vec> &pd1 = pdir1, &pd2 = pdir2;
+	std::vector<float> &k1 = curv1, &k2 = curv2;
+
+	// Set up an initial coordinate system per vertex.  On one thread,
+	// letting each face overwrite the edges of earlier ones finds the
+	// same edges without needing adjacentfaces.
+	if (one_thread()) {
+		for (ptrdiff_t i = 0; i < nf; i++) {
+			const Face &f = mesh->faces[i];
+			for (int j = 0; j < 3; j++) {
+				index_t v = f[j];
+				if (v >= 0 && v < nv)
+					pd1[v] = mesh->vertices[f[NEXT(j)]] -
+						 mesh->vertices[v];
+			}
+		}
+		for (ptrdiff_t i = 0; i < nv; i++) {
+			vec e = pd1[i];
+			initial_coord_sys(this, i, e);
+		}
+	} else {
+		need_adjacentfaces();
 #pragma omp parallel for
-	for (int i = 0; i < nv; i++) {
-		pdir1[i] = pdir1[i] CROSS normals[i];
-		normalize(pdir1[i]);
-		pdir2[i] = normals[i] CROSS pdir1[i];
+		for (ptrdiff_t i = 0; i < nv; i++)
+			initial_coord_sys(this, i);
 	}
 
-	// Compute curvature per-face
-#pragma omp parallel for
-	for (int i = 0; i < nf; i++) {
-		// Edges
-		vec e[3] = { vertices[faces[i][2]] - vertices[faces[i][1]],
-			     vertices[faces[i][0]] - vertices[faces[i][2]],
-			     vertices[faces[i][1]] - vertices[faces[i][0]] };
-
-		// N-T-B coordinate system per face
-		vec t = e[0];
-		normalize(t);
-		vec n = e[0] CROSS e[1];
-		vec b = n CROSS t;
-		normalize(b);
-
-		// Estimate curvature based on variation of normals
-		// along edges
-		float m[3] = { 0, 0, 0 };
-		float w[3][3] = { {0,0,0}, {0,0,0}, {0,0,0} };
-		for (int j = 0; j < 3; j++) {
-			float u = e[j] DOT t;
-			float v = e[j] DOT b;
-			w[0][0] += u*u;
-			w[0][1] += u*v;
-			//w[1][1] += v*v + u*u; 
-			//w[1][2] += u*v; 
-			w[2][2] += v*v;
-			vec dn = normals[faces[i][PREV(j)]] -
-				 normals[faces[i][NEXT(j)]];
-			float dnu = dn DOT t;
-			float dnv = dn DOT b;
-			m[0] += dnu*u;
-			m[1] += dnu*v + dnv*u;
-			m[2] += dnv*v;
-		}
-		w[1][1] = w[0][0] + w[2][2];
-		w[1][2] = w[0][1];
-
-		// Least squares solution
-		float diag[3];
-		if (!ldltdc<float,3>(w, diag)) {
-			//dprintf("ldltdc failed!\n");
+	// Compute curvature per-face, and project it into the coordinate
+	// system of each corner's vertex.  The tensor (curv1, curv12, curv2)
+	// at each vertex is the sum over its corners: on one thread they are
+	// added up right away, in the same order as sum_corners would.
+	std::vector<float> curv12(nv);
+	bool direct = one_thread();
+	std::vector<vec> corner_curv(direct ? 0 : 3 * nf);
+#pragma omp parallel for if (!direct)
+	for (ptrdiff_t i = 0; i < nf; i++) {
+		vec t, b;
+		float m[3];
+		if (!face_curv(mesh, i, t, b, m))
 			continue;
-		}
-		ldltsl<float,3>(w, diag, m, m);
 
-		// Push it back out to the vertices
 		for (int j = 0; j < 3; j++) {
-			int vj = faces[i][j];
+			index_t vj = mesh->faces[i][j];
 			float c1, c12, c2;
 			proj_curv(t, b, m[0], m[1], m[2],
-				  pdir1[vj], pdir2[vj], c1, c12, c2);
-			float wt = cornerareas[i][j] / pointareas[vj];
-#pragma omp atomic
-			curv1[vj]  += wt * c1;
-#pragma omp atomic
-			curv12[vj] += wt * c12;
-#pragma omp atomic
-			curv2[vj]  += wt * c2;
+				  pd1[vj], pd2[vj], c1, c12, c2);
+			float wt = mesh->cornerareas[i][j] /
+				   mesh->pointareas[vj];
+			if (direct) {
+				k1[vj]     += wt * c1;
+				curv12[vj] += wt * c12;
+				k2[vj]     += wt * c2;
+			} else {
+				corner_curv[3*i+j] = vec(wt * c1, wt * c12,
+							 wt * c2);
+			}
+		}
+	}
+	if (!direct && nf) {
+		std::vector<vec> curv(nv);
+		sum_corners(&corner_curv[0], &curv[0]);
+#pragma omp parallel for
+		for (ptrdiff_t i = 0; i < nv; i++) {
+			k1[i]     = curv[i][0];
+			curv12[i] = curv[i][1];
+			k2[i]     = curv[i][2];
 		}
 	}
 
 	// Compute principal directions and curvatures at each vertex
 #pragma omp parallel for
-	for (int i = 0; i < nv; i++) {
-		diagonalize_curv(pdir1[i], pdir2[i],
-				 curv1[i], curv12[i], curv2[i],
-				 normals[i], pdir1[i], pdir2[i],
-				 curv1[i], curv2[i]);
+	for (ptrdiff_t i = 0; i < nv; i++) {
+		diagonalize_curv(pd1[i], pd2[i],
+				 k1[i], curv12[i], k2[i],
+				 mesh->normals[i], pd1[i], pd2[i],
+				 k1[i], k2[i]);
 	}
+	curv_gen = generation;
 	dprintf("Done.\n");
 }
 
 
+// Recompute the principal curvatures and directions at just the given
+// vertices, from their adjacent faces.  Normals and point areas are
+// assumed to be up to date.  Used by vertices_moved().
+void TriMesh::update_curvatures(const std::vector<index_t> &verts)
+{
+	ptrdiff_t nv = vertices.size();
+	if ((ptrdiff_t) curv1.size() != nv ||
+	    (ptrdiff_t) curv2.size() != nv ||
+	    (ptrdiff_t) pdir1.size() != nv ||
+	    (ptrdiff_t) pdir2.size() != nv)
+		return;
+	need_adjacentfaces();
+	if (adjacentfaces.empty())
+		return;
+
+	ptrdiff_t n = verts.size();
+#pragma omp parallel for schedule(dynamic, 64)
+	for (ptrdiff_t i = 0; i < n; i++) {
+		index_t v = verts[i];
+		if (v < 0 || v >= nv)
+			continue;
+		AdjList::Range a = adjacentfaces[v];
+		if (a.empty())
+			continue;
+
+		initial_coord_sys(this, v);
+
+		// Gather curvature from the adjacent faces
+		float c1 = 0.0f, c12 = 0.0f, c2 = 0.0f;
+		for (size_t k = 0; k < a.size(); k++) {
+			vec t, b;
+			float m[3];
+			if (!face_curv(this, a[k], t, b, m))
+				continue;
+			for (int j = 0; j < 3; j++) {
+				if (faces[a[k]][j] != v)
+					continue;
+				float fc1, fc12, fc2;
+				proj_curv(t, b, m[0], m[1], m[2],
+					  pdir1[v], pdir2[v], fc1, fc12, fc2);
+				float wt = cornerareas[a[k]][j] / pointareas[v];
+				c1  += wt * fc1;
+				c12 += wt * fc12;
+				c2  += wt * fc2;
+			}
+		}
+
+		diagonalize_curv(pdir1[v], pdir2[v], c1, c12, c2,
+				 normals[v], pdir1[v], pdir2[v],
+				 curv1[v], curv2[v]);
+	}
+}
+
+
+// Estimate the derivative of curvature of face i, from the variation of
+// curvature along its edges, in a coordinate system t, b in the plane of
+// the face.  Returns false if the least-squares fit fails.
+static bool face_dcurv(const TriMesh *mesh, ptrdiff_t i, vec &t, vec &b,
+	Vec<4> &fdcurv)
+{
+	// Edges
+	const TriMesh::Face &f = mesh->faces[i];
+	vec e[3] = { mesh->vertices[f[2]] - mesh->vertices[f[1]],
+		     mesh->vertices[f[0]] - mesh->vertices[f[2]],
+		     mesh->vertices[f[1]] - mesh->vertices[f[0]] };
+
+	// N-T-B coordinate system per face
+	t = e[0];
+	normalize(t);
+	vec n = e[0] CROSS e[1];
+	b = n CROSS t;
+	normalize(b);
+
+	// Project curvature tensor from each vertex into this
+	// face's coordinate system
+	vec fcurv[3];
+	for (int j = 0; j < 3; j++) {
+		index_t vj = f[j];
+		proj_curv(mesh->pdir1[vj], mesh->pdir2[vj], mesh->curv1[vj], 0,
+			  mesh->curv2[vj], t, b,
+			  fcurv[j][0], fcurv[j][1], fcurv[j][2]);
+
+	}
+
+	// Estimate dcurv based on variation of curvature along edges
+	float m[4] = { 0, 0, 0, 0 };
+	float w[4][4] = { {0,0,0,0}, {0,0,0,0}, {0,0,0,0}, {0,0,0,0} };
+	for (int j = 0; j < 3; j++) {
+		// Variation of curvature along each edge
+		vec dfcurv = fcurv[PREV(j)] - fcurv[NEXT(j)];
+		float u = e[j] DOT t;
+		float v = e[j] DOT b;
+		float u2 = u*u, v2 = v*v, uv = u*v;
+		w[0][0] += u2;
+		w[0][1] += uv;
+		//w[1][1] += 2.0f*u2 + v2;
+		//w[1][2] += 2.0f*uv;
+		//w[2][2] += u2 + 2.0f*v2;
+		//w[2][3] += uv;
+		w[3][3] += v2;
+		m[0] += u*dfcurv[0];
+		m[1] += v*dfcurv[0] + 2.0f*u*dfcurv[1];
+		m[2] += 2.0f*v*dfcurv[1] + u*dfcurv[2];
+		m[3] += v*dfcurv[2];
+	}
+	w[1][1] = 2.0f * w[0][0] + w[3][3];
+	w[1][2] = 2.0f * w[0][1];
+	w[2][2] = w[0][0] + 2.0f * w[3][3];
+	w[2][3] = w[0][1];
+
+	// Least squares solution
+	float d[4];
+	if (!ldltdc<float,4>(w, d)) {
+		//dprintf("ldltdc failed!\n");
+		return false;
+	}
+	ldltsl<float,4>(w, d, m, m);
+	fdcurv = Vec<4>(m);
+	return true;
+}
+
+
 // Compute derivatives of curvature.
 void TriMesh::need_dcurv()
 {
-	if (dcurv.size() == vertices.size())
+	need_vertices();
+	if (dcurv.size() == vertices.size() && is_current(dcurv_gen))
 		return;
 	need_curvatures();
 
 	dprintf("Computing dcurv... ");
 
 	// Resize the arrays we'll be using
-	int nv = vertices.size(), nf = faces.size();
+	ptrdiff_t nv = vertices.size(), nf = faces.size();
 	dcurv.clear(); dcurv.resize(nv);
-
-	// Compute dcurv per-face
-#pragma omp parallel for
-	for (int i = 0; i < nf; i++) {
-		// Edges
-		vec e[3] = { vertices[faces[i][2]] - vertices[faces[i][1]],
-			     vertices[faces[i][0]] - vertices[faces[i][2]],
-			     vertices[faces[i][1]] - vertices[faces[i][0]] };
-
-		// N-T-B coordinate system per face
-		vec t = e[0];
-		normalize(t);
-		vec n = e[0] CROSS e[1];
-		vec b = n CROSS t;
-		normalize(b);
-
-		// Project curvature tensor from each vertex into this
-		// face's coordinate system
-		vec fcurv[3];
-		for (int j = 0; j < 3; j++) {
-			int vj = faces[i][j];
-			proj_curv(pdir1[vj], pdir2[vj], curv1[vj], 0, curv2[vj],
-				  t, b, fcurv[j][0], fcurv[j][1], fcurv[j][2]);
-
-		}
-
-		// Estimate dcurv based on variation of curvature along edges
-		float m[4] = { 0, 0, 0, 0 };
-		float w[4][4] = { {0,0,0,0}, {0,0,0,0}, {0,0,0,0}, {0,0,0,0} };
-		for (int j = 0; j < 3; j++) {
-			// Variation of curvature along each edge
-			vec dfcurv = fcurv[PREV(j)] - fcurv[NEXT(j)];
-			float u = e[j] DOT t;
-			float v = e[j] DOT b;
-			float u2 = u*u, v2 = v*v, uv = u*v;
-			w[0][0] += u2;
-			w[0][1] += uv;
-			//w[1][1] += 2.0f*u2 + v2;
-			//w[1][2] += 2.0f*uv;
-			//w[2][2] += u2 + 2.0f*v2;
-			//w[2][3] += uv;
-			w[3][3] += v2;
-			m[0] += u*dfcurv[0];
-			m[1] += v*dfcurv[0] + 2.0f*u*dfcurv[1];
-			m[2] += 2.0f*v*dfcurv[1] + u*dfcurv[2];
-			m[3] += v*dfcurv[2];
-		}
-		w[1][1] = 2.0f * w[0][0] + w[3][3];
-		w[1][2] = 2.0f * w[0][1];
-		w[2][2] = w[0][0] + 2.0f * w[3][3];
-		w[2][3] = w[0][1];
-
-		// Least squares solution
-		float d[4];
-		if (!ldltdc<float,4>(w, d)) {
-			//dprintf("ldltdc failed!\n");
+	const TriMesh *mesh = this;
+	std::vector< Vec<4,float> > &dc = dcurv;
+	bool direct = one_thread();
+	std::vector< Vec<4,float> > corner_dcurv(direct ? 0 : 3 * nf);
+
+	// Compute dcurv per-face.  As in need_curvatures, on one thread the
+	// corners are added up right away.
+#pragma omp parallel for if (!direct)
+	for (ptrdiff_t i = 0; i < nf; i++) {
+		vec t, b;
+		Vec<4> fdcurv;
+		if (!face_dcurv(mesh, i, t, b, fdcurv))
 			continue;
-		}
-		ldltsl<float,4>(w, d, m, m);
-		Vec<4> face_dcurv(m);
 
-		// Push it back out to each vertex
+		// Project it into each corner's vertex coordinate system
 		for (int j = 0; j < 3; j++) {
-			int vj = faces[i][j];
+			index_t vj = mesh->faces[i][j];
 			Vec<4> this_vert_dcurv;
-			proj_dcurv(t, b, face_dcurv,
-				   pdir1[vj], pdir2[vj], this_vert_dcurv);
-			float wt = cornerareas[i][j] / pointareas[vj];
-			dcurv[vj] += wt * this_vert_dcurv;
+			proj_dcurv(t, b, fdcurv, mesh->pdir1[vj],
+				   mesh->pdir2[vj], this_vert_dcurv);
+			float wt = mesh->cornerareas[i][j] /
+				   mesh->pointareas[vj];
+			if (direct)
+				dc[vj] += wt * this_vert_dcurv;
+			else
+				corner_dcurv[3*i+j] = wt * this_vert_dcurv;
 		}
 	}
 
+	// Push it out to the vertices
+	if (!direct && nf)
+		sum_corners(&corner_dcurv[0], &dc[0]);
+
+	dcurv_gen = generation;
 	dprintf("Done.\n");
 }
 
+
+// Recompute dcurv at just the given vertices, from the current
+// curvatures, normals, and point areas.  Each vertex gathers from its
+// adjacent faces in the same order as need_dcurv, so the result is the
+// same as recomputing everything.
+void TriMesh::update_dcurv(const std::vector<index_t> &verts)
+{
+	ptrdiff_t nv = vertices.size();
+	if ((ptrdiff_t) dcurv.size() != nv)
+		return;
+	need_adjacentfaces();
+	if (adjacentfaces.empty())
+		return;
+
+	ptrdiff_t n = verts.size();
+#pragma omp parallel for schedule(dynamic, 64)
+	for (ptrdiff_t i = 0; i < n; i++) {
+		index_t v = verts[i];
+		if (v < 0 || v >= nv)
+			continue;
+		AdjList::Range a = adjacentfaces[v];
+		Vec<4,float> sum;
+		for (size_t k = 0; k < a.size(); k++) {
+			vec t, b;
+			Vec<4> fdcurv;
+			if (!face_dcurv(this, a[k], t, b, fdcurv))
+				continue;
+			for (int j = 0; j < 3; j++) {
+				if (faces[a[k]][j] != v)
+					continue;
+				Vec<4> this_vert_dcurv;
+				proj_dcurv(t, b, fdcurv,
+					   pdir1[v], pdir2[v], this_vert_dcurv);
+				float wt = cornerareas[a[k]][j] / pointareas[v];
+				sum += wt * this_vert_dcurv;
+			}
+		}
+		dcurv[v] = sum;
+	}
+}
+
 } // end namespace trimesh
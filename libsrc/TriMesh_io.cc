@@ -5,7 +5,23 @@ Princeton University
 TriMesh_io.cc
 Input and output of triangle meshes
 Can read: PLY (triangle mesh and range grid), OFF, OBJ, RAY, SM, 3DS, VVD, STL
-Can write: PLY (triangle mesh and range grid), OFF, OBJ, RAY, SM, STL, C++, DAE
+  (binary and ASCII), TMC, TMZ
+Can write: PLY (triangle mesh and range grid), OFF, OBJ, RAY, SM, STL, C++, DAE,
+  TMC, TMZ
+
+TMC is trimesh2's own cache format: a raw dump of every populated member of
+a TriMesh (including curvatures and connectivity), so that reading it back
+skips all the need_*() work.
+
+TMZ is trimesh2's own compressed format: positions quantized to the bounding
+box (16 bits by default, or q<bits>:filename.tmz), plus connectivity, colors,
+and confidences, entropy coded.  Faces and vertices are reordered.
+
+Binary PLY files written with an attr: prefix also carry curvatures, point
+areas, and named channels (TriMesh::channels) as float vertex properties.
+Curvatures and point areas are read back in whenever present, and named
+channels once they have been given to TriMesh::register_ply_channel().
+ASCII PLY files, and TMC and TMZ files, don't carry any of these.
 */
 
 #include <cstdio>
@@ -14,8 +30,16 @@ Can write: PLY (triangle mesh and range grid), OFF, OBJ, RAY, SM, STL, C++, DAE
 #include <cerrno>
 #include <cctype>
 #include <cstdarg>
+#include <climits>
+#include <limits>
+#ifdef _MSC_VER
+# include <intrin.h>
+#endif
 #include "TriMesh.h"
 #include "strutil.h"
+#include "mapfile.h"
+#include <sys/types.h>
+#include <sys/stat.h>
 
 namespace trimesh {
 
@@ -40,20 +64,47 @@ static bool read_ray(FILE *f, TriMesh *mesh);
 static bool read_obj(FILE *f, TriMesh *mesh);
 static bool read_off(FILE *f, TriMesh *mesh, bool iscolor = false);
 static bool read_sm( FILE *f, TriMesh *mesh);
-static bool read_stl( FILE *f, TriMesh *mesh);
+static bool read_stl( FILE *f, TriMesh *mesh, float weld_eps);
+static bool read_tmc( FILE *f, TriMesh *mesh);
+static bool read_tmz( FILE *f, TriMesh *mesh);
+static bool read_obj_mapped(const char *p, const char *end, TriMesh *mesh);
+static bool read_off_mapped(const char *p, const char *end, TriMesh *mesh,
+	bool iscolor);
+static bool read_sm_mapped(const char *p, const char *end, TriMesh *mesh);
 
 static bool read_verts_bin(FILE *f, TriMesh *mesh, bool &need_swap,
-	int nverts, int vert_len, int vert_pos, int vert_norm,
-	int vert_color, bool float_color, int vert_conf);
+	index_t nverts, int vert_len, int vert_pos, int vert_norm,
+	int vert_color, bool float_color, int vert_conf,
+	bool continuation = false);
 static bool slurp_verts_bin(FILE *f, TriMesh *mesh, bool need_swap,
-	int nverts);
+	index_t nverts);
+static bool read_verts_mapped(const unsigned char *p, const unsigned char *end,
+	TriMesh *mesh, bool &need_swap, index_t nverts, int vert_len,
+	int vert_pos, int vert_norm, int vert_color, bool float_color,
+	int vert_conf, size_t &nbytes);
+struct PlyChannel;
+static void read_attribs_mapped(const unsigned char *p, TriMesh *mesh,
+	bool need_swap, index_t nverts, int vert_len,
+	const std::vector<PlyChannel> &channels);
 static bool read_verts_asc(FILE *f, TriMesh *mesh,
-	int nverts, int vert_len, int vert_pos, int vert_norm,
-	int vert_color, bool float_color, int vert_conf);
+	index_t nverts, int vert_len, int vert_pos, int vert_norm,
+	int vert_color, bool float_color, int vert_conf,
+	bool continuation = false);
 static bool read_faces_bin(FILE *f, TriMesh *mesh, bool need_swap,
-	int nfaces, int face_len, int face_count, int face_idx);
-static bool read_faces_asc(FILE *f, TriMesh *mesh, int nfaces,
-	int face_len, int face_count, int face_idx, bool read_to_eol = false);
+	index_t nfaces, int face_len, int face_count, int face_idx,
+	bool continuation = false);
+static bool read_faces_mapped(const unsigned char *p, const unsigned char *end,
+	TriMesh *mesh, bool need_swap,
+	index_t nfaces, int face_len, int face_count, int face_idx);
+static bool read_faces_asc(FILE *f, TriMesh *mesh, index_t nfaces,
+	int face_len, int face_count, int face_idx, bool read_to_eol = false,
+	bool continuation = false);
+static bool read_verts_asc_mapped(const char *&p, const char *end,
+	TriMesh *mesh, index_t nverts, int vert_len, int vert_pos,
+	int vert_norm, int vert_color, bool float_color, int vert_conf);
+static bool read_faces_asc_mapped(const char *&p, const char *end,
+	TriMesh *mesh, index_t nfaces, int face_len, int face_count,
+	int face_idx, bool read_to_eol = false);
 static bool read_strips_bin(FILE *f, TriMesh *mesh, bool need_swap);
 static bool read_strips_asc(FILE *f, TriMesh *mesh);
 static bool read_grid_bin(FILE *f, TriMesh *mesh, bool need_swap);
@@ -64,13 +115,19 @@ static bool ply_property(const char *buf, int &len, bool binary);
 static void check_need_swap(const point &p, bool &need_swap);
 static void check_ind_range(TriMesh *mesh);
 static void skip_comments(FILE *f);
+static const char *skip_comments(const char *p, const char *end);
+static bool map_text(FILE *f, MappedFile &map,
+	const char *&p, const char *&end);
+static void clear_elements(TriMesh *mesh);
+static void weld_mesh(TriMesh *mesh, float eps);
 static void tess(const std::vector<point> &verts, const std::vector<int> &thisface,
 		 std::vector<TriMesh::Face> &tris);
 
 static bool write_ply_ascii(TriMesh *mesh, FILE *f,
 	bool write_norm, bool write_grid, bool float_color);
 static bool write_ply_binary(TriMesh *mesh, FILE *f,
-	bool need_swap, bool write_norm, bool write_grid, bool float_color);
+	bool need_swap, bool write_norm, bool write_grid, bool float_color,
+	bool write_attribs);
 static bool write_ray(TriMesh *mesh, FILE *f);
 static bool write_obj(TriMesh *mesh, FILE *f, bool write_norm);
 static bool write_off(TriMesh *mesh, FILE *f);
@@ -79,6 +136,10 @@ static bool write_stl(TriMesh *mesh, FILE *f);
 static bool write_cc(TriMesh *mesh, FILE *f, const char *filename,
 	bool write_norm, bool float_color);
 static bool write_dae(TriMesh *mesh, FILE *f);
+static unsigned char color2uchar(float p);
+static bool write_tmc(TriMesh *mesh, FILE *f,
+	long long source_size = 0, long long source_mtime = 0);
+static bool write_tmz(TriMesh *mesh, FILE *f, int bits);
 static bool write_verts_asc(TriMesh *mesh, FILE *f,
 			    const char *before_vert,
 			    const char *before_norm,
@@ -88,7 +149,8 @@ static bool write_verts_asc(TriMesh *mesh, FILE *f,
 			    const char *after_line);
 static bool write_verts_bin(TriMesh *mesh, FILE *f, bool need_swap,
 			    bool write_norm, bool write_color,
-			    bool float_color, bool write_conf);
+			    bool float_color, bool write_conf,
+			    bool write_attribs);
 static bool write_faces_asc(TriMesh *mesh, FILE *f,
 			    const char *before_face, const char *after_line);
 static bool write_faces_bin(TriMesh *mesh, FILE *f, bool need_swap,
@@ -216,6 +278,9 @@ TriMesh *TriMesh::read(const char *filename)
 // few bytes.  Filename can be "-" for stdin.
 // STL doesn't have a magic number, nor any other way of recognizing it.
 // Recognize file.stl and stl:- constructions.
+// A weld: prefix merges vertices at identical positions, and weld<eps>:
+// (e.g., weld0.001:file.stl) merges vertices in the same cell of a grid
+// of spacing eps.
 bool TriMesh::read_helper(const char *filename, TriMesh *mesh)
 {
 	if (!filename || *filename == '\0')
@@ -223,8 +288,23 @@ bool TriMesh::read_helper(const char *filename, TriMesh *mesh)
 
 	FILE *f = NULL;
 	bool ok = false;
+	float weld_eps = -1.0f;
 	int c;
 
+	if (begins_with(filename, "weld")) {
+		char *colon;
+		float eps = (float) strtod(filename + 4, &colon);
+		if (filename[4] == ':') {
+			weld_eps = 0.0f;
+			filename += 5;
+		} else if (colon > filename + 4 && *colon == ':' && eps > 0.0f) {
+			weld_eps = eps;
+			filename = colon + 1;
+		}
+	}
+	bool is_stl = begins_with(filename, "stl:-") ||
+		ends_with(filename, ".stl");
+
 	if (strcmp(filename, "-") == 0) {
 		f = stdin;
 		filename = "standard input";
@@ -242,8 +322,8 @@ bool TriMesh::read_helper(const char *filename, TriMesh *mesh)
 	dprintf("Reading %s... ", filename);
 
 	// STL
-	if (begins_with(filename, "stl:-") || ends_with(filename, ".stl")) {
-		ok = read_stl(f, mesh);
+	if (is_stl) {
+		ok = read_stl(f, mesh, weld_eps);
 		goto out;
 	}
 
@@ -316,6 +396,17 @@ bool TriMesh::read_helper(const char *filename, TriMesh *mesh)
 		// Assume an old-style sm file
 		ungetc(c, f);
 		ok = read_sm(f, mesh);
+	} else if (c == 'T') {
+		// Our own tmc and tmz formats
+		char buf[3];
+		if (fread(buf, 3, 1, f) != 1) {
+			eprintf("Can't read header.\n");
+			goto out;
+		}
+		if (memcmp(buf, "MC", 3) == 0)
+			ok = read_tmc(f, mesh);
+		else if (memcmp(buf, "MZ", 3) == 0)
+			ok = read_tmz(f, mesh);
 	} else {
 		eprintf("Unknown file type.\n");
 	}
@@ -327,6 +418,8 @@ out:
 		eprintf("Error reading file [%s].\n", filename);
 		return false;
 	}
+	if (weld_eps >= 0.0f && !is_stl)
+		weld_mesh(mesh, weld_eps);
 
 	dprintf("Done.\n");
 	check_ind_range(mesh);
@@ -334,15 +427,218 @@ out:
 }
 
 
-// Read a ply file
-static bool read_ply(FILE *f, TriMesh *mesh)
+// Per-vertex values, other than positions, normals, colors, and
+// confidences, that binary ply files can carry.  Each is stored as float
+// properties named after it: e.g., "curv1", or "pdir1x", "pdir1y", "pdir1z"
+// for a vector, or "dcurv0" through "dcurv3" for a 4-vector.  There are
+// the curvatures and point areas, plus the mesh's named channels when
+// writing, or the channels given to register_ply_channel() when reading.
+enum { PLY_CURV1, PLY_CURV2, PLY_PDIR1, PLY_PDIR2, PLY_DCURV,
+       PLY_POINTAREAS, PLY_NATTRIBS };
+static const char *ply_attrib_names[PLY_NATTRIBS] = {
+	"curv1", "curv2", "pdir1", "pdir2", "dcurv", "pointarea"
+};
+static const int ply_attrib_ncomp[PLY_NATTRIBS] = { 1, 1, 3, 3, 4, 1 };
+
+struct PlyChannel {
+	std::string name;
+	int ncomp;
+	int attrib;		// One of the above, or PLY_NATTRIBS for a
+				// named channel
+	std::vector<int> pos;	// When reading, where each component is
+				// in the vertex records (or -1)
+	PlyChannel(const std::string &name_, int ncomp_,
+		   int attrib_ = PLY_NATTRIBS) :
+		name(name_), ncomp(ncomp_), attrib(attrib_), pos(ncomp_, -1)
+		{}
+
+	// Name of the property holding component j
+	std::string prop(int j) const
+	{
+		std::string p = name;
+		if (ncomp == 3)
+			p += "xyz"[j];
+		else if (ncomp > 1)
+			p += char('0' + j);
+		return p;
+	}
+};
+
+
+// The channels that have been registered to be read
+static std::vector<PlyChannel> &registered_ply_channels()
+{
+	static std::vector<PlyChannel> channels;
+	return channels;
+}
+
+
+// Have reads of binary ply files load a named channel
+void TriMesh::register_ply_channel(const char *name, int ncomp /* = 1 */)
+{
+	if (!name || !*name || ncomp < 1 || ncomp > 9) {
+		eprintf("Bad ply channel %s with %d components.\n",
+			name ? name : "(null)", ncomp);
+		return;
+	}
+	std::vector<PlyChannel> &channels = registered_ply_channels();
+	for (size_t i = 0; i < channels.size(); i++) {
+		if (channels[i].name == name) {
+			channels[i] = PlyChannel(name, ncomp);
+			return;
+		}
+	}
+	channels.push_back(PlyChannel(name, ncomp));
+}
+
+
+// The channel of the mesh with the given name, or NULL
+TriMesh::Channel *TriMesh::channel(const char *name)
+{
+	for (size_t i = 0; i < channels.size(); i++)
+		if (channels[i].name == name)
+			return &channels[i];
+	return NULL;
+}
+
+const TriMesh::Channel *TriMesh::channel(const char *name) const
+{
+	for (size_t i = 0; i < channels.size(); i++)
+		if (channels[i].name == name)
+			return &channels[i];
+	return NULL;
+}
+
+
+// The channel of the mesh with the given name, added if need be and
+// sized for ncomp values per vertex
+TriMesh::Channel &TriMesh::add_channel(const char *name, int ncomp /* = 1 */)
+{
+	Channel *c = channel(name);
+	if (!c) {
+		channels.push_back(Channel(name, ncomp));
+		c = &channels.back();
+	}
+	c->ncomp = ncomp;
+	c->values.resize(ncomp * vertices.size());
+	return *c;
+}
+
+
+// The floats holding attribute i of the mesh, or NULL if it doesn't have
+// one per vertex.  The const version doesn't copy arrays shared with
+// another mesh; the other one makes room for one per vertex first.
+static const float *ply_attrib(const TriMesh *mesh, int i)
+{
+	size_t nv = mesh->vertices.size();
+	switch (i) {
+#define PLY_ATTRIB(id, v) \
+	case id: \
+		return (nv && v.size() == nv) ? (const float *) &v[0] : NULL;
+	PLY_ATTRIB(PLY_CURV1, mesh->curv1)
+	PLY_ATTRIB(PLY_CURV2, mesh->curv2)
+	PLY_ATTRIB(PLY_PDIR1, mesh->pdir1)
+	PLY_ATTRIB(PLY_PDIR2, mesh->pdir2)
+	PLY_ATTRIB(PLY_DCURV, mesh->dcurv)
+	PLY_ATTRIB(PLY_POINTAREAS, mesh->pointareas)
+#undef PLY_ATTRIB
+	}
+	return NULL;
+}
+
+static float *ply_attrib(TriMesh *mesh, int i)
+{
+	size_t nv = mesh->vertices.size();
+	switch (i) {
+#define PLY_ATTRIB(id, v) \
+	case id: \
+		v.resize(nv); \
+		return nv ? (float *) &v[0] : NULL;
+	PLY_ATTRIB(PLY_CURV1, mesh->curv1)
+	PLY_ATTRIB(PLY_CURV2, mesh->curv2)
+	PLY_ATTRIB(PLY_PDIR1, mesh->pdir1)
+	PLY_ATTRIB(PLY_PDIR2, mesh->pdir2)
+	PLY_ATTRIB(PLY_DCURV, mesh->dcurv)
+	PLY_ATTRIB(PLY_POINTAREAS, mesh->pointareas)
+#undef PLY_ATTRIB
+	}
+	return NULL;
+}
+
+
+// The channels to write for a mesh, with where their values come from
+static void ply_write_channels(const TriMesh *mesh,
+	std::vector<PlyChannel> &channels, std::vector<const float *> &data)
+{
+	for (int i = 0; i < PLY_NATTRIBS; i++) {
+		const float *a = ply_attrib(mesh, i);
+		if (!a)
+			continue;
+		channels.push_back(PlyChannel(ply_attrib_names[i],
+					      ply_attrib_ncomp[i], i));
+		data.push_back(a);
+	}
+	size_t nv = mesh->vertices.size();
+	for (size_t i = 0; i < mesh->channels.size(); i++) {
+		const TriMesh::Channel &c = mesh->channels[i];
+		if (!nv || c.ncomp < 1 || c.ncomp > 9 ||
+		    c.values.size() != c.ncomp * nv)
+			continue;
+		bool dup = false;
+		for (size_t j = 0; j < channels.size(); j++)
+			if (channels[j].name == c.name)
+				dup = true;
+		if (dup)
+			continue;
+		channels.push_back(PlyChannel(c.name, c.ncomp));
+		data.push_back(&c.values[0]);
+	}
+}
+
+
+// Everything we need to know from a ply header in order to read the rest
+struct PlyHeader {
+	bool binary, need_swap, float_color;
+	index_t nverts, nfaces;
+	int nstrips, ngrid;
+	int vert_len, vert_pos, vert_norm, vert_color, vert_conf;
+	std::vector<PlyChannel> vert_channels;
+	int face_len, face_count, face_idx;
+	int skip1, skip2;
+	PlyHeader() : binary(false), need_swap(false), float_color(false),
+		nverts(0), nfaces(0), nstrips(0), ngrid(0),
+		vert_len(0), vert_pos(-1), vert_norm(-1),
+		vert_color(-1), vert_conf(-1),
+		face_len(0), face_count(-1), face_idx(-1),
+		skip1(0), skip2(0)
+		{}
+};
+
+
+// Parse the number of elements from an "element" line of a ply header,
+// given the format for sscanf.  Counts too big for index_t are rejected.
+static bool ply_element_count(const char *buf, const char *format,
+	index_t &n)
+{
+	long long count;
+	if (sscanf(buf, format, &count) != 1 || count < 0)
+		return false;
+	if (count > (long long) std::numeric_limits<index_t>::max()) {
+		eprintf("Too many elements (%lld) - "
+			"rebuild with TRIMESH_64BIT_INDICES.\n", count);
+		return false;
+	}
+	n = (index_t) count;
+	return true;
+}
+
+
+// Read a ply header, up to and including the end_header line.
+// Range grid dimensions are stored directly into the mesh.
+static bool read_ply_header(FILE *f, TriMesh *mesh, PlyHeader &h)
 {
-	char buf[1024];	
-	bool binary = false, need_swap = false, float_color = false;
-	int result, nverts = 0, nfaces = 0, nstrips = 0, ngrid = 0;
-	int vert_len = 0, vert_pos = -1, vert_norm = -1;
-	int vert_color = -1, vert_conf = -1;
-	int face_len = 0, face_count = -1, face_idx = -1;
+	char buf[1024];
+	bool &binary = h.binary;
 
 	// Read file format
 	GET_LINE();
@@ -350,10 +646,10 @@ static bool read_ply(FILE *f, TriMesh *mesh)
 		GET_LINE();
 	if (LINE_IS("format binary_big_endian 1.0")) {
 		binary = true;
-		need_swap = we_are_little_endian();
+		h.need_swap = we_are_little_endian();
 	} else if (LINE_IS("format binary_little_endian 1.0")) {
 		binary = true;
-		need_swap = !we_are_little_endian();
+		h.need_swap = !we_are_little_endian();
 	} else if (LINE_IS("format ascii 1.0")) {
 		binary = false;
 	} else {
@@ -372,7 +668,6 @@ static bool read_ply(FILE *f, TriMesh *mesh)
 	}
 
 	// Skip until we find vertices
-	int skip1 = 0;
 	while (!LINE_IS("end_header") && !LINE_IS("element vertex")) {
 		char elem_name[1024];
 		int nelem = 0, elem_len = 0;
@@ -383,47 +678,78 @@ static bool read_ply(FILE *f, TriMesh *mesh)
 				return false;
 			GET_LINE();
 		}
-		skip1 += nelem * elem_len;
+		h.skip1 += nelem * elem_len;
 	}
 
 	// Find number of vertices
-	result = sscanf(buf, "element vertex %d\n", &nverts);
-	if (result != 1) {
+	if (!ply_element_count(buf, "element vertex %lld\n", h.nverts)) {
 		eprintf("Expected \"element vertex\".\n");
 		return false;
 	}
 
-	// Parse vertex properties
+	// Parse vertex properties.  The components of each channel may be
+	// anywhere in the vertex records, in any order.
+	std::vector<PlyChannel> channels;
+	for (int i = 0; i < PLY_NATTRIBS; i++)
+		channels.push_back(PlyChannel(ply_attrib_names[i],
+					      ply_attrib_ncomp[i], i));
+	channels.insert(channels.end(), registered_ply_channels().begin(),
+			registered_ply_channels().end());
 	GET_LINE();
 	while (LINE_IS("property")) {
+		char type[256], name[256];
+		if (sscanf(buf, "property %255s %255s", type, name) == 2 &&
+		    (!strcmp(type, "float") || !strcmp(type, "float32"))) {
+			for (size_t i = 0; i < channels.size(); i++)
+				for (int j = 0; j < channels[i].ncomp; j++)
+					if (channels[i].prop(j) == name)
+						channels[i].pos[j] = h.vert_len;
+		}
 		if (LINE_IS("property float x") ||
 		    LINE_IS("property float32 x"))
-			vert_pos = vert_len;
+			h.vert_pos = h.vert_len;
 		if (LINE_IS("property float nx") ||
 		    LINE_IS("property float32 nx"))
-			vert_norm = vert_len;
+			h.vert_norm = h.vert_len;
 		if (LINE_IS("property uchar diffuse_red") ||
 		    LINE_IS("property uint8 diffuse_red") ||
 		    LINE_IS("property uchar red") ||
 		    LINE_IS("property uint8 red"))
-			vert_color = vert_len;
+			h.vert_color = h.vert_len;
 		if (LINE_IS("property float diffuse_red") ||
 		    LINE_IS("property float32 diffuse_red") ||
 		    LINE_IS("property float red") ||
 		    LINE_IS("property float32 red"))
-			vert_color = vert_len, float_color = true;
+			h.vert_color = h.vert_len, h.float_color = true;
 		if (LINE_IS("property float confidence") ||
 		    LINE_IS("property float32 confidence"))
-			vert_conf = vert_len;
+			h.vert_conf = h.vert_len;
 
-		if (!ply_property(buf, vert_len, binary))
+		if (!ply_property(buf, h.vert_len, binary))
 			return false;
 
 		GET_LINE();
 	}
+	for (size_t i = 0; i < channels.size(); i++) {
+		const PlyChannel &c = channels[i];
+		int found = 0;
+		for (int j = 0; j < c.ncomp; j++)
+			if (c.pos[j] >= 0)
+				found++;
+		if (!found)
+			continue;
+		if (found < c.ncomp)
+			eprintf("Warning: ply channel %s has only %d of %d "
+				"components - ignored.\n",
+				c.name.c_str(), found, c.ncomp);
+		else if (!binary)
+			eprintf("Warning: ply channel %s is only read from "
+				"binary files - ignored.\n", c.name.c_str());
+		else
+			h.vert_channels.push_back(c);
+	}
 
 	// Skip until we find faces
-	int skip2 = 0;
 	while (!LINE_IS("end_header") && !LINE_IS("element face") &&
 	       !LINE_IS("element tristrips") && !LINE_IS("element range_grid")) {
 		char elem_name[1024];
@@ -435,13 +761,13 @@ static bool read_ply(FILE *f, TriMesh *mesh)
 				return false;
 			GET_LINE();
 		}
-		skip2 += nelem * elem_len;
+		h.skip2 += nelem * elem_len;
 	}
 
 
 	// Look for faces, tristrips, or range grid
 	if (LINE_IS("element face")) {
-		if (sscanf(buf, "element face %d\n", &nfaces) != 1)
+		if (!ply_element_count(buf, "element face %lld\n", h.nfaces))
 			return false;
 		GET_LINE();
 		while (LINE_IS("property")) {
@@ -451,25 +777,25 @@ static bool read_ply(FILE *f, TriMesh *mesh)
 				int count_len = ply_type_len(count_type, binary);
 				int ind_len = ply_type_len(ind_type, binary);
 				if (count_len && ind_len) {
-					face_count = face_len;
-					face_idx = face_len + count_len;
-					face_len += count_len;
+					h.face_count = h.face_len;
+					h.face_idx = h.face_len + count_len;
+					h.face_len += count_len;
 				}
-			} else if (!ply_property(buf, face_len, binary))
+			} else if (!ply_property(buf, h.face_len, binary))
 				return false;
 			GET_LINE();
 		}
 	} else if (LINE_IS("element tristrips")) {
-		nstrips = 1;
+		h.nstrips = 1;
 		GET_LINE();
 		if (!LINE_IS("property list int int vertex_ind") &&
 		    !LINE_IS("property list int32 int32 vertex_ind"))
 			return false;
 		GET_LINE();
 	} else if (LINE_IS("element range_grid")) {
-		if (sscanf(buf, "element range_grid %d\n", &ngrid) != 1)
+		if (sscanf(buf, "element range_grid %d\n", &h.ngrid) != 1)
 			return false;
-		if (ngrid != mesh->grid_width*mesh->grid_height) {
+		if (h.ngrid != mesh->grid_width*mesh->grid_height) {
 			eprintf("Range grid size does not equal num_rows*num_cols.\n");
 			return false;
 		}
@@ -483,7 +809,7 @@ static bool read_ply(FILE *f, TriMesh *mesh)
 	}
 
 	while (LINE_IS("property")) {
-		if (!ply_property(buf, face_len, binary))
+		if (!ply_property(buf, h.face_len, binary))
 			return false;
 		GET_LINE();
 	}
@@ -495,60 +821,136 @@ static bool read_ply(FILE *f, TriMesh *mesh)
 		eprintf("Warning: possibly corrupt file. (Transferred as ASCII instead of BINARY?)\n");
 	}
 
+	return true;
+}
+
+
+// Read the body of a binary ply file out of a memory map.  "offset" is the
+// position of the first byte after the header.
+static bool read_ply_mapped(const MappedFile &map, long long offset,
+	TriMesh *mesh, PlyHeader &h)
+{
+	const unsigned char *p = map.data() + offset;
+	const unsigned char *end = map.data() + map.size();
+	if (offset < 0 || (long long) map.size() - offset < h.skip1)
+		return false;
+	p += h.skip1;
+
+	size_t vert_bytes;
+	if (!read_verts_mapped(p, end, mesh, h.need_swap, h.nverts,
+			       h.vert_len, h.vert_pos, h.vert_norm,
+			       h.vert_color, h.float_color, h.vert_conf,
+			       vert_bytes))
+		return false;
+	read_attribs_mapped(p, mesh, h.need_swap, h.nverts, h.vert_len,
+			    h.vert_channels);
+	p += vert_bytes;
+	if (end - p < h.skip2)
+		return false;
+	p += h.skip2;
+
+	return read_faces_mapped(p, end, mesh, h.need_swap, h.nfaces,
+				 h.face_len, h.face_count, h.face_idx);
+}
+
+
+// Read a ply file
+static bool read_ply(FILE *f, TriMesh *mesh)
+{
+	PlyHeader h;
+	if (!read_ply_header(f, mesh, h))
+		return false;
+
+	// Binary triangle meshes on disk get read straight out of a memory map
+	if (h.binary && !h.ngrid && !h.nstrips) {
+		MappedFile map;
+		if (map.open(f))
+			return read_ply_mapped(map, ftell64(f), mesh, h);
+	}
+
+	// ASCII ones get parsed in parallel, as long as there's nothing
+	// other than vertices and faces
+	if (!h.binary && !h.ngrid && !h.nstrips && !h.skip1 && !h.skip2) {
+		MappedFile map;
+		const char *p, *end;
+		if (map_text(f, map, p, end)) {
+			if (read_verts_asc_mapped(p, end, mesh, h.nverts,
+					h.vert_len, h.vert_pos, h.vert_norm,
+					h.vert_color, h.float_color, h.vert_conf) &&
+			    read_faces_asc_mapped(p, end, mesh, h.nfaces,
+					h.face_len, h.face_count, h.face_idx))
+				return true;
+			clear_elements(mesh);
+		}
+	}
 
 	// Actually read everything in
-	if (skip1) {
-		if (binary)
-			fseek(f, skip1, SEEK_CUR);
+	char buf[1024];
+	if (h.skip1) {
+		if (h.binary)
+			fseek(f, h.skip1, SEEK_CUR);
 		else
-			for (int i = 0; i < skip1; i++)
+			for (int i = 0; i < h.skip1; i++)
 				fscanf(f, "%s", buf);
 	}
-	if (binary) {
-		if (!read_verts_bin(f, mesh, need_swap, nverts, vert_len,
-				    vert_pos, vert_norm, vert_color,
-				    float_color, vert_conf))
+	if (h.binary && !h.vert_channels.empty() && h.nverts > 0) {
+		// Read the vertex records in as a block, then pull the
+		// properties out of it as if it were mapped
+		std::vector<unsigned char> block(size_t(h.nverts) * h.vert_len);
+		COND_READ(true, block[0], block.size());
+		size_t nbytes;
+		if (!read_verts_mapped(&block[0], &block[0] + block.size(),
+				       mesh, h.need_swap, h.nverts, h.vert_len,
+				       h.vert_pos, h.vert_norm, h.vert_color,
+				       h.float_color, h.vert_conf, nbytes))
+			return false;
+		read_attribs_mapped(&block[0], mesh, h.need_swap, h.nverts,
+				    h.vert_len, h.vert_channels);
+	} else if (h.binary) {
+		if (!read_verts_bin(f, mesh, h.need_swap, h.nverts, h.vert_len,
+				    h.vert_pos, h.vert_norm, h.vert_color,
+				    h.float_color, h.vert_conf))
 			return false;
 	} else {
-		if (!read_verts_asc(f, mesh, nverts, vert_len,
-				    vert_pos, vert_norm, vert_color,
-				    float_color, vert_conf))
+		if (!read_verts_asc(f, mesh, h.nverts, h.vert_len,
+				    h.vert_pos, h.vert_norm, h.vert_color,
+				    h.float_color, h.vert_conf))
 			return false;
 	}
 
-	if (skip2) {
-		if (binary)
-			fseek(f, skip2, SEEK_CUR);
+	if (h.skip2) {
+		if (h.binary)
+			fseek(f, h.skip2, SEEK_CUR);
 		else
-			for (int i = 0; i < skip2; i++)
+			for (int i = 0; i < h.skip2; i++)
 				fscanf(f, "%s", buf);
 	}
 
-	if (ngrid) {
-		if (binary) {
-			if (!read_grid_bin(f, mesh, need_swap))
+	if (h.ngrid) {
+		if (h.binary) {
+			if (!read_grid_bin(f, mesh, h.need_swap))
 				return false;
 		} else {
 			if (!read_grid_asc(f, mesh))
 				return false;
 		}
-	} else if (nstrips) {
-		if (binary) {
-			if (!read_strips_bin(f, mesh, need_swap))
+	} else if (h.nstrips) {
+		if (h.binary) {
+			if (!read_strips_bin(f, mesh, h.need_swap))
 				return false;
 		} else {
 			if (!read_strips_asc(f, mesh))
 				return false;
 		}
 		mesh->convert_strips(TriMesh::TSTRIP_LENGTH);
-	} else if (nfaces) {
-		if (binary) {
-			if (!read_faces_bin(f, mesh, need_swap, nfaces,
-					    face_len, face_count, face_idx))
+	} else if (h.nfaces) {
+		if (h.binary) {
+			if (!read_faces_bin(f, mesh, h.need_swap, h.nfaces,
+					    h.face_len, h.face_count, h.face_idx))
 				return false;
 		} else {
-			if (!read_faces_asc(f, mesh, nfaces,
-					    face_len, face_count, face_idx))
+			if (!read_faces_asc(f, mesh, h.nfaces,
+					    h.face_len, h.face_count, h.face_idx))
 				return false;
 		}
 	}
@@ -556,6 +958,308 @@ static bool read_ply(FILE *f, TriMesh *mesh)
 	return true;
 }
 
+// Map the vertices of a binary ply file into memory, without copying them.
+// Returns false (and leaves the view empty) if the layout of the file
+// doesn't allow it, in which case the caller should just read() the mesh.
+bool TriMesh::map_verts(const char *filename, MappedVerts &view)
+{
+	view.release();
+
+	FILE *f = fopen(filename, "rb");
+	if (!f) {
+		eprintf("Error opening [%s] for reading: %s.\n", filename,
+			strerror(errno));
+		return false;
+	}
+
+	char buf[4];
+	TriMesh tmp;
+	PlyHeader h;
+	bool ok = fgets(buf, 4, f) && !strncmp(buf, "ply", 3) &&
+		read_ply_header(f, &tmp, h);
+	if (!ok || !h.binary || h.need_swap || h.nverts <= 0 ||
+	    h.vert_len != 12 || h.vert_pos != 0 || sizeof(point) != 12) {
+		dprintf("Can't map vertices of [%s] directly.\n", filename);
+		fclose(f);
+		return false;
+	}
+
+	long long offset = ftell64(f) + h.skip1;
+	view.map = new MappedFile;
+	ok = view.map->open(f);
+	fclose(f);
+	if (!ok || offset + 12 * (long long) h.nverts > (long long) view.map->size()) {
+		view.release();
+		return false;
+	}
+	const unsigned char *p = view.map->data() + offset;
+
+	// Unaligned floats are fine on x86, but not everywhere else
+#if !(defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64))
+	if (offset % sizeof(float)) {
+		dprintf("Can't map vertices of [%s]: unaligned.\n", filename);
+		view.release();
+		return false;
+	}
+#endif
+
+	view.verts = (const point *) p;
+	view.nverts = h.nverts;
+	return true;
+}
+
+
+void TriMesh::MappedVerts::release()
+{
+	delete map;
+	map = 0;
+	verts = 0;
+	nverts = 0;
+}
+
+
+// Open a ply file for streaming in
+bool TriMesh::PlyReader::open(const char *filename)
+{
+	close();
+	f = fopen(filename, "rb");
+	if (!f) {
+		eprintf("Error opening [%s] for reading: %s.\n", filename,
+			strerror(errno));
+		return false;
+	}
+
+	char buf[1024];
+	if (fgetc(f) != 'p' || !fgets(buf, 4, f) || strncmp(buf, "ly", 2)) {
+		eprintf("[%s] is not a ply file.\n", filename);
+		close();
+		return false;
+	}
+	h = new PlyHeader;
+	TriMesh dummy;
+	if (!read_ply_header(f, &dummy, *h)) {
+		eprintf("Error reading header of [%s].\n", filename);
+		close();
+		return false;
+	}
+	if (h->ngrid || h->nverts <= 0) {
+		eprintf("Can't stream [%s].\n", filename);
+		close();
+		return false;
+	}
+
+	if (h->skip1) {
+		if (h->binary)
+			fseek(f, h->skip1, SEEK_CUR);
+		else
+			for (int i = 0; i < h->skip1; i++)
+				fscanf(f, "%s", buf);
+	}
+	verts_left = h->nverts;
+	faces_left = 0;
+	strip_len = strip_v0 = strip_v1 = 0;
+	in_faces = false;
+	ok = true;
+	return true;
+}
+
+
+void TriMesh::PlyReader::close()
+{
+	if (f)
+		fclose(f);
+	f = 0;
+	delete h;
+	h = 0;
+	ok = false;
+}
+
+
+index_t TriMesh::PlyReader::nverts() const
+{
+	return h ? h->nverts : 0;
+}
+
+index_t TriMesh::PlyReader::nfaces() const
+{
+	return h ? h->nfaces : 0;
+}
+
+bool TriMesh::PlyReader::has_normals() const
+{
+	return h && h->vert_norm >= 0;
+}
+
+bool TriMesh::PlyReader::has_colors() const
+{
+	return h && h->vert_color >= 0;
+}
+
+bool TriMesh::PlyReader::has_confidences() const
+{
+	return h && h->vert_conf >= 0;
+}
+
+
+// Empty a chunk for reuse.  The arrays that the reader fills keep the
+// memory they have, so that reading chunk after chunk does not reallocate
+// them every time; everything else is freed.
+static void reset_chunk(TriMesh *chunk)
+{
+	TriMesh keep;
+	keep.vertices.swap(chunk->vertices);
+	keep.normals.swap(chunk->normals);
+	keep.colors.swap(chunk->colors);
+	keep.confidences.swap(chunk->confidences);
+	keep.faces.swap(chunk->faces);
+	chunk->clear();
+	chunk->vertices.swap(keep.vertices);
+	chunk->normals.swap(keep.normals);
+	chunk->colors.swap(keep.colors);
+	chunk->confidences.swap(keep.confidences);
+	chunk->faces.swap(keep.faces);
+	clear_elements(chunk);
+	chunk->geometry_changed();
+	chunk->topology_changed();
+}
+
+
+// Read the next chunk of vertices
+bool TriMesh::PlyReader::read_verts(TriMesh *chunk, int n)
+{
+	reset_chunk(chunk);
+	if (!ok || in_faces || verts_left <= 0 || n <= 0)
+		return false;
+
+	n = (int) std::min((index_t) n, verts_left);
+	bool continuation = (verts_left < h->nverts);
+	bool success;
+	if (h->binary)
+		success = read_verts_bin(f, chunk, h->need_swap, n,
+			h->vert_len, h->vert_pos, h->vert_norm,
+			h->vert_color, h->float_color, h->vert_conf,
+			continuation);
+	else
+		success = read_verts_asc(f, chunk, n,
+			h->vert_len, h->vert_pos, h->vert_norm,
+			h->vert_color, h->float_color, h->vert_conf,
+			continuation);
+	if (!success) {
+		reset_chunk(chunk);
+		ok = false;
+		return false;
+	}
+	verts_left -= n;
+	return true;
+}
+
+
+// Skip to the faces, and read the length of the triangle strips if any
+bool TriMesh::PlyReader::start_faces()
+{
+	TriMesh scratch;
+	while (read_verts(&scratch, 65536))
+		;
+	if (!ok)
+		return false;
+	in_faces = true;
+
+	char buf[1024];
+	if (h->skip2) {
+		if (h->binary)
+			fseek(f, h->skip2, SEEK_CUR);
+		else
+			for (int i = 0; i < h->skip2; i++)
+				fscanf(f, "%s", buf);
+	}
+
+	if (!h->nstrips) {
+		faces_left = h->nfaces;
+		return true;
+	}
+	int nstripinds;
+	if (h->binary) {
+		COND_READ(true, nstripinds, 4);
+		if (h->need_swap)
+			swap_int(nstripinds);
+	} else {
+		skip_comments(f);
+		if (fscanf(f, "%d", &nstripinds) != 1)
+			return false;
+	}
+	faces_left = nstripinds;
+	return true;
+}
+
+
+// Turn a piece of a (-1-terminated) triangle strip into faces, continuing
+// from wherever the last piece left off
+void TriMesh::PlyReader::add_strip(const int *inds, int n,
+	std::vector<Face> &faces)
+{
+	for (int i = 0; i < n; i++) {
+		int v = inds[i];
+		if (v == -1) {
+			strip_len = 0;
+			continue;
+		}
+		if (strip_len >= 2) {
+			if (strip_len & 1)
+				faces.push_back(Face(strip_v1, strip_v0, v));
+			else
+				faces.push_back(Face(strip_v0, strip_v1, v));
+		}
+		strip_v0 = strip_v1;
+		strip_v1 = v;
+		strip_len++;
+	}
+}
+
+
+// Read the next chunk of faces
+bool TriMesh::PlyReader::read_faces(TriMesh *chunk, int n)
+{
+	reset_chunk(chunk);
+	if (!ok)
+		return false;
+	if (!in_faces && !start_faces()) {
+		ok = false;
+		return false;
+	}
+	if (faces_left <= 0 || n <= 0)
+		return false;
+
+	n = (int) std::min((index_t) n, faces_left);
+	bool success = true;
+	if (h->nstrips) {
+		std::vector<int> inds(n);
+		if (h->binary) {
+			success = (fread(&inds[0], 4, n, f) == size_t(n));
+			if (h->need_swap)
+				for (int i = 0; i < n; i++)
+					swap_int(inds[i]);
+		} else {
+			for (int i = 0; success && i < n; i++)
+				success = (fscanf(f, "%d", &inds[i]) == 1);
+		}
+		if (success)
+			add_strip(&inds[0], n, chunk->faces);
+	} else if (h->binary) {
+		success = read_faces_bin(f, chunk, h->need_swap, n,
+			h->face_len, h->face_count, h->face_idx, true);
+	} else {
+		success = read_faces_asc(f, chunk, n,
+			h->face_len, h->face_count, h->face_idx, false, true);
+	}
+	if (!success) {
+		reset_chunk(chunk);
+		ok = false;
+		return false;
+	}
+	faces_left -= n;
+	return true;
+}
+
 
 #define CHUNK_3DS_MAIN  0x4d4d
 #define CHUNK_3DS_MODEL 0x3d3d
@@ -731,6 +1435,18 @@ static bool read_ray(FILE *f, TriMesh *mesh)
 // Read an obj file
 static bool read_obj(FILE *f, TriMesh *mesh)
 {
+	// Files on disk get parsed in parallel, straight out of a memory map.
+	// If that doesn't work out, start over reading through stdio.
+	{
+		MappedFile map;
+		const char *p, *end;
+		if (map_text(f, map, p, end)) {
+			if (read_obj_mapped(p, end, mesh))
+				return true;
+			clear_elements(mesh);
+		}
+	}
+
 	std::vector<int> thisface;
 	while (1) {
 		skip_comments(f);
@@ -787,6 +1503,16 @@ static bool read_obj(FILE *f, TriMesh *mesh)
 // Read an off file
 static bool read_off(FILE *f, TriMesh *mesh, bool iscolor)
 {
+	{
+		MappedFile map;
+		const char *p, *end;
+		if (map_text(f, map, p, end)) {
+			if (read_off_mapped(p, end, mesh, iscolor))
+				return true;
+			clear_elements(mesh);
+		}
+	}
+
 	skip_comments(f);
 	char buf[1024]; 
 	GET_LINE();
@@ -811,6 +1537,16 @@ static bool read_off(FILE *f, TriMesh *mesh, bool iscolor)
 // Read an sm file
 static bool read_sm(FILE *f, TriMesh *mesh)
 {
+	{
+		MappedFile map;
+		const char *p, *end;
+		if (map_text(f, map, p, end)) {
+			if (read_sm_mapped(p, end, mesh))
+				return true;
+			clear_elements(mesh);
+		}
+	}
+
 	int nverts, nfaces;
 
 	if (fscanf(f, "%d", &nverts) != 1)
@@ -829,37 +1565,48 @@ static bool read_sm(FILE *f, TriMesh *mesh)
 }
 
 
-// Read a binary STL file
-static bool read_stl(FILE *f, TriMesh *mesh)
+// Read an off file out of memory
+static bool read_off_mapped(const char *p, const char *end, TriMesh *mesh,
+	bool iscolor)
 {
-	bool need_swap = !we_are_little_endian();
+	p = skip_comments(p, end);
+	const char *eol = (const char *) memchr(p, '\n', end - p);
+	if (!eol)
+		eol = end;
+	int nverts, nfaces;
+	if (!parse_int(p, eol, nverts) || !parse_int(p, eol, nfaces))
+		return false;
+	p = (eol == end) ? end : eol + 1;
 
-	char header[80];
-	COND_READ(true, header, 80);
+	if (iscolor) {
+		if (!read_verts_asc_mapped(p, end, mesh, nverts, 7, 0, -1, 3,
+					   true, -1))
+			return false;
+	} else {
+		if (!read_verts_asc_mapped(p, end, mesh, nverts, 3, 0, -1, -1,
+					   false, -1))
+			return false;
+	}
+	return read_faces_asc_mapped(p, end, mesh, nfaces, 1, 0, 1, true);
+}
 
-	int nfacets;
-	COND_READ(true, nfacets, 4);
-	if (need_swap)
-		swap_int(nfacets);
 
-	mesh->faces.reserve(nfacets);
-	mesh->vertices.reserve(3*nfacets);
-	for (int i = 0; i < nfacets; i++) {
-		float fbuf[12];
-		COND_READ(true, fbuf, 48);
-		if (need_swap) {
-			for (int j = 3; j < 12; j++)
-				swap_float(fbuf[j]);
-		}
-		int v = mesh->vertices.size();
-		mesh->vertices.push_back(point(fbuf[3], fbuf[4], fbuf[5]));
-		mesh->vertices.push_back(point(fbuf[6], fbuf[7], fbuf[8]));
-		mesh->vertices.push_back(point(fbuf[9], fbuf[10], fbuf[11]));
-		mesh->faces.push_back(TriMesh::Face(v, v+1, v+2));
-		unsigned char att[2];
-		COND_READ(true, att, 2);
-	}
-	return true;
+// Read an sm file out of memory
+static bool read_sm_mapped(const char *p, const char *end, TriMesh *mesh)
+{
+	int nverts, nfaces;
+
+	if (!parse_int(p, end, nverts))
+		return false;
+
+	if (!read_verts_asc_mapped(p, end, mesh, nverts, 3, 0, -1, -1,
+				   false, -1))
+		return false;
+
+	p = skip_comments(p, end);
+	if (!parse_int(p, end, nfaces))
+		return true;
+	return read_faces_asc_mapped(p, end, mesh, nfaces, 0, -1, 0);
 }
 
 
@@ -869,9 +1616,12 @@ static bool read_stl(FILE *f, TriMesh *mesh)
 //   position of vertex coordinates / normals / color / confidence in record
 // need_swap = swap for opposite endianness
 // float_color = colors are 4-byte float * 3, vs 1-byte uchar * 3
+// continuation = these vertices continue an earlier read, so endianness
+//   has already been checked and no progress message is printed
 static bool read_verts_bin(FILE *f, TriMesh *mesh, bool &need_swap,
-	int nverts, int vert_len, int vert_pos, int vert_norm,
-	int vert_color, bool float_color, int vert_conf)
+	index_t nverts, int vert_len, int vert_pos, int vert_norm,
+	int vert_color, bool float_color, int vert_conf,
+	bool continuation /* = false */)
 {
 	const int vert_size = 12;
 	const int norm_size = 12;
@@ -881,8 +1631,8 @@ static bool read_verts_bin(FILE *f, TriMesh *mesh, bool &need_swap,
 	if (nverts <= 0 || vert_len < 12 || vert_pos < 0)
 		return false;
 
-	int old_nverts = mesh->vertices.size();
-	int new_nverts = old_nverts + nverts;
+	index_t old_nverts = mesh->vertices.size();
+	index_t new_nverts = old_nverts + nverts;
 	mesh->vertices.resize(new_nverts);
 
 	bool have_norm = (vert_norm >= 0);
@@ -895,10 +1645,10 @@ static bool read_verts_bin(FILE *f, TriMesh *mesh, bool &need_swap,
 	if (have_conf)
 		mesh->confidences.resize(new_nverts);
 
-	unsigned char *buf = new unsigned char[vert_len];
+	std::vector<unsigned char> buf(vert_len);
 	COND_READ(true, buf[0], vert_len);
 
-	int i = old_nverts;
+	index_t i = old_nverts;
 	memcpy(&mesh->vertices[i][0], &buf[vert_pos], vert_size);
 	if (have_norm)
 		memcpy(&mesh->normals[i][0], &buf[vert_norm], norm_size);
@@ -909,7 +1659,8 @@ static bool read_verts_bin(FILE *f, TriMesh *mesh, bool &need_swap,
 	if (have_conf)
 		memcpy(&mesh->confidences[i], &buf[vert_conf], conf_size);
 
-	check_need_swap(mesh->vertices[i], need_swap);
+	if (!continuation)
+		check_need_swap(mesh->vertices[i], need_swap);
 	if (need_swap) {
 		swap_float(mesh->vertices[i][0]);
 		swap_float(mesh->vertices[i][1]);
@@ -928,7 +1679,8 @@ static bool read_verts_bin(FILE *f, TriMesh *mesh, bool &need_swap,
 			swap_float(mesh->confidences[i]);
 	}
 
-	dprintf("\n  Reading %d vertices... ", nverts);
+	if (!continuation)
+		dprintf("\n  Reading %lld vertices... ", (long long) nverts);
 	if (vert_len == 12 && sizeof(point) == 12 && nverts > 1)
 		return slurp_verts_bin(f, mesh, need_swap, nverts);
 	while (++i < new_nverts) {
@@ -967,10 +1719,11 @@ static bool read_verts_bin(FILE *f, TriMesh *mesh, bool &need_swap,
 
 
 // Optimized reader for the simple case of just vertices w/o other properties
-static bool slurp_verts_bin(FILE *f, TriMesh *mesh, bool need_swap, int nverts)
+static bool slurp_verts_bin(FILE *f, TriMesh *mesh, bool need_swap,
+	index_t nverts)
 {
-	int first = mesh->vertices.size() - nverts + 1;
-	COND_READ(true, mesh->vertices[first][0], (nverts-1)*12);
+	size_t first = mesh->vertices.size() - nverts + 1;
+	COND_READ(true, mesh->vertices[first][0], size_t(nverts - 1) * 12);
 	if (need_swap) {
 	    for (size_t i = first; i < mesh->vertices.size(); i++) {
 			swap_float(mesh->vertices[i][0]);
@@ -982,18 +1735,151 @@ static bool slurp_verts_bin(FILE *f, TriMesh *mesh, bool need_swap, int nverts)
 }
 
 
-// Read a bunch of vertices from an ASCII file.
-// Parameters are as in read_verts_bin, but offsets are in
-// (white-space-separated) words, rather than in bytes
+// Gather ncomp floats from offset "pos" within each of n records of
+// length "stride", packing them into dst.
+static void gather_mapped(float *dst, int ncomp, const unsigned char *src,
+	index_t n, int stride, int pos)
+{
+	src += pos;
+	const size_t len = ncomp * sizeof(float);
+#pragma omp parallel for
+	for (index_t i = 0; i < n; i++)
+		memcpy(dst + size_t(i) * ncomp, src + size_t(i) * stride, len);
+}
+
+
+// Byte-swap a whole array of floats
+static void swap_floats(float *p, size_t n)
+{
+	long long nblocks = (n + 1023) / 1024;
+#pragma omp parallel for
+	for (long long i = 0; i < nblocks; i++) {
+		size_t end = std::min(n, size_t(i+1) * 1024);
+		for (size_t j = size_t(i) * 1024; j < end; j++)
+			swap_float(p[j]);
+	}
+}
+
+
+// Read nverts vertices out of a memory-mapped binary file starting at p.
+// Parameters are as in read_verts_bin.  Records consisting of nothing but
+// positions are copied in bulk; otherwise each property is gathered from
+// the records separately.  Returns the number of bytes used in nbytes.
+static bool read_verts_mapped(const unsigned char *p, const unsigned char *end,
+	TriMesh *mesh, bool &need_swap, index_t nverts, int vert_len,
+	int vert_pos, int vert_norm, int vert_color, bool float_color,
+	int vert_conf, size_t &nbytes)
+{
+	if (nverts <= 0 || vert_len < 12 || vert_pos < 0)
+		return false;
+	nbytes = size_t(nverts) * vert_len;
+	if (size_t(end - p) < nbytes)
+		return false;
+
+	index_t old_nverts = mesh->vertices.size();
+	index_t new_nverts = old_nverts + nverts;
+	mesh->vertices.resize(new_nverts);
+
+	bool have_norm = (vert_norm >= 0);
+	bool have_color = (vert_color >= 0);
+	bool have_conf = (vert_conf >= 0);
+	if (have_norm)
+		mesh->normals.resize(new_nverts);
+	if (have_color)
+		mesh->colors.resize(new_nverts);
+	if (have_conf)
+		mesh->confidences.resize(new_nverts);
+
+	dprintf("\n  Reading %lld vertices... ", (long long) nverts);
+	float *v = &mesh->vertices[old_nverts][0];
+	if (vert_len == 12 && sizeof(point) == 12)
+		copy_mapped(v, p, nbytes);
+	else
+		gather_mapped(v, 3, p, nverts, vert_len, vert_pos);
+	check_need_swap(mesh->vertices[old_nverts], need_swap);
+	if (need_swap)
+		swap_floats(v, 3 * size_t(nverts));
+
+	if (have_norm) {
+		float *n = &mesh->normals[old_nverts][0];
+		gather_mapped(n, 3, p, nverts, vert_len, vert_norm);
+		if (need_swap)
+			swap_floats(n, 3 * size_t(nverts));
+	}
+	if (have_color && float_color) {
+		float *c = &mesh->colors[old_nverts][0];
+		gather_mapped(c, 3, p, nverts, vert_len, vert_color);
+		if (need_swap)
+			swap_floats(c, 3 * size_t(nverts));
+	}
+	if (have_color && !float_color) {
+		const unsigned char *c = p + vert_color;
+#pragma omp parallel for
+		for (index_t i = 0; i < nverts; i++)
+			mesh->colors[old_nverts + i] =
+				Color(c + size_t(i) * vert_len);
+	}
+	if (have_conf) {
+		float *c = &mesh->confidences[old_nverts];
+		gather_mapped(c, 1, p, nverts, vert_len, vert_conf);
+		if (need_swap)
+			swap_floats(c, nverts);
+	}
+
+	return true;
+}
+
+
+// Gather the channels (see PlyChannel) found in the last nverts binary
+// vertex records, which start at p.  Channels whose components are next
+// to each other, in order, are copied a whole vertex at a time.
+static void read_attribs_mapped(const unsigned char *p, TriMesh *mesh,
+	bool need_swap, index_t nverts, int vert_len,
+	const std::vector<PlyChannel> &channels)
+{
+	size_t first = mesh->vertices.size() - nverts;
+	for (size_t i = 0; i < channels.size(); i++) {
+		const PlyChannel &c = channels[i];
+		int ncomp = c.ncomp;
+		float *a = (c.attrib < PLY_NATTRIBS) ? ply_attrib(mesh, c.attrib) :
+			&mesh->add_channel(c.name.c_str(), ncomp).values[0];
+		a += first * ncomp;
+		dprintf("%s... ", c.name.c_str());
+
+		bool contiguous = true;
+		for (int j = 1; j < ncomp; j++)
+			if (c.pos[j] != c.pos[0] + 4 * j)
+				contiguous = false;
+		if (contiguous) {
+			gather_mapped(a, ncomp, p, nverts, vert_len, c.pos[0]);
+		} else {
+			for (int j = 0; j < ncomp; j++) {
+				const unsigned char *src = p + c.pos[j];
+#pragma omp parallel for
+				for (index_t k = 0; k < nverts; k++)
+					memcpy(a + size_t(k) * ncomp + j,
+					       src + size_t(k) * vert_len, 4);
+			}
+		}
+		if (need_swap)
+			swap_floats(a, ncomp * size_t(nverts));
+	}
+}
+
+
+// Read a bunch of vertices from an ASCII file.
+// Parameters are as in read_verts_bin, but offsets are in
+// (white-space-separated) words, rather than in bytes
 static bool read_verts_asc(FILE *f, TriMesh *mesh,
-	int nverts, int vert_len, int vert_pos, int vert_norm,
-	int vert_color, bool float_color, int vert_conf)
+	index_t nverts, int vert_len, int vert_pos, int vert_norm,
+	int vert_color, bool float_color, int vert_conf,
+	bool continuation /* = false */)
 {
 	if (nverts <= 0 || vert_len < 3 || vert_pos < 0)
 		return false;
 
-	int old_nverts = mesh->vertices.size();
-	int new_nverts = old_nverts + nverts;
+	index_t old_nverts = mesh->vertices.size();
+	index_t new_nverts = old_nverts + nverts;
 	mesh->vertices.resize(new_nverts);
 	if (vert_norm > 0)
 		mesh->normals.resize(new_nverts);
@@ -1004,8 +1890,9 @@ static bool read_verts_asc(FILE *f, TriMesh *mesh,
 
 	char buf[1024];
 	skip_comments(f);
-	dprintf("\n  Reading %d vertices... ", nverts);
-	for (int i = old_nverts; i < new_nverts; i++) {
+	if (!continuation)
+		dprintf("\n  Reading %lld vertices... ", (long long) nverts);
+	for (index_t i = old_nverts; i < new_nverts; i++) {
 		for (int j = 0; j < vert_len; j++) {
 			if (j == vert_pos) {
 				if (fscanf(f, "%f %f %f",
@@ -1052,8 +1939,10 @@ static bool read_verts_asc(FILE *f, TriMesh *mesh,
 // face_count = offset within record of the count of indices in this face
 //  (If this is -1, does not read a count and assumes triangles)
 // face_idx = offset within record of the indices themselves
+// continuation = these faces continue an earlier read (see read_verts_bin)
 static bool read_faces_bin(FILE *f, TriMesh *mesh, bool need_swap,
-	int nfaces, int face_len, int face_count, int face_idx)
+	index_t nfaces, int face_len, int face_count, int face_idx,
+	bool continuation /* = false */)
 {
 	if (nfaces < 0 || face_idx < 0)
 		return false;
@@ -1061,10 +1950,11 @@ static bool read_faces_bin(FILE *f, TriMesh *mesh, bool need_swap,
 	if (nfaces == 0)
 		return true;
 
-	dprintf("\n  Reading %d faces... ", nfaces);
+	if (!continuation)
+		dprintf("\n  Reading %lld faces... ", (long long) nfaces);
 
-	int old_nfaces = mesh->faces.size();
-	int new_nfaces = old_nfaces + nfaces;
+	index_t old_nfaces = mesh->faces.size();
+	index_t new_nfaces = old_nfaces + nfaces;
 	mesh->faces.reserve(new_nfaces);
 
 	// face_len doesn't include the indices themeselves, since that's
@@ -1073,7 +1963,7 @@ static bool read_faces_bin(FILE *f, TriMesh *mesh, bool need_swap,
 
 	std::vector<unsigned char> buf(std::max(face_idx, face_skip));
 	std::vector<int> thisface;
-	for (int i = 0; i < nfaces; i++) {
+	for (index_t i = 0; i < nfaces; i++) {
 		COND_READ(face_idx > 0, buf[0], face_idx);
 
 		unsigned this_ninds = 3;
@@ -1101,9 +1991,100 @@ static bool read_faces_bin(FILE *f, TriMesh *mesh, bool need_swap,
 }
 
 
+// Read the count of indices of a face
+static inline unsigned face_ninds(const unsigned char *p, int count_len,
+	bool need_swap)
+{
+	if (count_len != 4)
+		return *p;
+	unsigned n;
+	memcpy(&n, p, 4);
+	if (need_swap)
+		swap_unsigned(n);
+	return n;
+}
+
+
+// Read nfaces faces out of a memory-mapped binary file starting at p.
+// Parameters are as in read_faces_bin.  If every face is a triangle (the
+// common case), the records all have the same length and the indices are
+// gathered in parallel.  Otherwise, walk through them one at a time.
+static bool read_faces_mapped(const unsigned char *p, const unsigned char *end,
+	TriMesh *mesh, bool need_swap,
+	index_t nfaces, int face_len, int face_count, int face_idx)
+{
+	if (nfaces < 0 || face_idx < 0)
+		return false;
+
+	if (nfaces == 0)
+		return true;
+
+	dprintf("\n  Reading %lld faces... ", (long long) nfaces);
+
+	index_t old_nfaces = mesh->faces.size();
+	int count_len = face_idx - face_count;
+	int face_skip = face_len - face_idx;
+	size_t stride = face_len + 12;
+
+	bool all_tris = (size_t(end - p) >= nfaces * stride);
+	if (all_tris && face_count >= 0) {
+		index_t ntris = 0;
+#pragma omp parallel for reduction(+ : ntris)
+		for (index_t i = 0; i < nfaces; i++)
+			ntris += (face_ninds(p + i * stride + face_count,
+					     count_len, need_swap) == 3);
+		all_tris = (ntris == nfaces);
+	}
+
+	if (all_tris) {
+		mesh->faces.resize(old_nfaces + nfaces);
+		const unsigned char *inds = p + face_idx;
+#pragma omp parallel for
+		for (index_t i = 0; i < nfaces; i++) {
+			int ind[3];
+			memcpy(ind, inds + i * stride, 12);
+			if (need_swap) {
+				swap_int(ind[0]);
+				swap_int(ind[1]);
+				swap_int(ind[2]);
+			}
+			mesh->faces[old_nfaces + i] =
+				TriMesh::Face(ind[0], ind[1], ind[2]);
+		}
+		return true;
+	}
+
+	mesh->faces.reserve(old_nfaces + nfaces);
+	std::vector<int> thisface;
+	for (index_t i = 0; i < nfaces; i++) {
+		if (end - p < face_idx)
+			return false;
+		unsigned this_ninds = 3;
+		if (face_count >= 0)
+			this_ninds = face_ninds(p + face_count, count_len,
+						need_swap);
+		p += face_idx;
+		if (size_t(end - p) < 4 * size_t(this_ninds) + face_skip)
+			return false;
+		thisface.resize(this_ninds);
+		if (this_ninds)
+			memcpy(&thisface[0], p, 4 * this_ninds);
+		p += 4 * this_ninds + face_skip;
+		if (need_swap) {
+			for (size_t j = 0; j < thisface.size(); j++)
+				swap_int(thisface[j]);
+		}
+		tess(mesh->vertices, thisface, mesh->faces);
+	}
+
+	return true;
+}
+
+
 // Read a bunch of faces from an ASCII file
-static bool read_faces_asc(FILE *f, TriMesh *mesh, int nfaces,
-	int face_len, int face_count, int face_idx, bool read_to_eol /* = false */)
+static bool read_faces_asc(FILE *f, TriMesh *mesh, index_t nfaces,
+	int face_len, int face_count, int face_idx, bool read_to_eol /* = false */,
+	bool continuation /* = false */)
 {
 	if (nfaces < 0 || face_idx < 0)
 		return false;
@@ -1111,28 +2092,30 @@ static bool read_faces_asc(FILE *f, TriMesh *mesh, int nfaces,
 	if (nfaces == 0)
 		return true;
 
-	int old_nfaces = mesh->faces.size();
-	int new_nfaces = old_nfaces + nfaces;
+	index_t old_nfaces = mesh->faces.size();
+	index_t new_nfaces = old_nfaces + nfaces;
 	mesh->faces.reserve(new_nfaces);
 
 	char buf[1024];
 	skip_comments(f);
-	dprintf("\n  Reading %d faces... ", nfaces);
+	if (!continuation)
+		dprintf("\n  Reading %lld faces... ", (long long) nfaces);
 	std::vector<int> thisface;
-	for (int i = 0; i < nfaces; i++) {
+	for (index_t i = 0; i < nfaces; i++) {
 		thisface.clear();
 		int this_face_count = 3;
 		for (int j = 0; j < face_len + this_face_count; j++) {
 			if (j >= face_idx && j < face_idx + this_face_count) {
 				thisface.push_back(0);
 				if (!fscanf(f, " %d", &(thisface.back()))) {
-					dprintf("Couldn't read vertex index %d for face %d\n",
-						j - face_idx, i);
+					dprintf("Couldn't read vertex index %d for face %lld\n",
+						j - face_idx, (long long) i);
 					return false;
 				}
 			} else if (j == face_count) {
 				if (!fscanf(f, " %d", &this_face_count)) {
-					dprintf("Couldn't read vertex count for face %d\n", i);
+					dprintf("Couldn't read vertex count for face %lld\n",
+						(long long) i);
 					return false;
 				}
 			} else {
@@ -1153,6 +2136,470 @@ static bool read_faces_asc(FILE *f, TriMesh *mesh, int nfaces,
 }
 
 
+// Parallel parsing of ASCII files.  The text is split at line boundaries
+// into chunks of a few MB, which are parsed independently and then
+// stitched back together in order.  Only files with one record per line
+// are handled: anything else is reported as failure, and the caller falls
+// back on the stdio-based readers above.
+
+#define ASC_CHUNK_SIZE (4 << 20)
+
+// A block of text split into chunks.  Chunk i is [start[i], start[i+1]),
+// and contains lines line[i] through line[i+1]-1 of the text.
+struct AscChunks {
+	std::vector<const char *> start;
+	std::vector<size_t> line;
+	int size() const
+		{ return int(start.size()) - 1; }
+	size_t nlines() const
+		{ return line.back(); }
+};
+
+
+// End of the line beginning at p (i.e., the newline, or end)
+static inline const char *line_end(const char *p, const char *end)
+{
+	if (p >= end)
+		return end;
+	const char *eol = (const char *) memchr(p, '\n', size_t(end - p));
+	return eol ? eol : end;
+}
+
+
+// Beginning of the line after the one containing p
+static inline const char *next_line(const char *p, const char *end)
+{
+	const char *eol = line_end(p, end);
+	return (eol == end) ? end : eol + 1;
+}
+
+
+// Is there nothing but white space left in [p, end)?
+static inline bool at_eol(const char *p, const char *end)
+{
+	while (p < end && is_space(*p))
+		p++;
+	return p == end;
+}
+
+
+// Skip over one white-space-delimited word, like fscanf("%s")
+static inline bool skip_word(const char *&p, const char *end)
+{
+	while (p < end && is_space(*p))
+		p++;
+	if (p == end)
+		return false;
+	while (p < end && !is_space(*p))
+		p++;
+	return true;
+}
+
+
+// Split [p, end) into chunks, and count the lines in each
+static void split_lines(const char *p, const char *end, AscChunks &chunks)
+{
+	chunks.start.clear();
+	chunks.start.push_back(p);
+	while (size_t(end - chunks.start.back()) > ASC_CHUNK_SIZE) {
+		const char *q = chunks.start.back() + ASC_CHUNK_SIZE;
+		q = line_end(q, end);
+		if (end - q <= 1)
+			break;
+		chunks.start.push_back(q + 1);
+	}
+	chunks.start.push_back(end);
+
+	int n = chunks.size();
+	chunks.line.assign(n + 1, 0);
+#pragma omp parallel for
+	for (int i = 0; i < n; i++) {
+		size_t nlines = 0;
+		const char *q = chunks.start[i], *cend = chunks.start[i+1];
+		while (q < cend) {
+			q = next_line(q, cend);
+			nlines++;
+		}
+		chunks.line[i+1] = nlines;
+	}
+	for (int i = 0; i < n; i++)
+		chunks.line[i+1] += chunks.line[i];
+}
+
+
+// Find the beginning of line number l
+static const char *find_line(const AscChunks &chunks, size_t l)
+{
+	if (l >= chunks.nlines())
+		return chunks.start.back();
+	int i = int(std::upper_bound(chunks.line.begin(), chunks.line.end(), l) -
+		chunks.line.begin()) - 1;
+	const char *q = chunks.start[i], *cend = chunks.start[i+1];
+	for (size_t j = chunks.line[i]; j < l; j++)
+		q = next_line(q, cend);
+	return q;
+}
+
+
+// Append the faces found in each chunk to faces, in order, freeing the
+// per-chunk lists as we go
+static void append_chunks(std::vector<TriMesh::Face> &faces,
+	std::vector< std::vector<TriMesh::Face> > &chunk_faces)
+{
+	int n = chunk_faces.size();
+	std::vector<size_t> offset(n + 1, faces.size());
+	for (int i = 0; i < n; i++)
+		offset[i+1] = offset[i] + chunk_faces[i].size();
+	faces.resize(offset[n]);
+#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < n; i++) {
+		std::copy(chunk_faces[i].begin(), chunk_faces[i].end(),
+			  faces.begin() + offset[i]);
+		std::vector<TriMesh::Face>().swap(chunk_faces[i]);
+	}
+}
+
+
+// Parse one vertex record from the line [p, end), storing it as vertex i.
+// Parameters are as in read_verts_asc.
+static bool parse_vert_asc(const char *p, const char *end, TriMesh *mesh,
+	index_t i, int vert_len, int vert_pos, int vert_norm,
+	int vert_color, bool float_color, int vert_conf)
+{
+	for (int j = 0; j < vert_len; j++) {
+		if (j == vert_pos) {
+			point &v = mesh->vertices[i];
+			if (!parse_float(p, end, v[0]) ||
+			    !parse_float(p, end, v[1]) ||
+			    !parse_float(p, end, v[2]))
+				return false;
+			j += 2;
+		} else if (j == vert_norm) {
+			vec &n = mesh->normals[i];
+			if (!parse_float(p, end, n[0]) ||
+			    !parse_float(p, end, n[1]) ||
+			    !parse_float(p, end, n[2]))
+				return false;
+			j += 2;
+		} else if (j == vert_color && float_color) {
+			float r, g, b;
+			if (!parse_float(p, end, r) ||
+			    !parse_float(p, end, g) ||
+			    !parse_float(p, end, b))
+				return false;
+			mesh->colors[i] = Color(r,g,b);
+			j += 2;
+		} else if (j == vert_color && !float_color) {
+			int r, g, b;
+			if (!parse_int(p, end, r) ||
+			    !parse_int(p, end, g) ||
+			    !parse_int(p, end, b))
+				return false;
+			mesh->colors[i] = Color(r,g,b);
+			j += 2;
+		} else if (j == vert_conf) {
+			if (!parse_float(p, end, mesh->confidences[i]))
+				return false;
+		} else if (!skip_word(p, end)) {
+			return false;
+		}
+	}
+	return at_eol(p, end);
+}
+
+
+// Read nverts vertices, one per line, from the text starting at p.
+// Parameters are as in read_verts_asc.  On success, advances p to the
+// line after the last vertex.
+static bool read_verts_asc_mapped(const char *&p, const char *end,
+	TriMesh *mesh, index_t nverts, int vert_len, int vert_pos,
+	int vert_norm, int vert_color, bool float_color, int vert_conf)
+{
+	if (nverts <= 0 || vert_len < 3 || vert_pos < 0)
+		return false;
+
+	p = skip_comments(p, end);
+	AscChunks chunks;
+	split_lines(p, end, chunks);
+	if (chunks.nlines() < size_t(nverts))
+		return false;
+
+	index_t old_nverts = mesh->vertices.size();
+	index_t new_nverts = old_nverts + nverts;
+	mesh->vertices.resize(new_nverts);
+	if (vert_norm > 0)
+		mesh->normals.resize(new_nverts);
+	if (vert_color > 0)
+		mesh->colors.resize(new_nverts);
+	if (vert_conf > 0)
+		mesh->confidences.resize(new_nverts);
+
+	dprintf("\n  Reading %lld vertices... ", (long long) nverts);
+	int nbad = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+ : nbad)
+	for (int i = 0; i < chunks.size(); i++) {
+		size_t last = std::min(chunks.line[i+1], size_t(nverts));
+		const char *q = chunks.start[i], *cend = chunks.start[i+1];
+		for (size_t j = chunks.line[i]; j < last; j++) {
+			const char *eol = line_end(q, cend);
+			if (!parse_vert_asc(q, eol, mesh, old_nverts + index_t(j),
+					vert_len, vert_pos, vert_norm,
+					vert_color, float_color, vert_conf)) {
+				nbad++;
+				break;
+			}
+			q = (eol == cend) ? cend : eol + 1;
+		}
+	}
+	if (nbad)
+		return false;
+
+	p = find_line(chunks, nverts);
+	return true;
+}
+
+
+// Parse one face record from the line [p, end) into thisface.
+// Parameters are as in read_faces_asc.
+static bool parse_face_asc(const char *p, const char *end,
+	int face_len, int face_count, int face_idx, bool read_to_eol,
+	std::vector<int> &thisface)
+{
+	thisface.clear();
+	int this_face_count = 3;
+	for (int j = 0; j < face_len + this_face_count; j++) {
+		if (j >= face_idx && j < face_idx + this_face_count) {
+			int ind;
+			if (!parse_int(p, end, ind))
+				return false;
+			thisface.push_back(ind);
+		} else if (j == face_count) {
+			if (!parse_int(p, end, this_face_count))
+				return false;
+		} else if (!skip_word(p, end)) {
+			return false;
+		}
+	}
+	return read_to_eol || at_eol(p, end);
+}
+
+
+// Read nfaces faces, one per line, from the text starting at p.
+// Parameters are as in read_faces_asc.  On success, advances p to the
+// line after the last face.
+static bool read_faces_asc_mapped(const char *&p, const char *end,
+	TriMesh *mesh, index_t nfaces, int face_len, int face_count,
+	int face_idx, bool read_to_eol /* = false */)
+{
+	if (nfaces < 0 || face_idx < 0)
+		return false;
+
+	if (nfaces == 0)
+		return true;
+
+	p = skip_comments(p, end);
+	AscChunks chunks;
+	split_lines(p, end, chunks);
+	if (chunks.nlines() < size_t(nfaces))
+		return false;
+
+	dprintf("\n  Reading %lld faces... ", (long long) nfaces);
+	int n = chunks.size();
+	std::vector< std::vector<TriMesh::Face> > chunk_faces(n);
+	int nbad = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+ : nbad)
+	for (int i = 0; i < n; i++) {
+		size_t last = std::min(chunks.line[i+1], size_t(nfaces));
+		const char *q = chunks.start[i], *cend = chunks.start[i+1];
+		std::vector<int> thisface;
+		for (size_t j = chunks.line[i]; j < last; j++) {
+			const char *eol = line_end(q, cend);
+			if (!parse_face_asc(q, eol, face_len, face_count,
+					face_idx, read_to_eol, thisface)) {
+				nbad++;
+				break;
+			}
+			tess(mesh->vertices, thisface, chunk_faces[i]);
+			q = (eol == cend) ? cend : eol + 1;
+		}
+	}
+	if (nbad)
+		return false;
+
+	append_chunks(mesh->faces, chunk_faces);
+	p = find_line(chunks, nfaces);
+	return true;
+}
+
+
+// Kinds of lines in an obj file that we care about
+enum { OBJ_OTHER, OBJ_VERT, OBJ_NORM, OBJ_FACE };
+
+// Classify a line of an obj file, given its first non-blank character
+static inline int obj_line_type(const char *p, const char *end)
+{
+	if (end - p < 2)
+		return OBJ_OTHER;
+	char c = *p | 0x20;
+	if (c == 'v') {
+		if (p[1] == ' ' || p[1] == '\t')
+			return OBJ_VERT;
+		if ((p[1] | 0x20) == 'n' && end - p >= 3 &&
+		    (p[2] == ' ' || p[2] == '\t'))
+			return OBJ_NORM;
+	} else if (c == 'f' || c == 't') {
+		if (p[1] == ' ' || p[1] == '\t')
+			return OBJ_FACE;
+	}
+	return OBJ_OTHER;
+}
+
+
+// Parse one chunk of an obj file.  Vertices and normals go directly into
+// the mesh, starting at vbase and nbase.  Triangles go into tris, while
+// bigger polygons get placeholder triangles, to be filled in by tess()
+// once all the vertices are known.  Each such polygon is recorded in polys
+// as the position of its placeholders, the number of indices, and the
+// indices themselves.
+static bool parse_obj_chunk(const char *p, const char *end, TriMesh *mesh,
+	size_t vbase, size_t nbase,
+	std::vector<TriMesh::Face> &tris, std::vector<int> &polys)
+{
+	std::vector<int> thisface;
+	size_t nv = vbase, nn = nbase;
+	while (p < end) {
+		const char *eol = line_end(p, end);
+		while (p < eol && is_space(*p))
+			p++;
+		switch (obj_line_type(p, eol)) {
+		case OBJ_VERT: {
+			point &v = mesh->vertices[nv++];
+			p++;
+			if (!parse_float(p, eol, v[0]) ||
+			    !parse_float(p, eol, v[1]) ||
+			    !parse_float(p, eol, v[2]))
+				return false;
+			break;
+		}
+		case OBJ_NORM: {
+			vec &n = mesh->normals[nn++];
+			p += 2;
+			if (!parse_float(p, eol, n[0]) ||
+			    !parse_float(p, eol, n[1]) ||
+			    !parse_float(p, eol, n[2]))
+				return false;
+			break;
+		}
+		case OBJ_FACE: {
+			thisface.clear();
+			p++;
+			int thisf;
+			while (parse_int(p, eol, thisf)) {
+				if (thisf < 0)
+					thisf += int(nv);
+				else
+					thisf--;
+				thisface.push_back(thisf);
+				// Skip texture coordinate and normal indices
+				while (p < eol && !is_space(*p))
+					p++;
+			}
+			size_t ninds = thisface.size();
+			if (ninds == 3) {
+				tris.push_back(TriMesh::Face(thisface[0],
+							     thisface[1],
+							     thisface[2]));
+			} else if (ninds > 3) {
+				polys.push_back(int(tris.size()));
+				polys.push_back(int(ninds));
+				polys.insert(polys.end(), thisface.begin(),
+					     thisface.end());
+				tris.resize(tris.size() + ninds - 2);
+			}
+			break;
+		}
+		}
+		p = (eol == end) ? end : eol + 1;
+	}
+	return true;
+}
+
+
+// Tesselate the polygons set aside by parse_obj_chunk
+static void tess_polys(const std::vector<point> &verts,
+	const std::vector<int> &polys, std::vector<TriMesh::Face> &tris)
+{
+	std::vector<int> thisface;
+	std::vector<TriMesh::Face> thistris;
+	for (size_t i = 0; i < polys.size(); i += 2 + polys[i+1]) {
+		const int *inds = &polys[i+2];
+		thisface.assign(inds, inds + polys[i+1]);
+		thistris.clear();
+		tess(verts, thisface, thistris);
+		std::copy(thistris.begin(), thistris.end(),
+			  tris.begin() + polys[i]);
+	}
+}
+
+
+// Read an obj file out of memory.  One pass over the text counts the
+// vertices and normals in each chunk, so that a second pass can parse all
+// the chunks in parallel: each knows where its vertices go, and how to
+// resolve relative (negative) indices.
+static bool read_obj_mapped(const char *p, const char *end, TriMesh *mesh)
+{
+	AscChunks chunks;
+	split_lines(p, end, chunks);
+	int n = chunks.size();
+
+	std::vector<size_t> vbase(n + 1), nbase(n + 1);
+#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < n; i++) {
+		size_t nv = 0, nn = 0;
+		const char *q = chunks.start[i], *cend = chunks.start[i+1];
+		while (q < cend) {
+			const char *eol = line_end(q, cend);
+			while (q < eol && is_space(*q))
+				q++;
+			int type = obj_line_type(q, eol);
+			if (type == OBJ_VERT)
+				nv++;
+			else if (type == OBJ_NORM)
+				nn++;
+			q = (eol == cend) ? cend : eol + 1;
+		}
+		vbase[i+1] = nv;
+		nbase[i+1] = nn;
+	}
+	for (int i = 0; i < n; i++) {
+		vbase[i+1] += vbase[i];
+		nbase[i+1] += nbase[i];
+	}
+	mesh->vertices.resize(vbase[n]);
+	mesh->normals.resize(nbase[n]);
+
+	std::vector< std::vector<TriMesh::Face> > chunk_faces(n);
+	std::vector< std::vector<int> > polys(n);
+	int nbad = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+ : nbad)
+	for (int i = 0; i < n; i++) {
+		if (!parse_obj_chunk(chunks.start[i], chunks.start[i+1], mesh,
+				     vbase[i], nbase[i],
+				     chunk_faces[i], polys[i]))
+			nbad++;
+	}
+	if (nbad)
+		return false;
+
+#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < n; i++)
+		tess_polys(mesh->vertices, polys[i], chunk_faces[i]);
+
+	append_chunks(mesh->faces, chunk_faces);
+	return true;
+}
+
+
 // Read triangle strips from a binary file
 static bool read_strips_bin(FILE *f, TriMesh *mesh, bool need_swap)
 {
@@ -1320,8 +2767,8 @@ static void check_ind_range(TriMesh *mesh)
 {
 	if (mesh->faces.empty())
 		return;
-	int min_ind = mesh->faces[0][0];
-	int max_ind = mesh->faces[0][0];
+	index_t min_ind = mesh->faces[0][0];
+	index_t max_ind = mesh->faces[0][0];
 	for (size_t i = 0; i < mesh->faces.size(); i++) {
 		for (int j = 0; j < 3; j++) {
 			min_ind = std::min(min_ind, mesh->faces[i][j]);
@@ -1329,7 +2776,7 @@ static void check_ind_range(TriMesh *mesh)
 		}
 	}
 
-	int nv = mesh->vertices.size();
+	index_t nv = mesh->vertices.size();
 
 	// All good
 	if (min_ind == 0 && max_ind == nv-1)
@@ -1337,9 +2784,9 @@ static void check_ind_range(TriMesh *mesh)
 
 	// Simple fix: offset everything
 	if (max_ind - min_ind == nv-1) {
-		dprintf("Found indices ranging from %d through %d\n",
-				 min_ind, max_ind);
-		dprintf("Remapping to %d through %d\n", 0, nv-1);
+		dprintf("Found indices ranging from %lld through %lld\n",
+			(long long) min_ind, (long long) max_ind);
+		dprintf("Remapping to 0 through %lld\n", (long long) nv - 1);
 		for (size_t i = 0; i < mesh->faces.size(); i++)
 			for (int j = 0; j < 3; j++)
 				mesh->faces[i][j] -= min_ind;
@@ -1368,47 +2815,1984 @@ static void skip_comments(FILE *f)
 			break;
 		}
 	}
-	ungetc(c, f);
-}
+	ungetc(c, f);
+}
+
+
+// Skip comments in ASCII text in memory
+static const char *skip_comments(const char *p, const char *end)
+{
+	while (p < end) {
+		if (*p == '#')
+			p = line_end(p, end);
+		else if (!is_space(*p))
+			break;
+		if (p < end)
+			p++;
+	}
+	return p;
+}
+
+
+// Map the rest of the file underlying an ASCII stream into memory, from
+// the current position of the stream to the end
+static bool map_text(FILE *f, MappedFile &map,
+	const char *&p, const char *&end)
+{
+	if (!map.open(f))
+		return false;
+	long long pos = ftell64(f);
+	if (pos < 0 || pos > (long long) map.size())
+		return false;
+	p = (const char *) map.data() + pos;
+	end = (const char *) map.data() + map.size();
+	return true;
+}
+
+
+// Throw away whatever vertices and faces a failed read left behind
+static void clear_elements(TriMesh *mesh)
+{
+	mesh->vertices.clear();
+	mesh->normals.clear();
+	mesh->colors.clear();
+	mesh->confidences.clear();
+	mesh->faces.clear();
+}
+
+
+// Atomic compare-and-swap on an int.  Returns the previous value.
+static inline int atomic_cas(int *p, int oldval, int newval)
+{
+#ifdef _MSC_VER
+	return _InterlockedCompareExchange((volatile long *) p, newval, oldval);
+#else
+	return __sync_val_compare_and_swap(p, oldval, newval);
+#endif
+}
+
+
+// What welding compares: the position itself (with -0 == 0), or, if
+// eps > 0, the cell containing it in a grid of spacing eps
+struct WeldKey {
+	long long k[3];
+
+	WeldKey(const point &p, float eps)
+	{
+		for (int i = 0; i < 3; i++) {
+			double c = eps > 0.0f ? std::floor(p[i] / (double) eps) : 0.0;
+			if (eps > 0.0f && std::fabs(c) < 1.0e18) {
+				k[i] = (long long) c;
+			} else {
+				float x = (p[i] == 0.0f) ? 0.0f : p[i];
+				unsigned u;
+				memcpy(&u, &x, 4);
+				k[i] = (1ll << 62) + u;
+			}
+		}
+	}
+	bool operator == (const WeldKey &o) const
+		{ return k[0] == o.k[0] && k[1] == o.k[1] && k[2] == o.k[2]; }
+	size_t hash() const
+	{
+		unsigned long long h = k[0] * 0x9e3779b97f4a7c15ull;
+		h = (h ^ (h >> 29) ^ (unsigned long long) k[1]) * 0xbf58476d1ce4e5b9ull;
+		h = (h ^ (h >> 31) ^ (unsigned long long) k[2]) * 0x94d049bb133111ebull;
+		return (size_t) (h ^ (h >> 32));
+	}
+};
+
+
+// Merge points with equal WeldKeys.  Points are entered in parallel into
+// an open-addressed hash table, each slot of which ends up holding the
+// lowest-numbered point of its group.  On return, remap[i] is the new index
+// of point i, and kept lists the first point of each group, in order.
+template <class Points, class Index>
+static void weld_points(const Points &pts, int n, float eps, Index *remap,
+	std::vector<int> &kept)
+{
+	size_t size = 64;
+	while (size < (size_t) n + n / 2)
+		size *= 2;
+	const size_t mask = size - 1;
+	std::vector<int> table(size, -1);
+
+#pragma omp parallel for
+	for (int i = 0; i < n; i++) {
+		WeldKey key(pts[i], eps);
+		size_t h = key.hash() & mask;
+		while (1) {
+			int s = table[h];
+			if (s < 0 && (s = atomic_cas(&table[h], -1, i)) < 0)
+				break;
+			if (WeldKey(pts[s], eps) == key) {
+				while (i < s) {
+					int t = atomic_cas(&table[h], s, i);
+					if (t == s)
+						break;
+					s = t;
+				}
+				break;
+			}
+			h = (h + 1) & mask;
+		}
+	}
+
+#pragma omp parallel for
+	for (int i = 0; i < n; i++) {
+		WeldKey key(pts[i], eps);
+		size_t h = key.hash() & mask;
+		while (!(WeldKey(pts[table[h]], eps) == key))
+			h = (h + 1) & mask;
+		remap[i] = table[h];
+	}
+
+	kept.clear();
+	for (int i = 0; i < n; i++) {
+		if (remap[i] == i) {
+			remap[i] = kept.size();
+			kept.push_back(i);
+		} else {
+			remap[i] = remap[remap[i]];
+		}
+	}
+}
+
+
+// Keep only the given elements of a per-vertex array
+template <class T>
+static void weld_compact(SharedArray<T> &v, const std::vector<int> &kept,
+	size_t nverts)
+{
+	if (v.size() != nverts)
+		return;
+	int n = kept.size();
+	std::vector<T> w(n);
+#pragma omp parallel for
+	for (int i = 0; i < n; i++)
+		w[i] = v[kept[i]];
+	v.swap(w);
+}
+
+
+// Keep only the given vertices' values of a channel
+static void weld_compact(TriMesh::Channel &c, const std::vector<int> &kept,
+	size_t nverts)
+{
+	int ncomp = c.ncomp;
+	if (c.values.size() != ncomp * nverts)
+		return;
+	int n = kept.size();
+	std::vector<float> w(size_t(n) * ncomp);
+	const SharedArray<float> &v = c.values;
+#pragma omp parallel for
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < ncomp; j++)
+			w[size_t(i) * ncomp + j] = v[size_t(kept[i]) * ncomp + j];
+	c.values.swap(w);
+}
+
+
+// Merge vertices of a mesh that was read in as a whole
+static void weld_mesh(TriMesh *mesh, float eps)
+{
+	int nv = mesh->vertices.size();
+	std::vector<int> remap(nv), kept;
+	dprintf("\n  Welding %d vertices... ", nv);
+	weld_points(mesh->vertices, nv, eps, &remap[0], kept);
+	dprintf("%d left. ", (int) kept.size());
+	if ((int) kept.size() == nv)
+		return;
+
+	weld_compact(mesh->vertices, kept, nv);
+	weld_compact(mesh->normals, kept, nv);
+	weld_compact(mesh->colors, kept, nv);
+	weld_compact(mesh->confidences, kept, nv);
+	weld_compact(mesh->flags, kept, nv);
+	for (size_t i = 0; i < mesh->channels.size(); i++)
+		weld_compact(mesh->channels[i], kept, nv);
+
+	int nf = mesh->faces.size();
+#pragma omp parallel for
+	for (int i = 0; i < nf; i++) {
+		for (int j = 0; j < 3; j++) {
+			index_t &ind = mesh->faces[i][j];
+			if (ind >= 0 && ind < nv)
+				ind = remap[ind];
+		}
+	}
+	for (size_t i = 0; i < mesh->tstrips.size(); i++) {
+		int &ind = mesh->tstrips[i];
+		if (ind >= 0 && ind < nv)
+			ind = remap[ind];
+	}
+	for (size_t i = 0; i < mesh->grid.size(); i++) {
+		int &ind = mesh->grid[i];
+		if (ind >= 0 && ind < nv)
+			ind = remap[ind];
+	}
+}
+
+
+// The vertices of binary STL facets, as an array of points
+struct StlPoints {
+	const unsigned char *data;
+	bool need_swap;
+
+	StlPoints(const unsigned char *data_, bool need_swap_) :
+		data(data_), need_swap(need_swap_)
+		{}
+	point operator [] (int i) const
+	{
+		float p[3];
+		memcpy(p, data + 50 * (i / 3) + 12 + 12 * (i % 3), 12);
+		if (need_swap) {
+			swap_float(p[0]);
+			swap_float(p[1]);
+			swap_float(p[2]);
+		}
+		return point(p[0], p[1], p[2]);
+	}
+};
+
+
+// Read all of the rest of a stream into memory
+static bool slurp(FILE *f, std::vector<char> &buf)
+{
+	char tmp[65536];
+	size_t n;
+	while ((n = fread(tmp, 1, sizeof(tmp), f)) > 0)
+		buf.insert(buf.end(), tmp, tmp + n);
+	return !ferror(f);
+}
+
+
+// Parse an ASCII STL file.  Each facet's "outer loop" becomes a triangle
+// (or a fan of triangles, if it has more than 3 vertices).
+static bool read_stl_asc(const char *p, const char *end, TriMesh *mesh)
+{
+	AscChunks chunks;
+	split_lines(p, end, chunks);
+	int n = chunks.size();
+
+	// For each chunk: its vertices, and the number of vertices seen
+	// at each "endloop"
+	std::vector< std::vector<point> > chunk_verts(n);
+	std::vector< std::vector<int> > chunk_loops(n);
+	int nbad = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+ : nbad)
+	for (int i = 0; i < n; i++) {
+		const char *q = chunks.start[i], *cend = chunks.start[i+1];
+		while (q < cend) {
+			const char *eol = line_end(q, cend);
+			while (q < eol && is_space(*q))
+				q++;
+			if (eol - q > 6 && begins_with(q, "vertex") &&
+			    is_space(q[6])) {
+				q += 6;
+				point v;
+				if (parse_float(q, eol, v[0]) &&
+				    parse_float(q, eol, v[1]) &&
+				    parse_float(q, eol, v[2]))
+					chunk_verts[i].push_back(v);
+				else
+					nbad++;
+			} else if (eol - q >= 7 && begins_with(q, "endloop")) {
+				chunk_loops[i].push_back(chunk_verts[i].size());
+			}
+			q = (eol == cend) ? cend : eol + 1;
+		}
+	}
+	if (nbad) {
+		eprintf("Couldn't parse %d vertices.\n", nbad);
+		return false;
+	}
+
+	// A loop can straddle chunks: it starts wherever the previous
+	// "endloop" in the file was.
+	std::vector<int> vbase(n + 1, 0), fbase(n + 1, 0), lstart(n);
+	int last = 0;
+	for (int i = 0; i < n; i++) {
+		vbase[i+1] = vbase[i] + chunk_verts[i].size();
+		lstart[i] = last;
+		int nf = 0;
+		for (size_t j = 0; j < chunk_loops[i].size(); j++) {
+			int loop_end = vbase[i] + chunk_loops[i][j];
+			nf += std::max(loop_end - last - 2, 0);
+			last = loop_end;
+		}
+		fbase[i+1] = fbase[i] + nf;
+	}
+	mesh->vertices.resize(vbase[n]);
+	mesh->faces.resize(fbase[n]);
+
+#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < n; i++) {
+		std::copy(chunk_verts[i].begin(), chunk_verts[i].end(),
+			  mesh->vertices.begin() + vbase[i]);
+		int start = lstart[i], f = fbase[i];
+		for (size_t j = 0; j < chunk_loops[i].size(); j++) {
+			int loop_end = vbase[i] + chunk_loops[i][j];
+			for (int k = start + 2; k < loop_end; k++)
+				mesh->faces[f++] = TriMesh::Face(start, k - 1, k);
+			start = loop_end;
+		}
+	}
+	return true;
+}
+
+
+// Read an STL file, binary or ASCII.  If weld_eps >= 0, merge vertices
+// (see WeldKey) as they are read, instead of making 3 per facet.
+static bool read_stl(FILE *f, TriMesh *mesh, float weld_eps)
+{
+	bool need_swap = !we_are_little_endian();
+
+	char header[84];
+	COND_READ(true, header, 84);
+	int nfacets;
+	memcpy(&nfacets, header + 80, 4);
+	if (need_swap)
+		swap_int(nfacets);
+
+	// Files on disk get read straight out of a memory map
+	MappedFile map;
+	long long start = ftell64(f) - 84;
+	if (start < 0 || !map.open(f))
+		map.close();
+	long long avail = map.valid() ? map.size() - start - 84 : -1;
+
+	// ASCII STL begins with "solid" - but so do some binary files.
+	// Believe the facet count if the file size agrees with it.
+	bool ascii = false;
+	if (begins_with(header, "solid")) {
+		if (avail >= 0) {
+			ascii = (avail != 50ll * nfacets);
+		} else {
+			for (int i = 5; i <= 84 - 8 && !ascii; i++)
+				ascii = !strncmp(header + i, "facet", 5) ||
+					!strncmp(header + i, "endsolid", 8);
+		}
+	}
+
+	if (ascii) {
+		dprintf("\n  Reading ASCII STL... ");
+		bool ok;
+		if (map.valid()) {
+			const char *p = (const char *) map.data() + start;
+			ok = read_stl_asc(p, p + (map.size() - start), mesh);
+		} else {
+			std::vector<char> text(header, header + 84);
+			if (!slurp(f, text))
+				return false;
+			ok = read_stl_asc(&text[0], &text[0] + text.size(), mesh);
+		}
+		if (ok && weld_eps >= 0.0f && !mesh->vertices.empty())
+			weld_mesh(mesh, weld_eps);
+		return ok;
+	}
+
+	if (nfacets <= 0 || nfacets > INT_MAX / 3)
+		return false;
+	const unsigned char *data;
+	std::vector<unsigned char> buf;
+	if (map.valid()) {
+		if (avail < 50ll * nfacets)
+			return false;
+		data = map.data() + start + 84;
+	} else {
+		buf.resize(50 * (size_t) nfacets);
+		COND_READ(true, buf[0], buf.size());
+		data = &buf[0];
+	}
+	StlPoints pts(data, need_swap);
+	int nverts = 3 * nfacets;
+
+	mesh->faces.resize(nfacets);
+	if (weld_eps < 0.0f) {
+		mesh->vertices.resize(nverts);
+#pragma omp parallel for
+		for (int i = 0; i < nverts; i++)
+			mesh->vertices[i] = pts[i];
+#pragma omp parallel for
+		for (int i = 0; i < nfacets; i++)
+			mesh->faces[i] = TriMesh::Face(3*i, 3*i+1, 3*i+2);
+		return true;
+	}
+
+	dprintf("\n  Welding %d vertices... ", nverts);
+	std::vector<int> kept;
+	weld_points(pts, nverts, weld_eps, &mesh->faces[0][0], kept);
+	dprintf("%d left. ", (int) kept.size());
+	int nkept = kept.size();
+	mesh->vertices.resize(nkept);
+#pragma omp parallel for
+	for (int i = 0; i < nkept; i++)
+		mesh->vertices[i] = pts[kept[i]];
+	return true;
+}
+
+
+// Skip n lines of ASCII text, not counting blank lines and comments
+static const char *skip_lines(const char *p, const char *end, int n)
+{
+	for (int i = 0; i < n && p < end; i++)
+		p = next_line(skip_comments(p, end), end);
+	return p;
+}
+
+
+// Count the triangles that n polygons, one per line starting at p, will
+// be split into.  Each line begins with the number of vertices.
+static int count_tris_asc(const char *p, const char *end, int n)
+{
+	int ntris = 0;
+	for (int i = 0; i < n; i++) {
+		p = skip_comments(p, end);
+		int ninds;
+		if (!parse_int(p, end, ninds))
+			return -1;
+		ntris += std::max(ninds - 2, 0);
+		p = next_line(p, end);
+	}
+	return ntris;
+}
+
+
+// Probe a ply file, positioned just after "ply"
+static bool probe_ply(FILE *f, TriMesh::FileInfo &info)
+{
+	TriMesh dummy;
+	PlyHeader h;
+	if (!read_ply_header(f, &dummy, h))
+		return false;
+
+	info.format = "ply";
+	info.binary = h.binary;
+	info.big_endian = h.binary && (h.need_swap == we_are_little_endian());
+	info.nverts = h.nverts;
+	info.nfaces = h.nfaces;
+	info.has_normals = (h.vert_norm >= 0);
+	info.has_colors = (h.vert_color >= 0);
+	info.has_confidences = (h.vert_conf >= 0);
+	info.has_tstrips = (h.nstrips > 0);
+	info.has_grid = (h.ngrid > 0);
+	if (info.has_grid) {
+		info.grid_width = dummy.grid_width;
+		info.grid_height = dummy.grid_height;
+	}
+	if (info.has_tstrips || info.has_grid)
+		return true;
+	if (h.face_count < 0) {
+		info.ntris = h.nfaces;
+		return true;
+	}
+
+	long long start = ftell64(f);
+	if (h.binary) {
+		// If the file is exactly as long as it would be with nothing
+		// but triangles, believe that that's what it has
+		long long tri_size = start + h.skip1 +
+			(long long) h.nverts * h.vert_len + h.skip2 +
+			(long long) h.nfaces * (h.face_len + 12);
+		if (start >= 0 && fseek64(f, 0, SEEK_END) == 0 &&
+		    ftell64(f) == tri_size)
+			info.ntris = h.nfaces;
+		return true;
+	}
+
+	// ASCII files with nothing but vertices and faces, with the count
+	// first on each line, can be scanned for the face sizes
+	MappedFile map;
+	const char *p, *end;
+	if (h.skip1 || h.skip2 || h.face_count != 0 ||
+	    !map_text(f, map, p, end))
+		return true;
+	p = skip_lines(p, end, h.nverts);
+	info.ntris = count_tris_asc(p, end, h.nfaces);
+	return true;
+}
+
+
+// Probe an off file in memory, after the "OFF" or "COFF"
+static bool probe_off(const char *p, const char *end, bool iscolor,
+	TriMesh::FileInfo &info)
+{
+	p = skip_comments(p, end);
+	if (p >= end)
+		return false;
+	const char *eol = line_end(p, end);
+	if (!parse_int(p, eol, info.nverts) || !parse_int(p, eol, info.nfaces))
+		return false;
+	info.format = "off";
+	info.has_colors = iscolor;
+	p = skip_lines(next_line(p, end), end, info.nverts);
+	info.ntris = count_tris_asc(p, end, info.nfaces);
+	return true;
+}
+
+
+// Probe an sm file in memory.  The number of faces comes after the
+// vertices, which have to be skipped over to get to it.
+static bool probe_sm(const char *p, const char *end, TriMesh::FileInfo &info)
+{
+	if (!parse_int(p, end, info.nverts))
+		return false;
+	info.format = "sm";
+	p = skip_lines(next_line(p, end), end, info.nverts);
+	p = skip_comments(p, end);
+	if (!parse_int(p, end, info.nfaces))
+		info.nfaces = 0;
+	info.ntris = info.nfaces;
+	return true;
+}
+
+
+// Probe an STL file.  Binary files have a count of facets in the header,
+// while ASCII ones get scanned for vertices and ends of loops.
+static bool probe_stl(FILE *f, TriMesh::FileInfo &info)
+{
+	char header[84];
+	if (!fread(header, 84, 1, f))
+		return false;
+	int nfacets;
+	memcpy(&nfacets, header + 80, 4);
+	if (!we_are_little_endian())
+		swap_int(nfacets);
+
+	MappedFile map;
+	map.open(f);
+	info.format = "stl";
+
+	bool ascii = false;
+	if (begins_with(header, "solid")) {
+		if (map.valid()) {
+			ascii = (map.size() != 84 + 50ull * nfacets);
+		} else {
+			for (int i = 5; i <= 84 - 8 && !ascii; i++)
+				ascii = !strncmp(header + i, "facet", 5) ||
+					!strncmp(header + i, "endsolid", 8);
+		}
+	}
+	if (!ascii) {
+		if (nfacets <= 0 || nfacets > INT_MAX / 3)
+			return false;
+		info.binary = true;
+		info.nverts = 3 * nfacets;
+		info.nfaces = info.ntris = nfacets;
+		return true;
+	}
+
+	if (!map.valid())
+		return false;
+	const char *p = (const char *) map.data();
+	const char *end = p + map.size();
+	int nverts = 0, loop_start = 0, nloops = 0, ntris = 0;
+	info.counted = true;
+	while (p < end) {
+		const char *eol = line_end(p, end);
+		while (p < eol && is_space(*p))
+			p++;
+		if (eol - p > 6 && begins_with(p, "vertex") && is_space(p[6])) {
+			nverts++;
+		} else if (eol - p >= 7 && begins_with(p, "endloop")) {
+			nloops++;
+			ntris += std::max(nverts - loop_start - 2, 0);
+			loop_start = nverts;
+		}
+		p = (eol == end) ? end : eol + 1;
+	}
+	info.nverts = nverts;
+	info.nfaces = nloops;
+	info.ntris = ntris;
+	return true;
+}
+
+
+// Count the vertices, normals, and faces of an obj file in memory.
+// Chunks of the file are scanned in parallel.
+static bool probe_obj(const char *p, const char *end, TriMesh::FileInfo &info)
+{
+	AscChunks chunks;
+	split_lines(p, end, chunks);
+	int n = chunks.size();
+	long long nverts = 0, nnorms = 0, nfaces = 0, ntris = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+ : nverts, nnorms, nfaces, ntris)
+	for (int i = 0; i < n; i++) {
+		const char *q = chunks.start[i], *cend = chunks.start[i+1];
+		while (q < cend) {
+			const char *eol = line_end(q, cend);
+			while (q < eol && is_space(*q))
+				q++;
+			switch (obj_line_type(q, eol)) {
+			case OBJ_VERT:
+				nverts++;
+				break;
+			case OBJ_NORM:
+				nnorms++;
+				break;
+			case OBJ_FACE: {
+				int ninds = 0, ind;
+				q++;
+				while (parse_int(q, eol, ind)) {
+					ninds++;
+					while (q < eol && !is_space(*q))
+						q++;
+				}
+				nfaces++;
+				ntris += std::max(ninds - 2, 0);
+				break;
+			}
+			}
+			q = (eol == cend) ? cend : eol + 1;
+		}
+	}
+	if (nverts > INT_MAX || nfaces > INT_MAX || ntris > INT_MAX)
+		return false;
+
+	info.format = "obj";
+	info.counted = true;
+	info.nverts = (int) nverts;
+	info.nfaces = (int) nfaces;
+	info.ntris = (int) ntris;
+	info.has_normals = (nnorms == nverts);
+	return true;
+}
+
+
+// Find out what's in a file without reading all of it.  Formats are
+// recognized as in read_helper.
+bool TriMesh::probe(const char *filename, FileInfo &info)
+{
+	info = FileInfo();
+	if (!filename || *filename == '\0' || !strcmp(filename, "-") ||
+	    begins_with(filename, "stl:") || begins_with(filename, "weld"))
+		return false;
+
+	FILE *f = fopen(filename, "rb");
+	if (!f) {
+		eprintf("Error opening [%s] for reading: %s.\n", filename,
+			strerror(errno));
+		return false;
+	}
+
+	bool ok = false;
+	MappedFile map;
+	char buf[1024];
+	if (ends_with(filename, ".stl")) {
+		ok = probe_stl(f, info);
+	} else if (fread(buf, 4, 1, f) != 1) {
+		ok = false;
+	} else if (!strncmp(buf, "ply", 3) && is_space(buf[3])) {
+		fseek64(f, 3, SEEK_SET);
+		ok = probe_ply(f, info);
+	} else if (map.open(f)) {
+		const char *p = (const char *) map.data();
+		const char *end = p + map.size();
+		if (!strncmp(buf, "OFF", 3)) {
+			ok = probe_off(p + 3, end, false, info);
+		} else if (!strncmp(buf, "COFF", 4)) {
+			ok = probe_off(p + 4, end, true, info);
+		} else if (is_digit(*p)) {
+			ok = probe_sm(p, end, info);
+		} else if (*p == '#') {
+			// Unless it's a ray file, which read_helper recognizes
+			// by the first word after the #
+			const char *word = p + 1, *q = p + 1;
+			skip_word(q, end);
+			while (word < q && is_space(*word))
+				word++;
+			size_t len = std::min(size_t(q - word), sizeof(buf) - 1);
+			memcpy(buf, word, len);
+			buf[len] = '\0';
+			if (!LINE_IS("material") && !LINE_IS("vertex") &&
+			    !LINE_IS("shape_"))
+				ok = probe_obj(p, end, info);
+		} else if (*p == 'v' || *p == 'u' || *p == 'f' ||
+			   *p == 'g' || *p == 's' || *p == 'o') {
+			ok = probe_obj(p, end, info);
+		}
+	}
+
+	// As in read_helper, a file without vertices doesn't count
+	fclose(f);
+	return ok && info.nverts > 0;
+}
+
+
+// Tesselate an arbitrary n-gon.  Appends triangles to "tris".
+static void tess(const std::vector<point> &verts, const std::vector<int> &thisface,
+		 std::vector<TriMesh::Face> &tris)
+{
+	if (thisface.size() < 3)
+		return;
+	if (thisface.size() == 3) {
+		tris.push_back(TriMesh::Face(thisface[0],
+					     thisface[1],
+					     thisface[2]));
+		return;
+	}
+	bool inds_ok = true;
+	for (size_t i = 0; i < thisface.size(); i++)
+		if (thisface[i] < 0 || thisface[i] >= (int) verts.size())
+			inds_ok = false;
+	if (thisface.size() == 4 && inds_ok) {
+		// Triangulate in the direction that
+		// gives the shorter diagonal
+		const point &p0 = verts[thisface[0]], &p1 = verts[thisface[1]];
+		const point &p2 = verts[thisface[2]], &p3 = verts[thisface[3]];
+		float d02 = dist2(p0, p2);
+		float d13 = dist2(p1, p3);
+		int i = (d02 < d13) ? 0 : 1;
+		tris.push_back(TriMesh::Face(thisface[i],
+					     thisface[(i+1)%4],
+					     thisface[(i+2)%4]));
+		tris.push_back(TriMesh::Face(thisface[i],
+					     thisface[(i+2)%4],
+					     thisface[(i+3)%4]));
+		return;
+	}
+
+	// 5-gon or higher - just tesselate arbitrarily...
+	for (size_t i = 2; i < thisface.size(); i++)
+		tris.push_back(TriMesh::Face(thisface[0],
+					     thisface[i-1],
+					     thisface[i]));
+}
+
+
+// The tmc format.  A 64-byte TmcHeader is followed by a table of
+// TmcSections, then by the sections themselves.  Each section is a raw
+// array in native byte order, starting at a multiple of 64 bytes, so the
+// whole thing can be copied straight out of a memory map.  Lists of lists
+// (neighbors, adjacentfaces) are stored as an array of offsets followed
+// by the concatenated lists.  Readers skip sections they don't know about.
+#define TMC_VERSION 1
+#define TMC_BYTE_ORDER 0x01020304u
+#define TMC_ALIGN 64
+
+struct TmcHeader {
+	char magic[4];		// "TMC\0"
+	unsigned version;
+	unsigned byte_order;	// TMC_BYTE_ORDER, as seen by the writer
+	unsigned nsections;
+	long long source_size;	// For caches: the file this was made from
+	long long source_mtime;
+	int grid_width, grid_height;
+	unsigned flag_curr;
+	unsigned reserved[5];
+};
+
+struct TmcSection {
+	unsigned id;
+	unsigned elem_size;
+	unsigned long long count;
+	unsigned long long offset;	// From start of file
+	unsigned long long reserved;
+};
+
+enum {
+	TMC_VERTICES = 1, TMC_FACES, TMC_TSTRIPS, TMC_GRID,
+	TMC_COLORS, TMC_CONFIDENCES, TMC_FLAGS,
+	TMC_NORMALS, TMC_PDIR1, TMC_PDIR2, TMC_CURV1, TMC_CURV2,
+	TMC_DCURV, TMC_CORNERAREAS, TMC_POINTAREAS,
+	TMC_BBOX, TMC_BSPHERE,
+	TMC_NEIGHBORS_INDEX, TMC_NEIGHBORS,
+	TMC_ADJACENTFACES_INDEX, TMC_ADJACENTFACES,
+	TMC_ACROSS_EDGE, TMC_EDGELENGTHS, TMC_FACEAREAS
+};
+
+
+// Is this the header of a tmc file we can read?
+static bool tmc_header_ok(const TmcHeader &h)
+{
+	return !memcmp(h.magic, "TMC", 4) &&
+		h.version == TMC_VERSION &&
+		h.byte_order == TMC_BYTE_ORDER;
+}
+
+
+// Size and modification time of a file, for keying caches
+static bool file_stamp(const char *filename, long long &size,
+	long long &mtime)
+{
+	struct stat st;
+	if (stat(filename, &st) != 0)
+		return false;
+	size = (long long) st.st_size;
+	mtime = (long long) st.st_mtime;
+	return true;
+}
+
+
+// Pulls sections out of a tmc file: from a memory map if possible,
+// otherwise by reading through the stream (in which case sections must
+// be requested in order).
+struct TmcReader {
+	FILE *f;
+	MappedFile map;
+	long long base, pos;
+
+	bool read(const TmcSection &s, void *dst)
+	{
+		unsigned long long n = s.count * s.elem_size;
+		if (map.valid()) {
+			if (s.offset > map.size() - base ||
+			    n > map.size() - base - s.offset)
+				return false;
+			copy_mapped(dst, map.data() + base + s.offset, n);
+			return true;
+		}
+		if ((long long) s.offset < pos)
+			return false;
+		char buf[TMC_ALIGN];
+		while (pos < (long long) s.offset) {
+			size_t skip = std::min((long long) sizeof(buf),
+					       (long long) s.offset - pos);
+			if (fread(buf, skip, 1, f) != 1)
+				return false;
+			pos += skip;
+		}
+		if (n && fread(dst, n, 1, f) != 1)
+			return false;
+		pos += n;
+		return true;
+	}
+
+	template <class T, class A>
+	bool read(const TmcSection &s, std::vector<T, A> &v)
+	{
+		if (s.elem_size != sizeof(T))
+			return false;
+		v.resize(s.count);
+		return s.count ? read(s, &v[0]) : true;
+	}
+
+	template <class T, class A>
+	bool read(const TmcSection &s, SharedArray<T, A> &v)
+		{ return read(s, (std::vector<T, A> &) v); }
+
+	// Read a list of lists, given its index and data sections
+	bool read(const TmcSection &index, const TmcSection &data, AdjList &v)
+	{
+		std::vector<long long> offsets;
+		if (!read(index, offsets) || !read(data, v.items))
+			return false;
+		if (offsets.empty() || offsets[0] != 0 ||
+		    offsets.back() != (long long) v.items.size())
+			return false;
+		size_t n = offsets.size();
+		for (size_t i = 1; i < n; i++)
+			if (offsets[i] < offsets[i-1])
+				return false;
+		v.offsets.assign(offsets.begin(), offsets.end());
+		return true;
+	}
+};
+
+
+// Read a tmc file, after the magic number
+static bool read_tmc(FILE *f, TriMesh *mesh)
+{
+	TmcHeader h;
+	memcpy(h.magic, "TMC", 4);
+	if (fread(&h.version, sizeof(h) - 4, 1, f) != 1 || !tmc_header_ok(h)) {
+		eprintf("Not a tmc file, or unsupported version.\n");
+		return false;
+	}
+	std::vector<TmcSection> sections(h.nsections);
+	if (h.nsections &&
+	    fread(&sections[0], sizeof(TmcSection), h.nsections, f) !=
+	    h.nsections)
+		return false;
+
+	TmcReader r;
+	r.f = f;
+	r.pos = sizeof(h) + h.nsections * sizeof(TmcSection);
+	r.base = ftell64(f) - r.pos;
+	if (r.base < 0 || !r.map.open(f))
+		r.map.close();
+
+	mesh->grid_width = h.grid_width;
+	mesh->grid_height = h.grid_height;
+	mesh->flag_curr = h.flag_curr;
+
+	dprintf("\n  Reading %d sections... ", (int) h.nsections);
+	const TmcSection *neighbors_index = NULL;
+	const TmcSection *adjacentfaces_index = NULL;
+	for (size_t i = 0; i < sections.size(); i++) {
+		const TmcSection &s = sections[i];
+		bool ok = true;
+		switch (s.id) {
+		case TMC_VERTICES:
+			ok = r.read(s, mesh->vertices); break;
+		case TMC_FACES:
+			ok = r.read(s, mesh->faces); break;
+		case TMC_TSTRIPS:
+			ok = r.read(s, mesh->tstrips); break;
+		case TMC_GRID:
+			ok = r.read(s, mesh->grid); break;
+		case TMC_COLORS:
+			ok = r.read(s, mesh->colors); break;
+		case TMC_CONFIDENCES:
+			ok = r.read(s, mesh->confidences); break;
+		case TMC_FLAGS:
+			ok = r.read(s, mesh->flags); break;
+		case TMC_NORMALS:
+			ok = r.read(s, mesh->normals); break;
+		case TMC_PDIR1:
+			ok = r.read(s, mesh->pdir1); break;
+		case TMC_PDIR2:
+			ok = r.read(s, mesh->pdir2); break;
+		case TMC_CURV1:
+			ok = r.read(s, mesh->curv1); break;
+		case TMC_CURV2:
+			ok = r.read(s, mesh->curv2); break;
+		case TMC_DCURV:
+			ok = r.read(s, mesh->dcurv); break;
+		case TMC_CORNERAREAS:
+			ok = r.read(s, mesh->cornerareas); break;
+		case TMC_POINTAREAS:
+			ok = r.read(s, mesh->pointareas); break;
+		case TMC_ACROSS_EDGE:
+			ok = r.read(s, mesh->across_edge); break;
+		case TMC_FACEAREAS:
+			ok = r.read(s, mesh->faceareas); break;
+		case TMC_BBOX: {
+			std::vector<point> b;
+			ok = r.read(s, b) && b.size() == 2;
+			if (ok) {
+				mesh->bbox.min = b[0];
+				mesh->bbox.max = b[1];
+				mesh->bbox.valid = true;
+			}
+			break;
+		}
+		case TMC_BSPHERE: {
+			std::vector< Vec<4,float> > b;
+			ok = r.read(s, b) && b.size() == 1;
+			if (ok) {
+				mesh->bsphere.center = point(b[0][0], b[0][1], b[0][2]);
+				mesh->bsphere.r = b[0][3];
+				mesh->bsphere.valid = true;
+			}
+			break;
+		}
+		case TMC_EDGELENGTHS:
+			ok = r.read(s, mesh->edgelengths); break;
+		case TMC_NEIGHBORS_INDEX:
+			neighbors_index = &s; break;
+		case TMC_NEIGHBORS:
+			ok = neighbors_index &&
+				r.read(*neighbors_index, s, mesh->neighbors);
+			break;
+		case TMC_ADJACENTFACES_INDEX:
+			adjacentfaces_index = &s; break;
+		case TMC_ADJACENTFACES:
+			ok = adjacentfaces_index &&
+				r.read(*adjacentfaces_index, s,
+				       mesh->adjacentfaces);
+			break;
+		default:
+			break;
+		}
+		if (!ok) {
+			eprintf("Error reading section %u of tmc file.\n", s.id);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+// Add a section to a tmc file being put together
+template <class T, class A>
+static void tmc_add(std::vector<TmcSection> &sections,
+	std::vector<const void *> &data, unsigned id, const std::vector<T, A> &v)
+{
+	if (v.empty())
+		return;
+	TmcSection s;
+	memset(&s, 0, sizeof(s));
+	s.id = id;
+	s.elem_size = sizeof(T);
+	s.count = v.size();
+	sections.push_back(s);
+	data.push_back(&v[0]);
+}
+
+template <class T, class A>
+static void tmc_add(std::vector<TmcSection> &sections,
+	std::vector<const void *> &data, unsigned id, const SharedArray<T, A> &v)
+{
+	tmc_add(sections, data, id, (const std::vector<T, A> &) v);
+}
+
+
+// Write a tmc file.  source_size and source_mtime identify the file this
+// one is a cache of, if any.
+static bool write_tmc(TriMesh *mesh, FILE *f,
+	long long source_size /* = 0 */, long long source_mtime /* = 0 */)
+{
+	std::vector<TmcSection> sections;
+	std::vector<const void *> data;
+
+	tmc_add(sections, data, TMC_VERTICES, mesh->vertices);
+	tmc_add(sections, data, TMC_FACES, mesh->faces);
+	tmc_add(sections, data, TMC_TSTRIPS, mesh->tstrips);
+	tmc_add(sections, data, TMC_GRID, mesh->grid);
+	tmc_add(sections, data, TMC_COLORS, mesh->colors);
+	tmc_add(sections, data, TMC_CONFIDENCES, mesh->confidences);
+	tmc_add(sections, data, TMC_FLAGS, mesh->flags);
+	tmc_add(sections, data, TMC_NORMALS, mesh->normals);
+	tmc_add(sections, data, TMC_PDIR1, mesh->pdir1);
+	tmc_add(sections, data, TMC_PDIR2, mesh->pdir2);
+	tmc_add(sections, data, TMC_CURV1, mesh->curv1);
+	tmc_add(sections, data, TMC_CURV2, mesh->curv2);
+	tmc_add(sections, data, TMC_DCURV, mesh->dcurv);
+	tmc_add(sections, data, TMC_CORNERAREAS, mesh->cornerareas);
+	tmc_add(sections, data, TMC_POINTAREAS, mesh->pointareas);
+
+	std::vector<point> bbox;
+	if (mesh->bbox.valid) {
+		bbox.push_back(mesh->bbox.min);
+		bbox.push_back(mesh->bbox.max);
+	}
+	tmc_add(sections, data, TMC_BBOX, bbox);
+	std::vector< Vec<4,float> > bsphere;
+	if (mesh->bsphere.valid) {
+		const point &c = mesh->bsphere.center;
+		bsphere.push_back(Vec<4,float>(c[0], c[1], c[2],
+					       mesh->bsphere.r));
+	}
+	tmc_add(sections, data, TMC_BSPHERE, bsphere);
+
+	// Connectivity is stored just as in memory, but with 64-bit offsets
+	const AdjList &n = mesh->neighbors, &a = mesh->adjacentfaces;
+	std::vector<long long> neighbors_index(n.offsets.begin(),
+		n.offsets.end());
+	std::vector<long long> adjacentfaces_index(a.offsets.begin(),
+		a.offsets.end());
+	if (!n.empty()) {
+		tmc_add(sections, data, TMC_NEIGHBORS_INDEX, neighbors_index);
+		tmc_add(sections, data, TMC_NEIGHBORS, n.items);
+	}
+	if (!a.empty()) {
+		tmc_add(sections, data, TMC_ADJACENTFACES_INDEX,
+			adjacentfaces_index);
+		tmc_add(sections, data, TMC_ADJACENTFACES, a.items);
+	}
+	tmc_add(sections, data, TMC_ACROSS_EDGE, mesh->across_edge);
+
+	tmc_add(sections, data, TMC_EDGELENGTHS, mesh->edgelengths);
+	tmc_add(sections, data, TMC_FACEAREAS, mesh->faceareas);
+
+	// Lay out the file
+	TmcHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, "TMC", 4);
+	h.version = TMC_VERSION;
+	h.byte_order = TMC_BYTE_ORDER;
+	h.nsections = sections.size();
+	h.source_size = source_size;
+	h.source_mtime = source_mtime;
+	h.grid_width = mesh->grid_width;
+	h.grid_height = mesh->grid_height;
+	h.flag_curr = mesh->flag_curr;
+
+	unsigned long long pos = sizeof(h) + sections.size() * sizeof(TmcSection);
+	for (size_t i = 0; i < sections.size(); i++) {
+		pos = (pos + TMC_ALIGN - 1) / TMC_ALIGN * TMC_ALIGN;
+		sections[i].offset = pos;
+		pos += sections[i].count * sections[i].elem_size;
+	}
+
+	FWRITE(&h, sizeof(h), 1, f);
+	if (!sections.empty())
+		FWRITE(&sections[0], sizeof(TmcSection), sections.size(), f);
+	pos = sizeof(h) + sections.size() * sizeof(TmcSection);
+	const char zeros[TMC_ALIGN] = { 0 };
+	for (size_t i = 0; i < sections.size(); i++) {
+		if (sections[i].offset > pos)
+			FWRITE(zeros, sections[i].offset - pos, 1, f);
+		size_t n = sections[i].count * sections[i].elem_size;
+		FWRITE(data[i], n, 1, f);
+		pos = sections[i].offset + n;
+	}
+	return true;
+}
+
+
+// Read a mesh through a tmc cache: if the cache was made from the current
+// version of the file (same size and modification time), read that,
+// else read the file itself.  The default cache name is filename.tmc.
+TriMesh *TriMesh::read_cached(const char *filename,
+	const char *cache_filename /* = NULL */)
+{
+	std::string cache = cache_filename ? std::string(cache_filename) :
+		std::string(filename) + ".tmc";
+
+	long long size, mtime;
+	FILE *f;
+	if (file_stamp(filename, size, mtime) &&
+	    (f = fopen(cache.c_str(), "rb")) != NULL) {
+		TmcHeader h;
+		bool fresh = (fread(&h, sizeof(h), 1, f) == 1) &&
+			tmc_header_ok(h) &&
+			h.source_size == size && h.source_mtime == mtime;
+		fclose(f);
+		if (fresh) {
+			TriMesh *mesh = read(cache.c_str());
+			if (mesh)
+				return mesh;
+		}
+	}
+
+	return read(filename);
+}
+
+
+// Write a tmc cache of this mesh, which was read from filename
+bool TriMesh::write_cache(const char *filename,
+	const char *cache_filename /* = NULL */)
+{
+	std::string cache = cache_filename ? std::string(cache_filename) :
+		std::string(filename) + ".tmc";
+
+	long long size, mtime;
+	if (!file_stamp(filename, size, mtime)) {
+		eprintf("Can't stat [%s]: %s.\n", filename, strerror(errno));
+		return false;
+	}
+
+	need_vertices();
+	FILE *f = fopen(cache.c_str(), "wb");
+	if (!f) {
+		eprintf("Error opening [%s] for writing: %s.\n", cache.c_str(),
+			strerror(errno));
+		return false;
+	}
+	dprintf("Writing %s... ", cache.c_str());
+	bool ok = write_tmc(this, f, size, mtime);
+	if (fclose(f))
+		ok = false;
+	if (!ok) {
+		eprintf("Error writing file [%s].\n", cache.c_str());
+		remove(cache.c_str());
+		return false;
+	}
+	dprintf("Done.\n");
+	return true;
+}
+
+
+// The tmz format: a compressed mesh.  Positions are quantized to 2^bits
+// steps along each axis of the bounding box.  Faces are put in an order
+// that walks across edges (using across_edge), vertices are numbered in
+// order of first use, and both are cut into blocks that are coded
+// independently, so that writing and reading run in parallel.  In a block:
+//  - A face that shares an edge with the previous face is coded as the
+//    index of that edge plus the one remaining corner; others as 3 corners.
+//  - A corner is coded as "next new vertex", a position in a FIFO of
+//    recently referenced vertices, or an explicit offset back from the
+//    newest vertex.
+//  - A new vertex is predicted by the parallelogram rule (or something
+//    simpler, if the vertices it needs belong to another block), and the
+//    residual is coded as a bit length plus that many raw bits.
+//  - Colors are stored as 8-bit deltas, confidences losslessly as 4 byte
+//    planes.  Normals and other derived quantities are not stored.
+// Every stream except the raw bits is then compressed with a static
+// order-0 rANS coder.
+#define TMZ_VERSION 1
+#define TMZ_BYTE_ORDER 0x01020304u
+#define TMZ_DEFAULT_BITS 16
+#define TMZ_MAX_BITS 24
+#define TMZ_BLOCK_FACES 16384
+#define TMZ_BLOCK_VERTS 65536
+#define TMZ_FIFO 32
+#define TMZ_RANS_BITS 12
+#define TMZ_RANS_L (1u << 23)
+
+struct TmzHeader {
+	char magic[4];		// "TMZ\0"
+	unsigned version;
+	unsigned byte_order;	// TMZ_BYTE_ORDER, as seen by the writer
+	unsigned flags;
+	unsigned bits;
+	int nverts, nfaces;
+	unsigned nblocks;
+	float min[3], max[3];	// Quantization box
+	unsigned reserved[2];
+};
+
+struct TmzBlock {
+	int first_face, nfaces;
+	int first_vert, nverts;	// Vertices first used in this block
+	unsigned long long offset;	// From start of file
+	unsigned long long size;
+};
+
+enum { TMZ_COLORS = 1, TMZ_CONFIDENCES = 2 };
+
+enum {
+	TMZ_S_EDGE, TMZ_S_INDEX, TMZ_S_EXPLICIT, TMZ_S_LEN, TMZ_S_BITS,
+	TMZ_S_COLOR, TMZ_S_CONF, TMZ_NSTREAMS = TMZ_S_CONF + 4
+};
+
+
+// Little-endian 32-bit integers in a byte stream
+static void tmz_put32(std::vector<unsigned char> &out, unsigned x)
+{
+	for (int i = 0; i < 4; i++)
+		out.push_back((unsigned char) (x >> (8 * i)));
+}
+
+static bool tmz_get32(const unsigned char *&p, const unsigned char *end,
+	unsigned &x)
+{
+	if (end - p < 4)
+		return false;
+	x = p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned) p[3] << 24);
+	p += 4;
+	return true;
+}
+
+
+// Scale symbol counts to frequencies summing to 2^TMZ_RANS_BITS, keeping
+// every symbol that occurs at a frequency of at least 1
+static void tmz_normalize(const unsigned *count, size_t n, unsigned *freq)
+{
+	const int total = 1 << TMZ_RANS_BITS;
+	int sum = 0, most = 0;
+	for (int s = 0; s < 256; s++) {
+		freq[s] = 0;
+		if (!count[s])
+			continue;
+		freq[s] = std::max(1, (int) ((unsigned long long) count[s] *
+					     total / n));
+		sum += freq[s];
+		if (count[s] > count[most])
+			most = s;
+	}
+	while (sum > total) {
+		int s = most;
+		for (int i = 0; i < 256; i++)
+			if (freq[i] > freq[s])
+				s = i;
+		freq[s]--;
+		sum--;
+	}
+	freq[most] += total - sum;
+}
+
+
+// Append a byte stream to out: its length, then either the raw bytes or
+// (if !raw) the symbol frequencies and the rANS-coded bytes
+static void tmz_encode_stream(const std::vector<unsigned char> &in,
+	std::vector<unsigned char> &out, bool raw)
+{
+	size_t n = in.size();
+	tmz_put32(out, n);
+	if (raw || !n) {
+		tmz_put32(out, 0);
+		out.insert(out.end(), in.begin(), in.end());
+		return;
+	}
+
+	unsigned count[256] = { 0 }, freq[256], cum[256];
+	for (size_t i = 0; i < n; i++)
+		count[in[i]]++;
+	tmz_normalize(count, n, freq);
+	unsigned nsym = 0, total = 0;
+	for (int s = 0; s < 256; s++) {
+		cum[s] = total;
+		total += freq[s];
+		if (freq[s])
+			nsym++;
+	}
+	tmz_put32(out, nsym);
+	for (int s = 0; s < 256; s++) {
+		if (!freq[s])
+			continue;
+		out.push_back((unsigned char) s);
+		out.push_back((unsigned char) freq[s]);
+		out.push_back((unsigned char) (freq[s] >> 8));
+	}
+
+	// rANS runs backwards: encode from the end, emitting bytes in
+	// reverse, so that the decoder goes forwards.  A symbol never
+	// emits more than 2 bytes.
+	std::vector<unsigned char> buf(2 * n + 8);
+	unsigned char *end = &buf[0] + buf.size(), *p = end;
+	unsigned x = TMZ_RANS_L;
+	for (size_t i = n; i--; ) {
+		unsigned s = in[i], f = freq[s];
+		unsigned xmax = ((TMZ_RANS_L >> TMZ_RANS_BITS) << 8) * f;
+		while (x >= xmax) {
+			*--p = (unsigned char) x;
+			x >>= 8;
+		}
+		x = ((x / f) << TMZ_RANS_BITS) + (x % f) + cum[s];
+	}
+	p -= 4;
+	for (int i = 0; i < 4; i++)
+		p[i] = (unsigned char) (x >> (8 * i));
+	tmz_put32(out, end - p);
+	out.insert(out.end(), p, end);
+}
+
+
+// Decode a stream written by tmz_encode_stream, advancing p past it
+static bool tmz_decode_stream(const unsigned char *&p,
+	const unsigned char *end, std::vector<unsigned char> &out)
+{
+	unsigned n, nsym;
+	if (!tmz_get32(p, end, n) || !tmz_get32(p, end, nsym))
+		return false;
+	if (!nsym) {
+		if (n > (size_t) (end - p))
+			return false;
+		out.assign(p, p + n);
+		p += n;
+		return true;
+	}
+
+	const unsigned total = 1 << TMZ_RANS_BITS;
+	unsigned freq[256] = { 0 }, cum[256] = { 0 }, sum = 0;
+	unsigned char sym[1 << TMZ_RANS_BITS];
+	if (nsym > 256 || 3 * nsym > (size_t) (end - p))
+		return false;
+	for (unsigned i = 0; i < nsym; i++, p += 3) {
+		unsigned s = p[0], f = p[1] | (p[2] << 8);
+		if (freq[s] || !f || sum + f > total)
+			return false;
+		freq[s] = f;
+		cum[s] = sum;
+		memset(sym + sum, s, f);
+		sum += f;
+	}
+	unsigned size;
+	if (sum != total || !tmz_get32(p, end, size) || size < 4 ||
+	    size > (size_t) (end - p))
+		return false;
+	const unsigned char *q = p, *qend = p + size;
+	p += size;
+
+	unsigned x;
+	tmz_get32(q, qend, x);
+	out.resize(n);
+	for (unsigned i = 0; i < n; i++) {
+		unsigned slot = x & (total - 1), s = sym[slot];
+		out[i] = (unsigned char) s;
+		x = freq[s] * (x >> TMZ_RANS_BITS) + slot - cum[s];
+		while (x < TMZ_RANS_L) {
+			if (q == qend)
+				return false;
+			x = (x << 8) | *q++;
+		}
+	}
+	return true;
+}
+
+
+// Raw bits, least significant first
+struct TmzBitWriter {
+	std::vector<unsigned char> &out;
+	unsigned long long acc;
+	int n;
+
+	TmzBitWriter(std::vector<unsigned char> &out_) : out(out_), acc(0), n(0)
+		{}
+	void put(unsigned x, int nbits)
+	{
+		acc |= (unsigned long long) x << n;
+		n += nbits;
+		for ( ; n >= 8; n -= 8, acc >>= 8)
+			out.push_back((unsigned char) acc);
+	}
+	void flush()
+	{
+		if (n > 0)
+			out.push_back((unsigned char) acc);
+		acc = 0;
+		n = 0;
+	}
+};
+
+struct TmzBitReader {
+	const unsigned char *p, *end;
+	unsigned long long acc;
+	int n;
+
+	TmzBitReader() : p(0), end(0), acc(0), n(0)
+		{}
+	unsigned get(int nbits)
+	{
+		for ( ; n < nbits; n += 8)
+			acc |= (unsigned long long) (p < end ? *p++ : 0) << n;
+		unsigned x = (unsigned) (acc & ((1ull << nbits) - 1));
+		acc >>= nbits;
+		n -= nbits;
+		return x;
+	}
+};
+
+
+// What the encoder and decoder of a block know in common: which vertices
+// have been seen so far, their quantized positions, and the FIFO
+struct TmzState {
+	int bits;
+	const int *q;		// Quantized positions, for the whole mesh
+	int first_vert, next;	// Vertices [first_vert, next) are done
+	int fifo[TMZ_FIFO];
+	int nfifo;		// Total ever pushed
+	unsigned char last_color[3];
+
+	TmzState(int bits_, const int *q_, int first_vert_) :
+		bits(bits_), q(q_), first_vert(first_vert_), next(first_vert_),
+		nfifo(0)
+		{ last_color[0] = last_color[1] = last_color[2] = 0; }
+
+	bool owned(int v) const
+		{ return v >= first_vert && v < next; }
+	void push(int v)
+		{ fifo[nfifo++ & (TMZ_FIFO - 1)] = v; }
+	int fifo_size() const
+		{ return std::min(nfifo, TMZ_FIFO); }
+	int fifo_at(int pos) const
+		{ return fifo[(nfifo - 1 - pos) & (TMZ_FIFO - 1)]; }
+
+	// Predict the position of the next new vertex, given the other
+	// corners a and b of its face and the vertex c across edge ab.
+	// Any of these may be -1, or belong to another block.
+	void predict(int a, int b, int c, int *pred) const
+	{
+		const int maxq = (1 << bits) - 1;
+		bool oa = owned(a), ob = owned(b);
+		for (int k = 0; k < 3; k++) {
+			int p;
+			if (oa && ob && owned(c))
+				p = q[3*a+k] + q[3*b+k] - q[3*c+k];
+			else if (oa && ob)
+				p = (q[3*a+k] + q[3*b+k]) >> 1;
+			else if (oa)
+				p = q[3*a+k];
+			else if (ob)
+				p = q[3*b+k];
+			else if (next > first_vert)
+				p = q[3*(next-1)+k];
+			else
+				p = 1 << (bits - 1);
+			pred[k] = std::min(std::max(p, 0), maxq);
+		}
+	}
+};
+
+
+// Codes one block
+struct TmzEncoder : public TmzState {
+	std::vector<unsigned char> s[TMZ_NSTREAMS];
+	TmzBitWriter bw;
+	const unsigned char *colors;	// 3 bytes per vertex, or NULL
+	const float *confidences;	// or NULL
+
+	TmzEncoder(int bits_, const int *q_, int first_vert_) :
+		TmzState(bits_, q_, first_vert_), bw(s[TMZ_S_BITS]),
+		colors(0), confidences(0)
+		{}
+
+	// The next new vertex
+	void vert(int a, int b, int c)
+	{
+		int v = next, pred[3];
+		predict(a, b, c, pred);
+		for (int k = 0; k < 3; k++) {
+			int r = q[3*v+k] - pred[k];
+			unsigned u = ((unsigned) r << 1) ^ (unsigned) (r >> 31);
+			int nb = 0;
+			while (u >> nb)
+				nb++;
+			s[TMZ_S_LEN].push_back((unsigned char) nb);
+			if (nb > 1)
+				bw.put(u & ((1u << (nb - 1)) - 1), nb - 1);
+		}
+		if (colors) {
+			for (int k = 0; k < 3; k++) {
+				unsigned char c = colors[3*v+k];
+				s[TMZ_S_COLOR].push_back((unsigned char)
+					(c - last_color[k]));
+				last_color[k] = c;
+			}
+		}
+		if (confidences) {
+			unsigned x;
+			memcpy(&x, &confidences[v], 4);
+			for (int k = 0; k < 4; k++)
+				s[TMZ_S_CONF+k].push_back((unsigned char) (x >> (8 * k)));
+		}
+		next++;
+	}
+
+	// A corner of a face, with a, b, c as in predict()
+	void corner(int v, int a, int b, int c)
+	{
+		if (v == next) {
+			s[TMZ_S_INDEX].push_back(0);
+			vert(a, b, c);
+			push(v);
+			return;
+		}
+		int n = fifo_size();
+		for (int i = 0; i < n; i++) {
+			if (fifo_at(i) == v) {
+				s[TMZ_S_INDEX].push_back((unsigned char) (i + 1));
+				return;
+			}
+		}
+		s[TMZ_S_INDEX].push_back(TMZ_FIFO + 1);
+		unsigned d = next - 1 - v;
+		for ( ; d >= 0x80; d >>= 7)
+			s[TMZ_S_EXPLICIT].push_back((unsigned char) (d | 0x80));
+		s[TMZ_S_EXPLICIT].push_back((unsigned char) d);
+		push(v);
+	}
+};
+
+
+// Decodes one block
+struct TmzDecoder : public TmzState {
+	std::vector<unsigned char> s[TMZ_NSTREAMS];
+	size_t pos[TMZ_NSTREAMS];
+	TmzBitReader br;
+	int *qout;
+	TriMesh *mesh;
+	float min[3], scale[3];
+	bool ok;
+
+	TmzDecoder(int bits_, int *q_, int first_vert_) :
+		TmzState(bits_, q_, first_vert_), qout(q_), mesh(0), ok(true)
+	{
+		for (int i = 0; i < TMZ_NSTREAMS; i++)
+			pos[i] = 0;
+	}
+
+	int get(int i)
+	{
+		if (pos[i] >= s[i].size()) {
+			ok = false;
+			return 0;
+		}
+		return s[i][pos[i]++];
+	}
+
+	void vert(int a, int b, int c)
+	{
+		int v = next, pred[3];
+		predict(a, b, c, pred);
+		for (int k = 0; k < 3; k++) {
+			int nb = get(TMZ_S_LEN);
+			if (nb > bits + 1) {
+				ok = false;
+				nb = 0;
+			}
+			unsigned u = (nb <= 1) ? nb :
+				(1u << (nb - 1)) | br.get(nb - 1);
+			int x = pred[k] + (int) ((u >> 1) ^ (0u - (u & 1)));
+			qout[3*v+k] = x;
+			mesh->vertices[v][k] = min[k] + scale[k] * x;
+		}
+		if (!mesh->colors.empty()) {
+			for (int k = 0; k < 3; k++)
+				last_color[k] += (unsigned char) get(TMZ_S_COLOR);
+			mesh->colors[v] = Color(last_color);
+		}
+		if (!mesh->confidences.empty()) {
+			unsigned x = 0;
+			for (int k = 0; k < 4; k++)
+				x |= (unsigned) get(TMZ_S_CONF+k) << (8 * k);
+			memcpy(&mesh->confidences[v], &x, 4);
+		}
+		next++;
+	}
+
+	int corner(int a, int b, int c, int end_vert)
+	{
+		int sym = get(TMZ_S_INDEX);
+		if (sym == 0) {
+			if (next >= end_vert) {
+				ok = false;
+				return 0;
+			}
+			int v = next;
+			vert(a, b, c);
+			push(v);
+			return v;
+		} else if (sym <= TMZ_FIFO) {
+			if (sym > fifo_size()) {
+				ok = false;
+				return 0;
+			}
+			return fifo_at(sym - 1);
+		} else if (sym == TMZ_FIFO + 1) {
+			unsigned d = 0;
+			for (int shift = 0; shift < 32; shift += 7) {
+				int byte = get(TMZ_S_EXPLICIT);
+				d |= (unsigned) (byte & 0x7f) << shift;
+				if (!(byte & 0x80))
+					break;
+			}
+			if (d >= (unsigned) next) {
+				ok = false;
+				return 0;
+			}
+			int v = next - 1 - d;
+			push(v);
+			return v;
+		}
+		ok = false;
+		return 0;
+	}
+};
+
+
+// Order faces for tmz: walk across edges for as long as possible.  Faces
+// are returned rotated, with edges[i] = 1 + the index of the edge of face
+// i-1 that face i shares (which is then face i's first edge, reversed),
+// or 0 if there is no such edge.
+static void tmz_order_faces(TriMesh *mesh, std::vector<TriMesh::Face> &order,
+	std::vector<unsigned char> &edges)
+{
+	int nf = mesh->faces.size();
+	order.resize(nf);
+	edges.resize(nf);
+	std::vector<bool> visited(nf);
+	std::vector<int> stack;
+	int seed = 0, prev = -1, prev_rot = 0;
+	for (int n = 0; n < nf; n++) {
+		int f = -1, e = 0, rot = 0;
+		if (prev >= 0) {
+			// Edge 2 of the previous face is the one we came in by
+			static const int try_edges[3] = { 1, 0, 2 };
+			const TriMesh::Face &pf = order[n-1];
+			for (int t = 0; t < 3 && f < 0; t++) {
+				int k = try_edges[t];
+				int g = mesh->across_edge[prev][(k + prev_rot) % 3];
+				if (g < 0 || visited[g])
+					continue;
+				int a = pf[(k+2)%3], b = pf[(k+1)%3];
+				const TriMesh::Face &gf = mesh->faces[g];
+				for (int i = 0; i < 3; i++) {
+					if (gf[i] == a && gf[(i+1)%3] == b) {
+						f = g;
+						e = k + 1;
+						rot = i;
+						break;
+					}
+				}
+			}
+		}
+		if (f < 0) {
+			while (!stack.empty() && visited[stack.back()])
+				stack.pop_back();
+			if (!stack.empty()) {
+				f = stack.back();
+				stack.pop_back();
+			} else {
+				while (visited[seed])
+					seed++;
+				f = seed;
+			}
+		}
+
+		visited[f] = true;
+		for (int j = 0; j < 3; j++) {
+			int g = mesh->across_edge[f][j];
+			if (g >= 0 && !visited[g])
+				stack.push_back(g);
+		}
+		const TriMesh::Face &ff = mesh->faces[f];
+		order[n] = TriMesh::Face(ff[rot], ff[(rot+1)%3], ff[(rot+2)%3]);
+		edges[n] = (unsigned char) e;
+		prev = f;
+		prev_rot = rot;
+	}
+}
+
+
+// Write a tmz file, quantizing positions to the given number of bits
+static bool write_tmz(TriMesh *mesh, FILE *f, int bits)
+{
+	if (bits < 1 || bits > TMZ_MAX_BITS) {
+		eprintf("Quantization must be 1 to %d bits.\n", TMZ_MAX_BITS);
+		return false;
+	}
+	mesh->need_faces();
+	int nv = mesh->vertices.size(), nf = mesh->faces.size();
+	for (int i = 0; i < nf; i++) {
+		for (int j = 0; j < 3; j++) {
+			if (mesh->faces[i][j] < 0 || mesh->faces[i][j] >= nv) {
+				eprintf("Face %d has invalid vertex index.\n", i);
+				return false;
+			}
+		}
+	}
+	mesh->need_across_edge();
+	mesh->need_bbox();
+
+	std::vector<TriMesh::Face> faces;
+	std::vector<unsigned char> edges;
+	tmz_order_faces(mesh, faces, edges);
+
+	// Number vertices in order of first use, and cut into blocks
+	std::vector<int> newid(nv, -1), oldid;
+	oldid.reserve(nv);
+	std::vector<TmzBlock> blocks;
+	for (int i = 0; i < nf; i += TMZ_BLOCK_FACES) {
+		TmzBlock b;
+		memset(&b, 0, sizeof(b));
+		b.first_face = i;
+		b.nfaces = std::min(nf - i, TMZ_BLOCK_FACES);
+		b.first_vert = oldid.size();
+		for (int j = i; j < i + b.nfaces; j++) {
+			for (int k = 0; k < 3; k++) {
+				int &id = newid[faces[j][k]];
+				if (id < 0) {
+					id = oldid.size();
+					oldid.push_back(faces[j][k]);
+				}
+			}
+		}
+		b.nverts = oldid.size() - b.first_vert;
+		blocks.push_back(b);
+	}
+	// Vertices not used by any face go at the end
+	for (int i = 0; i < nv; i++) {
+		if (newid[i] >= 0)
+			continue;
+		if (blocks.empty() || blocks.back().nfaces ||
+		    blocks.back().nverts == TMZ_BLOCK_VERTS) {
+			TmzBlock b;
+			memset(&b, 0, sizeof(b));
+			b.first_face = nf;
+			b.first_vert = oldid.size();
+			blocks.push_back(b);
+		}
+		newid[i] = oldid.size();
+		oldid.push_back(i);
+		blocks.back().nverts++;
+	}
+	int nblocks = blocks.size();
+
+	// Renumber, quantize
+#pragma omp parallel for
+	for (int i = 0; i < nf; i++)
+		for (int j = 0; j < 3; j++)
+			faces[i][j] = newid[faces[i][j]];
+
+	const int maxq = (1 << bits) - 1;
+	const point &bmin = mesh->bbox.min, &bmax = mesh->bbox.max;
+	vec inv;
+	for (int k = 0; k < 3; k++)
+		inv[k] = bmax[k] > bmin[k] ? maxq / (bmax[k] - bmin[k]) : 0.0f;
+	std::vector<int> q(3 * nv);
+	std::vector<unsigned char> colors;
+	std::vector<float> confidences;
+	bool have_colors = (mesh->colors.size() == (size_t) nv);
+	bool have_conf = (mesh->confidences.size() == (size_t) nv);
+	if (have_colors)
+		colors.resize(3 * nv);
+	if (have_conf)
+		confidences.resize(nv);
+#pragma omp parallel for
+	for (int i = 0; i < nv; i++) {
+		int v = oldid[i];
+		for (int k = 0; k < 3; k++) {
+			int x = int((mesh->vertices[v][k] - bmin[k]) * inv[k] + 0.5f);
+			q[3*i+k] = std::min(std::max(x, 0), maxq);
+		}
+		if (have_colors)
+			for (int k = 0; k < 3; k++)
+				colors[3*i+k] = color2uchar(mesh->colors[v][k]);
+		if (have_conf)
+			confidences[i] = mesh->confidences[v];
+	}
+
+	// Code the blocks
+	std::vector< std::vector<unsigned char> > data(nblocks);
+#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < nblocks; i++) {
+		const TmzBlock &b = blocks[i];
+		TmzEncoder enc(bits, &q[0], b.first_vert);
+		if (have_colors)
+			enc.colors = &colors[0];
+		if (have_conf)
+			enc.confidences = &confidences[0];
+		for (int j = b.first_face; j < b.first_face + b.nfaces; j++) {
+			const TriMesh::Face &fj = faces[j];
+			int e = (j == b.first_face) ? 0 : edges[j];
+			enc.s[TMZ_S_EDGE].push_back((unsigned char) e);
+			if (e) {
+				const TriMesh::Face &pf = faces[j-1];
+				enc.corner(fj[2], fj[0], fj[1], pf[e-1]);
+			} else {
+				enc.corner(fj[0], -1, -1, -1);
+				enc.corner(fj[1], fj[0], -1, -1);
+				enc.corner(fj[2], fj[0], fj[1], -1);
+			}
+		}
+		while (enc.next < b.first_vert + b.nverts)
+			enc.vert(-1, -1, -1);
+		enc.bw.flush();
+		for (int j = 0; j < TMZ_NSTREAMS; j++) {
+			tmz_encode_stream(enc.s[j], data[i], j == TMZ_S_BITS);
+			std::vector<unsigned char>().swap(enc.s[j]);
+		}
+	}
+
+	TmzHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, "TMZ", 4);
+	h.version = TMZ_VERSION;
+	h.byte_order = TMZ_BYTE_ORDER;
+	h.flags = (have_colors ? TMZ_COLORS : 0) |
+		  (have_conf ? TMZ_CONFIDENCES : 0);
+	h.bits = bits;
+	h.nverts = nv;
+	h.nfaces = nf;
+	h.nblocks = nblocks;
+	for (int k = 0; k < 3; k++) {
+		h.min[k] = bmin[k];
+		h.max[k] = bmax[k];
+	}
+	unsigned long long pos = sizeof(h) + nblocks * sizeof(TmzBlock);
+	for (int i = 0; i < nblocks; i++) {
+		blocks[i].offset = pos;
+		blocks[i].size = data[i].size();
+		pos += data[i].size();
+	}
+
+	FWRITE(&h, sizeof(h), 1, f);
+	if (nblocks)
+		FWRITE(&blocks[0], sizeof(TmzBlock), nblocks, f);
+	for (int i = 0; i < nblocks; i++)
+		FWRITE(&data[i][0], data[i].size(), 1, f);
+	return true;
+}
+
+
+// Read a tmz file, after the magic number
+static bool read_tmz(FILE *f, TriMesh *mesh)
+{
+	TmzHeader h;
+	memcpy(h.magic, "TMZ", 4);
+	if (fread(&h.version, sizeof(h) - 4, 1, f) != 1 ||
+	    h.version != TMZ_VERSION || h.byte_order != TMZ_BYTE_ORDER ||
+	    h.bits < 1 || h.bits > TMZ_MAX_BITS || h.nverts < 0 ||
+	    h.nfaces < 0) {
+		eprintf("Not a tmz file, or unsupported version.\n");
+		return false;
+	}
+	std::vector<TmzBlock> blocks(h.nblocks);
+	if (h.nblocks &&
+	    fread(&blocks[0], sizeof(TmzBlock), h.nblocks, f) != h.nblocks)
+		return false;
+
+	// The blocks must cover all faces and vertices, in order
+	unsigned long long start = sizeof(h) + h.nblocks * sizeof(TmzBlock);
+	unsigned long long end = start;
+	int nf = 0, nv = 0;
+	for (size_t i = 0; i < blocks.size(); i++) {
+		const TmzBlock &b = blocks[i];
+		if (b.first_face != nf || b.first_vert != nv ||
+		    b.nfaces < 0 || b.nverts < 0 ||
+		    b.nfaces > h.nfaces - nf || b.nverts > h.nverts - nv ||
+		    b.offset != end)
+			return false;
+		nf += b.nfaces;
+		nv += b.nverts;
+		end += b.size;
+	}
+	if (nf != h.nfaces || nv != h.nverts)
+		return false;
+
+	// Get at the data: mapped if possible, else read in
+	MappedFile map;
+	std::vector<unsigned char> buf;
+	const unsigned char *data = NULL;
+	long long base = ftell64(f) - (long long) start;
+	if (base >= 0 && map.open(f) && map.size() - base >= end) {
+		data = map.data() + base + start;
+	} else {
+		map.close();
+		buf.resize(end - start);
+		if (!buf.empty() && fread(&buf[0], buf.size(), 1, f) != 1)
+			return false;
+		data = buf.empty() ? NULL : &buf[0];
+	}
 
+	dprintf("\n  Decoding %d blocks... ", (int) h.nblocks);
+	mesh->vertices.resize(h.nverts);
+	mesh->faces.resize(h.nfaces);
+	if (h.flags & TMZ_COLORS)
+		mesh->colors.resize(h.nverts);
+	if (h.flags & TMZ_CONFIDENCES)
+		mesh->confidences.resize(h.nverts);
+	std::vector<int> q(3 * h.nverts);
+	const int maxq = (1 << h.bits) - 1;
+
+	int nblocks = h.nblocks;
+	bool ok = true;
+#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < nblocks; i++) {
+		const TmzBlock &b = blocks[i];
+		TmzDecoder dec(h.bits, q.empty() ? NULL : &q[0], b.first_vert);
+		dec.mesh = mesh;
+		for (int k = 0; k < 3; k++) {
+			dec.min[k] = h.min[k];
+			dec.scale[k] = (h.max[k] - h.min[k]) / maxq;
+		}
+		const unsigned char *p = data + (b.offset - start);
+		const unsigned char *pend = p + b.size;
+		for (int j = 0; j < TMZ_NSTREAMS && dec.ok; j++)
+			dec.ok = tmz_decode_stream(p, pend, dec.s[j]);
+		const std::vector<unsigned char> &bits = dec.s[TMZ_S_BITS];
+		if (!bits.empty()) {
+			dec.br.p = &bits[0];
+			dec.br.end = dec.br.p + bits.size();
+		}
 
-// Tesselate an arbitrary n-gon.  Appends triangles to "tris".
-static void tess(const std::vector<point> &verts, const std::vector<int> &thisface,
-		 std::vector<TriMesh::Face> &tris)
-{
-	if (thisface.size() < 3)
-		return;
-	if (thisface.size() == 3) {
-		tris.push_back(TriMesh::Face(thisface[0],
-					     thisface[1],
-					     thisface[2]));
-		return;
+		int end_vert = b.first_vert + b.nverts;
+		for (int j = b.first_face; dec.ok && j < b.first_face + b.nfaces; j++) {
+			int e = dec.get(TMZ_S_EDGE);
+			TriMesh::Face &fj = mesh->faces[j];
+			if (e > 3 || (e && j == b.first_face)) {
+				dec.ok = false;
+			} else if (e) {
+				const TriMesh::Face &pf = mesh->faces[j-1];
+				fj[0] = pf[(e+1)%3];
+				fj[1] = pf[e%3];
+				fj[2] = dec.corner(fj[0], fj[1], pf[e-1], end_vert);
+			} else {
+				fj[0] = dec.corner(-1, -1, -1, end_vert);
+				fj[1] = dec.corner(fj[0], -1, -1, end_vert);
+				fj[2] = dec.corner(fj[0], fj[1], -1, end_vert);
+			}
+		}
+		while (dec.ok && dec.next < end_vert)
+			dec.vert(-1, -1, -1);
+		if (!dec.ok)
+			ok = false;
 	}
-	if (thisface.size() == 4) {
-		// Triangulate in the direction that
-		// gives the shorter diagonal
-		const point &p0 = verts[thisface[0]], &p1 = verts[thisface[1]];
-		const point &p2 = verts[thisface[2]], &p3 = verts[thisface[3]];
-		float d02 = dist2(p0, p2);
-		float d13 = dist2(p1, p3);
-		int i = (d02 < d13) ? 0 : 1;
-		tris.push_back(TriMesh::Face(thisface[i],
-					     thisface[(i+1)%4],
-					     thisface[(i+2)%4]));
-		tris.push_back(TriMesh::Face(thisface[i],
-					     thisface[(i+2)%4],
-					     thisface[(i+3)%4]));
-		return;
+	if (!ok) {
+		eprintf("Corrupt tmz file.\n");
+		return false;
 	}
-
-	// 5-gon or higher - just tesselate arbitrarily...
-	for (size_t i = 2; i < thisface.size(); i++)
-		tris.push_back(TriMesh::Face(thisface[0],
-					     thisface[i-1],
-					     thisface[i]));
+	return true;
 }
 
 
+
 // Write mesh to a file
 bool TriMesh::write(const char *filename)
 {
@@ -1417,19 +4801,22 @@ bool TriMesh::write(const char *filename)
 		return false;
 	}
 
+	need_vertices();
 	if (vertices.empty()) {
 		eprintf("Empty mesh - nothing to write.\n");
 		return false;
 	}
 
 	enum { PLY_ASCII, PLY_BINARY_BE, PLY_BINARY_LE,
-	       RAY, OBJ, OFF, SM, STL, CC, DAE } filetype;
+	       RAY, OBJ, OFF, SM, STL, CC, DAE, TMC, TMZ } filetype;
 	// Set default file type to be native-endian binary ply
 	filetype = we_are_little_endian() ? PLY_BINARY_LE : PLY_BINARY_BE;
 
 	bool write_norm = false;
 	bool write_grid = !grid.empty();
 	bool float_color = false;
+	bool write_attribs = false;
+	int tmz_bits = TMZ_DEFAULT_BITS;
 
 	// Infer file type from file extension
 	if (ends_with(filename, ".ply"))
@@ -1455,6 +4842,10 @@ bool TriMesh::write(const char *filename)
 		filetype = CC;
 	else if (ends_with(filename, ".dae"))
 		filetype = DAE;
+	else if (ends_with(filename, ".tmc"))
+		filetype = TMC;
+	else if (ends_with(filename, ".tmz"))
+		filetype = TMZ;
 
 	// Handle filetype:filename.foo constructs
 	while (1) {
@@ -1467,6 +4858,9 @@ bool TriMesh::write(const char *filename)
 		} else if (begins_with(filename, "cflt:")) {
 			filename += 5;
 			float_color = true;
+		} else if (begins_with(filename, "attr:")) {
+			filename += 5;
+			write_attribs = true;
 		} else if (begins_with(filename, "ply:")) {
 			filename += 4;
 			filetype = we_are_little_endian() ?
@@ -1522,6 +4916,17 @@ bool TriMesh::write(const char *filename)
 		} else if (begins_with(filename, "dae:")) {
 			filename += 4;
 			filetype = DAE;
+		} else if (begins_with(filename, "tmc:")) {
+			filename += 4;
+			filetype = TMC;
+		} else if (begins_with(filename, "tmz:")) {
+			filename += 4;
+			filetype = TMZ;
+		} else if (filename[0] == 'q' && isdigit(filename[1]) &&
+			   filename[1 + strspn(filename + 1, "0123456789")] == ':') {
+			// q<bits>: sets tmz quantization
+			tmz_bits = atoi(filename + 1);
+			filename += 2 + strspn(filename + 1, "0123456789");
 		} else {
 			break;
 		}
@@ -1551,11 +4956,13 @@ bool TriMesh::write(const char *filename)
 			break;
 		case PLY_BINARY_BE:
 			ok = write_ply_binary(this, f,
-				we_are_little_endian(), write_norm, write_grid, float_color);
+				we_are_little_endian(), write_norm, write_grid, float_color,
+				write_attribs);
 			break;
 		case PLY_BINARY_LE:
 			ok = write_ply_binary(this, f,
-				!we_are_little_endian(), write_norm, write_grid, float_color);
+				!we_are_little_endian(), write_norm, write_grid, float_color,
+				write_attribs);
 			break;
 		case RAY:
 			ok = write_ray(this, f);
@@ -1578,6 +4985,12 @@ bool TriMesh::write(const char *filename)
 		case DAE:
 			ok = write_dae(this, f);
 			break;
+		case TMC:
+			ok = write_tmc(this, f);
+			break;
+		case TMZ:
+			ok = write_tmz(this, f, tmz_bits);
+			break;
 	}
 
 	fclose(f);
@@ -1592,17 +5005,32 @@ bool TriMesh::write(const char *filename)
 
 
 // Write a ply header
+// If stream_counts is given, the header is for a file being written in
+// chunks: it holds stream_counts[0] vertices and stream_counts[1] faces,
+// written with fixed width so that they can be updated in place later.
 static bool write_ply_header(TriMesh *mesh, FILE *f, const char *format,
 			     bool write_grid, bool write_tstrips,
-			     bool write_norm, bool float_color)
+			     bool write_norm, bool float_color,
+			     bool write_attribs = false,
+			     const long long *stream_counts = NULL)
 {
+	// Vertex indices are written as 32-bit ints
+	if ((write_grid || write_tstrips || !mesh->faces.empty()) &&
+	    mesh->vertices.size() > (size_t) INT_MAX) {
+		eprintf("Too many vertices to write to a ply file.\n");
+		return false;
+	}
+
 	FPRINTF(f, "ply\nformat %s 1.0\n", format);
 	if (write_grid) {
 		FPRINTF(f, "obj_info num_cols %d\n", mesh->grid_width);
 		FPRINTF(f, "obj_info num_rows %d\n", mesh->grid_height);
 	}
-	FPRINTF(f, "element vertex %lu\n",
-		(unsigned long) mesh->vertices.size());
+	if (stream_counts)
+		FPRINTF(f, "element vertex %-10lld\n", stream_counts[0]);
+	else
+		FPRINTF(f, "element vertex %lu\n",
+			(unsigned long) mesh->vertices.size());
 	FPRINTF(f, "property float x\n");
 	FPRINTF(f, "property float y\n");
 	FPRINTF(f, "property float z\n");
@@ -1624,6 +5052,15 @@ static bool write_ply_header(TriMesh *mesh, FILE *f, const char *format,
 	if (!mesh->confidences.empty()) {
 		FPRINTF(f, "property float confidence\n");
 	}
+	if (write_attribs) {
+		std::vector<PlyChannel> channels;
+		std::vector<const float *> data;
+		ply_write_channels(mesh, channels, data);
+		for (size_t i = 0; i < channels.size(); i++)
+			for (int j = 0; j < channels[i].ncomp; j++)
+				FPRINTF(f, "property float %s\n",
+					channels[i].prop(j).c_str());
+	}
 	if (write_grid) {
 		int ngrid = mesh->grid_width * mesh->grid_height;
 		FPRINTF(f, "element range_grid %d\n", ngrid);
@@ -1631,6 +5068,9 @@ static bool write_ply_header(TriMesh *mesh, FILE *f, const char *format,
 	} else if (write_tstrips) {
 		FPRINTF(f, "element tristrips 1\n");
 		FPRINTF(f, "property list int int vertex_indices\n");
+	} else if (stream_counts) {
+		FPRINTF(f, "element face %-10lld\n", stream_counts[1]);
+		FPRINTF(f, "property list uchar int vertex_indices\n");
 	} else {
 		mesh->need_faces();
 		if (!mesh->faces.empty()) {
@@ -1675,7 +5115,8 @@ static bool write_ply_ascii(TriMesh *mesh, FILE *f, bool write_norm,
 
 // Write a binary ply file
 static bool write_ply_binary(TriMesh *mesh, FILE *f, bool need_swap,
-			     bool write_norm, bool write_grid, bool float_color)
+			     bool write_norm, bool write_grid, bool float_color,
+			     bool write_attribs)
 {
 	if (write_norm)
 		mesh->need_normals();
@@ -1685,10 +5126,10 @@ static bool write_ply_binary(TriMesh *mesh, FILE *f, bool need_swap,
 	const char *format = (need_swap ^ we_are_little_endian()) ?
 		"binary_little_endian" : "binary_big_endian";
 	if (!write_ply_header(mesh, f, format, write_grid, write_tstrips,
-			      write_norm, float_color))
+			      write_norm, float_color, write_attribs))
 		return false;
 	if (!write_verts_bin(mesh, f, need_swap, write_norm, true,
-			     float_color, true))
+			     float_color, true, write_attribs))
 		return false;
 	if (write_grid) {
 		return write_grid_bin(mesh, f, need_swap);
@@ -1708,6 +5149,393 @@ static bool write_ply_binary(TriMesh *mesh, FILE *f, bool need_swap,
 }
 
 
+// Open a ply file for streaming out
+bool TriMesh::PlyWriter::open(const char *filename, bool binary_ /* = true */)
+{
+	close();
+	f = fopen(filename, "wb");
+	if (!f) {
+		eprintf("Error opening [%s] for writing: %s.\n", filename,
+			strerror(errno));
+		return false;
+	}
+	binary = binary_;
+	ok = true;
+	header_done = in_faces = false;
+	with_norm = with_color = with_conf = false;
+	nverts = nfaces = 0;
+	return true;
+}
+
+
+// Write the header, with the counts so far
+bool TriMesh::PlyWriter::write_header()
+{
+	// write_ply_header looks at a mesh to see which properties to write
+	TriMesh proto;
+	proto.vertices.resize(1);
+	if (with_norm)
+		proto.normals.resize(1);
+	if (with_color)
+		proto.colors.resize(1);
+	if (with_conf)
+		proto.confidences.resize(1);
+
+	const char *format = !binary ? "ascii" :
+		we_are_little_endian() ? "binary_little_endian" :
+		"binary_big_endian";
+	long long counts[2] = { nverts, nfaces };
+	return write_ply_header(&proto, f, format, false, false,
+		with_norm, false, false, counts);
+}
+
+
+// Write a chunk of vertices
+bool TriMesh::PlyWriter::write_verts(TriMesh *chunk)
+{
+	if (!ok)
+		return false;
+	if (in_faces) {
+		eprintf("Can't write vertices after faces.\n");
+		return ok = false;
+	}
+	if (!header_done) {
+		with_norm = !chunk->normals.empty();
+		with_color = !chunk->colors.empty();
+		with_conf = !chunk->confidences.empty();
+		if (!write_header())
+			return ok = false;
+		header_done = true;
+	}
+
+	size_t nv = chunk->vertices.size();
+	if ((with_norm && chunk->normals.size() != nv) ||
+	    (with_color && chunk->colors.size() != nv) ||
+	    (with_conf && chunk->confidences.size() != nv)) {
+		eprintf("Chunk of vertices is missing properties.\n");
+		return ok = false;
+	}
+	if (!nv)
+		return true;
+
+	bool success;
+	if (binary)
+		success = write_verts_bin(chunk, f, false, with_norm,
+			with_color, false, with_conf, false);
+	else
+		success = write_verts_asc(chunk, f, "",
+			with_norm ? " " : 0, with_color ? " " : 0, false,
+			with_conf ? " " : 0, "");
+	if (!success)
+		return ok = false;
+	nverts += nv;
+	return true;
+}
+
+
+// Write a chunk of faces
+bool TriMesh::PlyWriter::write_faces(TriMesh *chunk)
+{
+	if (!ok)
+		return false;
+	if (!header_done) {
+		if (!write_header())
+			return ok = false;
+		header_done = true;
+	}
+	in_faces = true;
+
+	chunk->need_faces();
+	if (chunk->faces.empty())
+		return true;
+
+	bool success;
+	if (binary) {
+		char buf[1] = { 3 };
+		success = write_faces_bin(chunk, f, false, 1, buf, 0, 0);
+	} else {
+		success = write_faces_asc(chunk, f, "3 ", "");
+	}
+	if (!success)
+		return ok = false;
+	nfaces += chunk->faces.size();
+	return true;
+}
+
+
+// Fill in the final counts, and close the file
+bool TriMesh::PlyWriter::close()
+{
+	if (!f)
+		return false;
+	if (ok && !header_done)
+		ok = write_header();
+	if (ok)
+		ok = (fseek(f, 0, SEEK_SET) == 0) && write_header();
+	if (fclose(f))
+		ok = false;
+	f = 0;
+	bool success = ok;
+	ok = false;
+	return success;
+}
+
+
+// Append the decimal representation of x to s, as printf("%d")
+static inline void append_int(std::string &s, int x)
+{
+	char buf[16], *p = buf + sizeof(buf);
+	unsigned u = (x < 0) ? 0u - (unsigned) x : (unsigned) x;
+	do {
+		*--p = char('0' + u % 10);
+		u /= 10;
+	} while (u);
+	if (x < 0)
+		*--p = '-';
+	s.append(p, buf + sizeof(buf) - p);
+}
+
+
+// Format x into buf exactly as printf("%.7g") would, returning the length.
+// The 7 significant digits come from scaling by a power of 10 in double
+// precision, which is good to far better than 1e-5 of a unit in the last
+// digit, so it rounds the same way as printf except when x is within that
+// much of a tie.  For those (and infinities and NaNs) return -1.
+static int format_float7(char *buf, float x)
+{
+	static const double p10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+		1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+		1e21, 1e22
+	};
+
+	// Look at the bits, since compiling with -ffast-math or the like
+	// makes the compiler forget about -0 and NaN
+	unsigned bits;
+	memcpy(&bits, &x, 4);
+	char *q = buf;
+	if (bits >> 31)
+		*q++ = '-';
+	if (!(bits & 0x7fffffffu)) {
+		*q++ = '0';
+		return q - buf;
+	}
+	if ((bits & 0x7f800000u) == 0x7f800000u)
+		return -1;
+
+	// y = v * 10^(6-e), so that 1e6 <= y < 1e7
+	double v = std::fabs((double) x), y;
+	int e = (int) std::floor(std::log10(v));
+	for (int tries = 0; ; tries++) {
+		int p = 6 - e;
+		y = v;
+		for ( ; p > 22; p -= 22)
+			y *= p10[22];
+		for ( ; p < -22; p += 22)
+			y /= p10[22];
+		y = (p >= 0) ? y * p10[p] : y / p10[-p];
+		if (y >= 1e7)
+			e++;
+		else if (y < 1e6)
+			e--;
+		else
+			break;
+		if (tries == 2)
+			return -1;
+	}
+	double r = std::floor(y), d = y - r;
+	if (std::fabs(d - 0.5) < 1e-5)
+		return -1;
+	int n = (int) r + (d > 0.5);
+	if (n == 10000000) {
+		n = 1000000;
+		e++;
+	}
+
+	char digits[7];
+	for (int i = 6; i >= 0; i--, n /= 10)
+		digits[i] = char('0' + n % 10);
+	int ndigits = 7;
+	while (ndigits > 1 && digits[ndigits-1] == '0')
+		ndigits--;
+
+	if (e < -4 || e >= 7) {
+		*q++ = digits[0];
+		if (ndigits > 1) {
+			*q++ = '.';
+			for (int i = 1; i < ndigits; i++)
+				*q++ = digits[i];
+		}
+		*q++ = 'e';
+		*q++ = (e < 0) ? '-' : '+';
+		int ae = (e < 0) ? -e : e;
+		*q++ = char('0' + ae / 10);
+		*q++ = char('0' + ae % 10);
+	} else if (e >= 0) {
+		for (int i = 0; i <= e; i++)
+			*q++ = digits[i];
+		if (ndigits > e + 1) {
+			*q++ = '.';
+			for (int i = e + 1; i < ndigits; i++)
+				*q++ = digits[i];
+		}
+	} else {
+		*q++ = '0';
+		*q++ = '.';
+		for (int i = -1; i > e; i--)
+			*q++ = '0';
+		for (int i = 0; i < ndigits; i++)
+			*q++ = digits[i];
+	}
+	return q - buf;
+}
+
+
+// Append x to s, as printf("%.7g")
+static inline void append_float7(std::string &s, float x)
+{
+	char buf[32];
+	int len = format_float7(buf, x);
+	if (len < 0)
+		len = snprintf(buf, sizeof(buf), "%.7g", x);
+	s.append(buf, len);
+}
+
+
+// Append "before" and the 3 components of v, separated by spaces
+static inline void append_vec7(std::string &s, const char *before,
+	const float *v)
+{
+	s.append(before);
+	append_float7(s, v[0]);
+	s += ' ';
+	append_float7(s, v[1]);
+	s += ' ';
+	append_float7(s, v[2]);
+}
+
+
+#define ASC_WRITE_CHUNK 16384
+#define ASC_WRITE_BATCH 64
+
+// Write n records of ASCII text.  fmt(i, s) appends record i to string s.
+// Chunks of records are formatted in parallel, a batch at a time, then
+// written out in order.
+template <class Formatter>
+static bool write_asc_records(FILE *f, size_t n, const Formatter &fmt)
+{
+	std::vector<std::string> bufs(ASC_WRITE_BATCH);
+	const size_t batch_size = (size_t) ASC_WRITE_BATCH * ASC_WRITE_CHUNK;
+	for (size_t first = 0; first < n; first += batch_size) {
+		size_t nleft = std::min(n - first, batch_size);
+		int nchunks = (nleft + ASC_WRITE_CHUNK - 1) / ASC_WRITE_CHUNK;
+#pragma omp parallel for schedule(dynamic)
+		for (int j = 0; j < nchunks; j++) {
+			std::string &s = bufs[j];
+			s.clear();
+			size_t start = first + (size_t) j * ASC_WRITE_CHUNK;
+			size_t end = std::min(start + ASC_WRITE_CHUNK, n);
+			for (size_t i = start; i < end; i++)
+				fmt(i, s);
+		}
+		for (int j = 0; j < nchunks; j++) {
+			if (!bufs[j].empty())
+				FWRITE(bufs[j].data(), bufs[j].size(), 1, f);
+		}
+	}
+	return true;
+}
+
+
+// Formats vertices for write_verts_asc
+struct VertFormatter {
+	const TriMesh *mesh;
+	const char *before_vert, *before_norm, *before_color, *before_conf;
+	const char *after_line;
+	bool float_color;
+
+	void operator () (size_t i, std::string &s) const
+	{
+		append_vec7(s, before_vert, mesh->vertices[i]);
+		if (!mesh->normals.empty() && before_norm)
+			append_vec7(s, before_norm, mesh->normals[i]);
+		if (!mesh->colors.empty() && before_color && float_color)
+			append_vec7(s, before_color, mesh->colors[i]);
+		if (!mesh->colors.empty() && before_color && !float_color) {
+			s.append(before_color);
+			append_int(s, color2uchar(mesh->colors[i][0]));
+			s += ' ';
+			append_int(s, color2uchar(mesh->colors[i][1]));
+			s += ' ';
+			append_int(s, color2uchar(mesh->colors[i][2]));
+		}
+		if (!mesh->confidences.empty() && before_conf) {
+			s.append(before_conf);
+			append_float7(s, mesh->confidences[i]);
+		}
+		s.append(after_line);
+		s += '\n';
+	}
+};
+
+
+// Formats faces for write_faces_asc.  Indices are offset by base, and
+// with obj_norm each index i is written as i//i (the OBJ syntax for a
+// vertex with its normal).
+struct FaceFormatter {
+	const TriMesh *mesh;
+	const char *before_face, *after_line;
+	int base;
+	bool obj_norm;
+
+	void operator () (size_t i, std::string &s) const
+	{
+		s.append(before_face);
+		for (int j = 0; j < 3; j++) {
+			if (j)
+				s += ' ';
+			int ind = mesh->faces[i][j] + base;
+			append_int(s, ind);
+			if (obj_norm) {
+				s.append("//");
+				append_int(s, ind);
+			}
+		}
+		s.append(after_line);
+		s += '\n';
+	}
+};
+
+
+// Formats tstrips for write_strips_asc
+struct StripFormatter {
+	const TriMesh *mesh;
+
+	void operator () (size_t i, std::string &s) const
+	{
+		append_int(s, mesh->tstrips[i]);
+		s += ' ';
+	}
+};
+
+
+// Formats range grid for write_grid_asc
+struct GridFormatter {
+	const TriMesh *mesh;
+
+	void operator () (size_t i, std::string &s) const
+	{
+		if (mesh->grid[i] < 0) {
+			s.append("0\n");
+		} else {
+			s.append("1 ");
+			append_int(s, mesh->grid[i]);
+			s += '\n';
+		}
+	}
+};
+
+
 // Write a ray file
 static bool write_ray(TriMesh *mesh, FILE *f)
 {
@@ -1736,36 +5564,9 @@ static bool write_obj(TriMesh *mesh, FILE *f, bool write_norm)
 
 	mesh->need_faces();
 
-	// Indices in OBJ files are 1-based.  Temporarily increment them.
-	for (size_t i = 0; i < mesh->faces.size(); i++) {
-		mesh->faces[i][0]++;
-		mesh->faces[i][1]++;
-		mesh->faces[i][2]++;
-	}
-
-	bool ok = true;
-	if (!write_norm) {
-		ok = write_faces_asc(mesh, f, "f ", "");
-	} else {
-		for (size_t i = 0; i < mesh->faces.size(); i++) {
-			int n = fprintf(f, "f %d//%d %d//%d %d//%d\n",
-					mesh->faces[i][0], mesh->faces[i][0],
-					mesh->faces[i][1], mesh->faces[i][1],
-					mesh->faces[i][2], mesh->faces[i][2]);
-			if (n < 6) {
-				ok = false;
-				break;
-			}
-		}
-	}
-
-	// Put indices back
-	for (size_t i = 0; i < mesh->faces.size(); i++) {
-		mesh->faces[i][0]--;
-		mesh->faces[i][1]--;
-		mesh->faces[i][2]--;
-	}
-	return ok;
+	// Indices in OBJ files are 1-based
+	FaceFormatter fmt = { mesh, "f ", "", 1, write_norm };
+	return write_asc_records(f, mesh->faces.size(), fmt);
 }
 
 
@@ -1862,8 +5663,8 @@ static bool write_cc(TriMesh *mesh, FILE *f, const char *filename,
 	delete [] meshname;
 
 	FPRINTF(f, "\tstatic const float vertdata[][3] = {\n");
-	int nv = mesh->vertices.size(), nf = mesh->faces.size();
-	for (int i = 0; i < nv; i++) {
+	long long nv = mesh->vertices.size(), nf = mesh->faces.size();
+	for (long long i = 0; i < nv; i++) {
 		FPRINTF(f, "\t\t{ %.7g, %.7g, %.7g },\n",
 				mesh->vertices[i][0],
 				mesh->vertices[i][1],
@@ -1872,7 +5673,7 @@ static bool write_cc(TriMesh *mesh, FILE *f, const char *filename,
 	FPRINTF(f, "\t};\n");
 	if (write_norm) {
 		FPRINTF(f, "\tstatic const float normdata[][3] = {\n");
-		for (int i = 0; i < nv; i++) {
+		for (long long i = 0; i < nv; i++) {
 			FPRINTF(f, "\t\t{ %.7g, %.7g, %.7g },\n",
 					mesh->normals[i][0],
 					mesh->normals[i][1],
@@ -1882,7 +5683,7 @@ static bool write_cc(TriMesh *mesh, FILE *f, const char *filename,
 	}
 	if (!mesh->colors.empty() && float_color) {
 		FPRINTF(f, "\tstatic const float colordata[][3] = {\n");
-		for (int i = 0; i < nv; i++) {
+		for (long long i = 0; i < nv; i++) {
 			FPRINTF(f, "\t\t{ %.7g, %.7g, %.7g },\n",
 					mesh->colors[i][0],
 					mesh->colors[i][1],
@@ -1892,7 +5693,7 @@ static bool write_cc(TriMesh *mesh, FILE *f, const char *filename,
 	}
 	if (!mesh->colors.empty() && !float_color) {
 		FPRINTF(f, "\tstatic const unsigned char colordata[][3] = {\n");
-		for (int i = 0; i < nv; i++) {
+		for (long long i = 0; i < nv; i++) {
 			FPRINTF(f, "\t\t{ %d, %d, %d },\n",
 					color2uchar(mesh->colors[i][0]),
 					color2uchar(mesh->colors[i][1]),
@@ -1900,26 +5701,26 @@ static bool write_cc(TriMesh *mesh, FILE *f, const char *filename,
 		}
 		FPRINTF(f, "\t};\n");
 	}
-	FPRINTF(f, "\tstatic const int facedata[][3] = {\n");
-	for (int i = 0; i < nf; i++) {
-		FPRINTF(f, "\t\t{ %d, %d, %d },\n",
-				mesh->faces[i][0],
-				mesh->faces[i][1],
-				mesh->faces[i][2]);
+	FPRINTF(f, "\tstatic const trimesh::index_t facedata[][3] = {\n");
+	for (long long i = 0; i < nf; i++) {
+		FPRINTF(f, "\t\t{ %lld, %lld, %lld },\n",
+				(long long) mesh->faces[i][0],
+				(long long) mesh->faces[i][1],
+				(long long) mesh->faces[i][2]);
 	}
 	FPRINTF(f, "\t};\n");
 	FPRINTF(f, "\n\tTriMesh *m = new TriMesh;\n");
-	FPRINTF(f, "\tm->vertices.resize(%d);\n", nv);
+	FPRINTF(f, "\tm->vertices.resize(%lld);\n", nv);
 	FPRINTF(f, "\tstd::memcpy(&m->vertices[0][0], vertdata, sizeof(vertdata));\n");
 	if (!mesh->colors.empty()) {
-		FPRINTF(f, "\tm->colors.resize(%d);\n", nv);
+		FPRINTF(f, "\tm->colors.resize(%lld);\n", nv);
 		FPRINTF(f, "\tstd::memcpy(&m->colors[0][0], colordata, sizeof(colordata));\n");
 	}
 	if (write_norm) {
-		FPRINTF(f, "\tm->normals.resize(%d);\n", nv);
+		FPRINTF(f, "\tm->normals.resize(%lld);\n", nv);
 		FPRINTF(f, "\tstd::memcpy(&m->normals[0][0], normdata, sizeof(normdata));\n");
 	}
-	FPRINTF(f, "\tm->faces.resize(%d);\n", nf);
+	FPRINTF(f, "\tm->faces.resize(%lld);\n", nf);
 	FPRINTF(f, "\tstd::memcpy(&m->faces[0][0], facedata, sizeof(facedata));\n");
 	FPRINTF(f, "\n\treturn m;\n");
 	FPRINTF(f, "}\n");
@@ -1931,7 +5732,7 @@ static bool write_cc(TriMesh *mesh, FILE *f, const char *filename,
 static bool write_dae(TriMesh *mesh, FILE *f)
 {
 	mesh->need_faces();
-	int nv = mesh->vertices.size(), nf = mesh->faces.size();
+	long long nv = mesh->vertices.size(), nf = mesh->faces.size();
 
 	FPRINTF(f, "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n");
 	FPRINTF(f, "<COLLADA xmlns=\"http://www.collada.org/2005/11/COLLADASchema\" version=\"1.4.1\">\n");
@@ -1944,8 +5745,8 @@ static bool write_dae(TriMesh *mesh, FILE *f)
 	FPRINTF(f, " <geometry id=\"geom\">\n");
 	FPRINTF(f, "  <mesh>\n");
 	FPRINTF(f, "   <source id=\"v\">\n");
-	FPRINTF(f, "    <float_array id=\"coords\" count=\"%d\">\n", 3*nv);
-	for (int i = 0; i < nv; i++) {
+	FPRINTF(f, "    <float_array id=\"coords\" count=\"%lld\">\n", 3*nv);
+	for (long long i = 0; i < nv; i++) {
 		FPRINTF(f, "\t%.7g %.7g %.7g\n",
 			mesh->vertices[i][0],
 			mesh->vertices[i][1],
@@ -1953,7 +5754,7 @@ static bool write_dae(TriMesh *mesh, FILE *f)
 	}
 	FPRINTF(f, "    </float_array>\n");
 	FPRINTF(f, "    <technique_common>\n");
-	FPRINTF(f, "     <accessor count=\"%d\" source=\"#coords\" stride=\"3\">\n", nv);
+	FPRINTF(f, "     <accessor count=\"%lld\" source=\"#coords\" stride=\"3\">\n", nv);
 	FPRINTF(f, "      <param name=\"X\" type=\"float\"/>\n");
 	FPRINTF(f, "      <param name=\"Y\" type=\"float\"/>\n");
 	FPRINTF(f, "      <param name=\"Z\" type=\"float\"/>\n");
@@ -1963,14 +5764,14 @@ static bool write_dae(TriMesh *mesh, FILE *f)
 	FPRINTF(f, "   <vertices id=\"vv\">\n");
 	FPRINTF(f, "    <input semantic=\"POSITION\" source=\"#v\"/>\n");
 	FPRINTF(f, "   </vertices>\n");
-	FPRINTF(f, "   <triangles count=\"%d\">\n", nf);
+	FPRINTF(f, "   <triangles count=\"%lld\">\n", nf);
 	FPRINTF(f, "    <input offset=\"0\" semantic=\"VERTEX\" source=\"#vv\"/>\n");
 	FPRINTF(f, "    <p>\n");
-	for (int i = 0; i < nf; i++) {
-		FPRINTF(f, "\t%d %d %d\n",
-			mesh->faces[i][0],
-			mesh->faces[i][1],
-			mesh->faces[i][2]);
+	for (long long i = 0; i < nf; i++) {
+		FPRINTF(f, "\t%lld %lld %lld\n",
+			(long long) mesh->faces[i][0],
+			(long long) mesh->faces[i][1],
+			(long long) mesh->faces[i][2]);
 	}
 	FPRINTF(f, "    </p>\n");
 	FPRINTF(f, "   </triangles>\n");
@@ -2001,121 +5802,93 @@ static bool write_verts_asc(TriMesh *mesh, FILE *f,
 			    const char *before_conf,
 			    const char *after_line)
 {
-    for (size_t i = 0; i < mesh->vertices.size(); i++) {
-		FPRINTF(f, "%s%.7g %.7g %.7g", before_vert,
-				mesh->vertices[i][0],
-				mesh->vertices[i][1],
-				mesh->vertices[i][2]);
-		if (!mesh->normals.empty() && before_norm)
-			FPRINTF(f, "%s%.7g %.7g %.7g", before_norm,
-				mesh->normals[i][0],
-				mesh->normals[i][1],
-				mesh->normals[i][2]);
-		if (!mesh->colors.empty() && before_color && float_color)
-			FPRINTF(f, "%s%.7g %.7g %.7g", before_color,
-				mesh->colors[i][0],
-				mesh->colors[i][1],
-				mesh->colors[i][2]);
-		if (!mesh->colors.empty() && before_color && !float_color)
-			FPRINTF(f, "%s%d %d %d", before_color,
-				color2uchar(mesh->colors[i][0]),
-				color2uchar(mesh->colors[i][1]),
-				color2uchar(mesh->colors[i][2]));
-		if (!mesh->confidences.empty() && before_conf)
-			FPRINTF(f, "%s%.7g", before_conf, mesh->confidences[i]);
-		FPRINTF(f, "%s\n", after_line);
-	}
-	return true;
+	VertFormatter fmt = { mesh, before_vert, before_norm, before_color,
+			      before_conf, after_line, float_color };
+	return write_asc_records(f, mesh->vertices.size(), fmt);
 }
 
 
-// Byte-swap vertex properties
-static void swap_vert_props(TriMesh *mesh, bool swap_color)
+// Copy n floats to p, byte-swapping them if need_swap
+static inline unsigned char *put_floats(unsigned char *p, const float *x,
+	int n, bool need_swap)
 {
-	for (size_t i = 0; i < mesh->vertices.size(); i++) {
-		swap_float(mesh->vertices[i][0]);
-		swap_float(mesh->vertices[i][1]);
-		swap_float(mesh->vertices[i][2]);
-	}
-	if (!mesh->normals.empty()) {
-		for (size_t i = 0; i < mesh->normals.size(); i++) {
-			swap_float(mesh->normals[i][0]);
-			swap_float(mesh->normals[i][1]);
-			swap_float(mesh->normals[i][2]);
-		}
-	}
-	if (!mesh->colors.empty() && swap_color) {
-		for (size_t i = 0; i < mesh->normals.size(); i++) {
-			swap_float(mesh->colors[i][0]);
-			swap_float(mesh->colors[i][1]);
-			swap_float(mesh->colors[i][2]);
-		}
-	}
-	if (!mesh->confidences.empty()) {
-		for (size_t i = 0; i < mesh->confidences.size(); i++)
-			swap_float(mesh->confidences[i]);
-	}
+	memcpy(p, x, 4 * n);
+	if (need_swap)
+		for (int i = 0; i < n; i++)
+			swap_32(p + 4 * i);
+	return p + 4 * n;
 }
 
 
-// Helper for write_verts_bin: actually does the writing.
-static bool write_verts_bin_helper(TriMesh *mesh, FILE *f,
-				   bool write_norm, bool write_color,
-				   bool float_color, bool write_conf)
+#define VERT_WRITE_CHUNK 65536
+
+// Write a bunch of vertices to a binary file.  Unless there's nothing but
+// native-endian positions to write, the records are assembled in a buffer
+// (in parallel, a chunk at a time) and written in bulk.
+static bool write_verts_bin(TriMesh *mesh, FILE *f, bool need_swap,
+			    bool write_norm, bool write_color,
+			    bool float_color, bool write_conf,
+			    bool write_attribs)
 {
-	if ((mesh->normals.empty() || !write_norm) &&
-	    (mesh->colors.empty() || !write_color) &&
-	    (mesh->confidences.empty() || !write_conf)) {
+	int nv = mesh->vertices.size();
+	bool have_norm = write_norm && !mesh->normals.empty();
+	bool have_color = write_color && !mesh->colors.empty();
+	bool have_conf = write_conf && !mesh->confidences.empty();
+	std::vector<PlyChannel> channels;
+	std::vector<const float *> data;
+	if (write_attribs)
+		ply_write_channels(mesh, channels, data);
+	int nchannels = channels.size();
+	int len = 12 + (have_norm ? 12 : 0) +
+		(have_color ? (float_color ? 12 : 3) : 0) +
+		(have_conf ? 4 : 0);
+	for (int i = 0; i < nchannels; i++)
+		len += 4 * channels[i].ncomp;
+
+	if (len == 12 && !need_swap) {
 		// Optimized vertex-only code
-		FWRITE(&(mesh->vertices[0][0]), 12*mesh->vertices.size(), 1, f);
-	} else {
-		// Generic code
-		for (size_t i = 0; i < mesh->vertices.size(); i++) {
-			FWRITE(&(mesh->vertices[i][0]), 12, 1, f);
-			if (!mesh->normals.empty() && write_norm)
-				FWRITE(&(mesh->normals[i][0]), 12, 1, f);
-			if (!mesh->colors.empty() && write_color && float_color)
-				FWRITE(&(mesh->colors[i][0]), 12, 1, f);
-			if (!mesh->colors.empty() && write_color && !float_color) {
-				char c[3] = {
-					color2uchar(mesh->colors[i][0]),
-					color2uchar(mesh->colors[i][1]),
-					color2uchar(mesh->colors[i][2]) };
-				FWRITE(&c, 3, 1, f);
+		FWRITE(&(mesh->vertices[0][0]), 12*nv, 1, f);
+		return true;
+	}
+
+	std::vector<unsigned char> buf(size_t(len) * std::min(nv, VERT_WRITE_CHUNK));
+	for (int first = 0; first < nv; first += VERT_WRITE_CHUNK) {
+		int n = std::min(nv - first, VERT_WRITE_CHUNK);
+#pragma omp parallel for
+		for (int j = 0; j < n; j++) {
+			int i = first + j;
+			unsigned char *p = &buf[size_t(j) * len];
+			p = put_floats(p, mesh->vertices[i], 3, need_swap);
+			if (have_norm)
+				p = put_floats(p, mesh->normals[i], 3, need_swap);
+			if (have_color && float_color)
+				p = put_floats(p, mesh->colors[i], 3, need_swap);
+			if (have_color && !float_color) {
+				*p++ = color2uchar(mesh->colors[i][0]);
+				*p++ = color2uchar(mesh->colors[i][1]);
+				*p++ = color2uchar(mesh->colors[i][2]);
+			}
+			if (have_conf)
+				p = put_floats(p, &mesh->confidences[i], 1, need_swap);
+			for (int k = 0; k < nchannels; k++) {
+				int ncomp = channels[k].ncomp;
+				p = put_floats(p, data[k] + size_t(i) * ncomp,
+					       ncomp, need_swap);
 			}
-			if (!mesh->confidences.empty() && write_conf)
-				FWRITE(&(mesh->confidences[i]), 4, 1, f);
 		}
+		FWRITE(&buf[0], size_t(n) * len, 1, f);
 	}
 	return true;
 }
 
 
-// Write a bunch of vertices to a binary file
-static bool write_verts_bin(TriMesh *mesh, FILE *f, bool need_swap,
-			    bool write_norm, bool write_color,
-			    bool float_color, bool write_conf)
-{
-	if (need_swap)
-		swap_vert_props(mesh, float_color);
-	bool ok = write_verts_bin_helper(mesh, f, write_norm, write_color,
-		float_color, write_conf);
-	if (need_swap)
-		swap_vert_props(mesh, float_color);
-	return ok;
-}
-
-
 // Write a bunch of faces to an ASCII file
 static bool write_faces_asc(TriMesh *mesh, FILE *f,
 			    const char *before_face, const char *after_line)
 {
 	mesh->need_faces();
-	for (size_t i = 0; i < mesh->faces.size(); i++) {
-		FPRINTF(f, "%s%d %d %d%s\n", before_face, mesh->faces[i][0],
-			mesh->faces[i][1], mesh->faces[i][2], after_line);
-	}
-	return true;
+	FaceFormatter fmt = { mesh, before_face, after_line, 0, false };
+	return write_asc_records(f, mesh->faces.size(), fmt);
 }
 
 
@@ -2125,50 +5898,30 @@ static bool write_faces_bin(TriMesh *mesh, FILE *f, bool need_swap,
 			    int after_face_len, const char *after_face)
 {
 	mesh->need_faces();
-	if (need_swap) {
-		for (size_t i = 0; i < mesh->faces.size(); i++) {
-			swap_int(mesh->faces[i][0]);
-			swap_int(mesh->faces[i][1]);
-			swap_int(mesh->faces[i][2]);
-		}
-	}
-	bool ok = true;
 	for (size_t i = 0; i < mesh->faces.size(); i++) {
-		if (before_face_len) {
-			if (fwrite(before_face, before_face_len, 1, f) != 1) {
-				ok = false;
-				goto out;
-			}
-		}
-		if (fwrite(&(mesh->faces[i][0]), 12, 1, f) != 1) {
-			ok = false;
-			goto out;
-		}
-		if (after_face_len) {
-			if (fwrite(after_face, after_face_len, 1, f) != 1) {
-				ok = false;
-				goto out;
-			}
-		}
-	}
-out:
-	if (need_swap) {
-		for (size_t i = 0; i < mesh->faces.size(); i++) {
-			swap_int(mesh->faces[i][0]);
-			swap_int(mesh->faces[i][1]);
-			swap_int(mesh->faces[i][2]);
+		if (before_face_len)
+			FWRITE(before_face, before_face_len, 1, f);
+		int ind[3] = { int(mesh->faces[i][0]), int(mesh->faces[i][1]),
+			       int(mesh->faces[i][2]) };
+		if (need_swap) {
+			swap_int(ind[0]);
+			swap_int(ind[1]);
+			swap_int(ind[2]);
 		}
+		FWRITE(ind, 12, 1, f);
+		if (after_face_len)
+			FWRITE(after_face, after_face_len, 1, f);
 	}
-	return ok;
+	return true;
 }
 
 
 // Write tstrips to an ASCII file
 static bool write_strips_asc(TriMesh *mesh, FILE *f)
 {
-	for (size_t i = 0; i < mesh->tstrips.size(); i++) {
-		FPRINTF(f, "%d ", mesh->tstrips[i]);
-	}
+	StripFormatter fmt = { mesh };
+	if (!write_asc_records(f, mesh->tstrips.size(), fmt))
+		return false;
 	FPRINTF(f, "\n");
 	return true;
 }
@@ -2193,14 +5946,8 @@ static bool write_strips_bin(TriMesh *mesh, FILE *f, bool need_swap)
 // Write range grid to an ASCII file
 static bool write_grid_asc(TriMesh *mesh, FILE *f)
 {
-	for (size_t i = 0; i < mesh->grid.size(); i++) {
-		if (mesh->grid[i] < 0) {
-			FPRINTF(f, "0\n");
-		} else {
-			FPRINTF(f, "1 %d\n", mesh->grid[i]);
-		}
-	}
-	return true;
+	GridFormatter fmt = { mesh };
+	return write_asc_records(f, mesh->grid.size(), fmt);
 }
 
 
@@ -0,0 +1,158 @@
+/*
+Szymon Rusinkiewicz
+Princeton University
+
+TriMesh_memory.cc
+Memory accounting and management: clearing, releasing computed
+properties, shrinking, swapping, and the hooks that computed arrays
+get their memory from.
+*/
+
+#include "TriMesh.h"
+#include "mempool.h"
+
+namespace trimesh {
+
+
+// The arrays in a TriMesh: those read from files or set by the user, and
+// those that the need_* functions can recompute
+#define TRIMESH_INPUT_ARRAYS(X) \
+	X(vertices) X(faces) X(tstrips) X(grid) \
+	X(colors) X(confidences) X(flags) X(normals) \
+	X(compact.pos) X(compact.norms) X(channels)
+
+#define TRIMESH_DERIVED_ARRAYS(X) \
+	X(pdir1) X(pdir2) X(curv1) X(curv2) X(dcurv) \
+	X(cornerareas) X(pointareas) \
+	X(neighbors) X(adjacentfaces) X(across_edge) \
+	X(corner_opposite) X(vertex_corner) \
+	X(tightpacked_faces) X(edgelengths) X(faceareas)
+
+
+// Bytes allocated for an array
+template <class T, class A>
+static inline size_t bytes(const SharedArray<T, A> &v)
+{
+	return v.capacity() * sizeof(T);
+}
+
+static inline size_t bytes(const AdjList &a)
+{
+	return a.memory_usage();
+}
+
+static inline size_t bytes(const std::vector<TriMesh::Channel> &c)
+{
+	size_t b = c.capacity() * sizeof(TriMesh::Channel);
+	for (size_t i = 0; i < c.size(); i++)
+		b += c[i].name.capacity() + bytes(c[i].values);
+	return b;
+}
+
+
+// Let go of an array's memory
+template <class T, class A>
+static inline void release(SharedArray<T, A> &v)
+{
+	SharedArray<T, A>().swap(v);
+}
+
+static inline void release(AdjList &a)
+{
+	a.clear();
+}
+
+
+// Give back an array's memory beyond its size
+template <class T, class A>
+static inline void shrink_array(SharedArray<T, A> &v)
+{
+	v.shrink_to_fit();
+}
+
+static inline void shrink_array(AdjList &a)
+{
+	a.shrink();
+}
+
+static inline void shrink_array(std::vector<TriMesh::Channel> &c)
+{
+	for (size_t i = 0; i < c.size(); i++)
+		c[i].values.shrink_to_fit();
+}
+
+
+// Where HookAlloc gets memory from (see mempool.h).  Setting just one of
+// the two hooks isn't allowed, and is the same as setting neither.
+void *(*array_alloc_hook)(size_t) = 0;
+void (*array_free_hook)(void *, size_t) = 0;
+
+void set_array_alloc_hooks(void *(*alloc)(size_t),
+	void (*free)(void *, size_t))
+{
+	if (alloc && free) {
+		array_alloc_hook = alloc;
+		array_free_hook = free;
+	} else {
+		array_alloc_hook = 0;
+		array_free_hook = 0;
+	}
+}
+
+
+// Delete everything, giving the memory back
+void TriMesh::clear()
+{
+	*this = TriMesh();
+}
+
+
+// Total bytes allocated for the mesh, and optionally how much by each member
+size_t TriMesh::memory_usage(std::vector<MemoryItem> *breakdown /* = 0 */) const
+{
+	size_t total = sizeof(*this);
+
+#define MEMBER(name) do { \
+		size_t b = bytes(name); \
+		total += b; \
+		if (breakdown && b) \
+			breakdown->push_back(MemoryItem(#name, b)); \
+	} while (0);
+
+	TRIMESH_INPUT_ARRAYS(MEMBER)
+	TRIMESH_DERIVED_ARRAYS(MEMBER)
+
+#undef MEMBER
+	return total;
+}
+
+
+// Free the properties that need_* can recompute (other than normals)
+void TriMesh::release_derived()
+{
+#define RELEASE(name) release(name);
+	TRIMESH_DERIVED_ARRAYS(RELEASE)
+#undef RELEASE
+	nonmanifold_edges = flipped_edges = 0;
+}
+
+
+// Give back memory that arrays have reserved beyond their sizes
+void TriMesh::shrink()
+{
+#define SHRINK(name) shrink_array(name);
+	TRIMESH_INPUT_ARRAYS(SHRINK)
+	TRIMESH_DERIVED_ARRAYS(SHRINK)
+#undef SHRINK
+}
+
+
+// Exchange the contents of two meshes.  Each copy here just shares arrays.
+void TriMesh::swap(TriMesh &m)
+{
+	TriMesh tmp(m);
+	m = *this;
+	*this = tmp;
+}
+
+} // end namespace trimesh
@@ -20,68 +20,70 @@ For raw point clouds, fits plane to k nearest neighbors.
 namespace trimesh {
 
 
-void TriMesh::recompute_normals_tightpacked()
-// recompute normals and stored in tightly packed data
+// The normal of face f (scaled by twice its area), and the weight of its
+// contribution to the normal at each corner's vertex: the inverse squared
+// lengths of the two edges at that corner.  Returns false for a face with
+// a zero-length edge, which contributes nothing.
+static inline bool face_normal(const TriMesh *mesh, const TriMesh::Face &f,
+	vec &facenormal, float w[3])
 {
-	// Nothing to do if we already have normals
-	need_faces();
-	int nv = vertices.size();
+	const point &p0 = mesh->vertices[f[0]];
+	const point &p1 = mesh->vertices[f[1]];
+	const point &p2 = mesh->vertices[f[2]];
+	vec a = p0-p1, b = p1-p2, c = p2-p0;
+	float l2a = len2(a), l2b = len2(b), l2c = len2(c);
+	if (!l2a || !l2b || !l2c)
+		return false;
+	facenormal = a CROSS b;
+	w[0] = 1.0f / (l2a * l2c);
+	w[1] = 1.0f / (l2b * l2a);
+	w[2] = 1.0f / (l2c * l2b);
+	return true;
+}
 
-	//dprintf("Recomputing normals... ");
-#pragma omp parallel for
-	for (int i=0; i< 3*nv; ++i) normals_tightpacked[i] = 0.f;
-	// TODO: direct handling of grids
-	{
-		// Compute from faces
-		int nf = faces.size();
-		  
-#pragma omp parallel for
-		for (int i = 0; i < nf; i++) {
-		  const int i0 = faces[i][0] * 3;
-		  const int i1 = faces[i][1] * 3;
-		  const int i2 = faces[i][2] * 3;
-		  const float* p0 = vertices_tightpacked + i0;
-		  const float* p1 = vertices_tightpacked + i1;
-		  const float* p2 = vertices_tightpacked + i2;
-		  float a[3] = {p0[0] - p1[0], p0[1] - p1[1], p0[2] - p1[2]};
-		  float b[3] = {p1[0] - p2[0], p1[1] - p2[1], p1[2] - p2[2]};
-		  float c[3] = {p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2]};
-				    
-		  float l2a = std::sqrt(a[0]*a[0] + a[1]*a[1] + a[2]*a[2]), l2b = std::sqrt(b[0]*b[0] + b[1]*b[1] + b[2]*b[2]), l2c = std::sqrt(c[0]*c[0] + c[1]*c[1] + c[2]*c[2]);
-		  
-		  if (!l2a || !l2b || !l2c)
-		    continue;
-		  float facenormal[3] = {a[1]*b[2] - a[2]*b[1], a[2]*b[0] - a[0]*b[2], a[0]*b[1] - a[1]*b[0]};
-		  normals_tightpacked[i0    ] += facenormal[0] * (1.0f / (l2a * l2c));
-		  normals_tightpacked[i0 + 1] += facenormal[1] * (1.0f / (l2a * l2c));
-		  normals_tightpacked[i0 + 2] += facenormal[2] * (1.0f / (l2a * l2c));
-		  
-		  normals_tightpacked[i1    ] += facenormal[0] * (1.0f / (l2b * l2a));
-		  normals_tightpacked[i1 + 1] += facenormal[1] * (1.0f / (l2b * l2a));
-		  normals_tightpacked[i1 + 2] += facenormal[2] * (1.0f / (l2b * l2a));
-		  
-		  normals_tightpacked[i2    ] += facenormal[0] * (1.0f / (l2c * l2b));
-		  normals_tightpacked[i2 + 1] += facenormal[1] * (1.0f / (l2c * l2b));
-		  normals_tightpacked[i2 + 2] += facenormal[2] * (1.0f / (l2c * l2b));
-		}
-	} 
 
-	// Make them all unit-length
-#pragma omp parallel for
-        for (int i = 0; i < 3*nv; i+=3) {
-	  float n = std::sqrt(normals_tightpacked[i]*normals_tightpacked[i] + normals_tightpacked[i+1]*normals_tightpacked[i+1] + normals_tightpacked[i+2]*normals_tightpacked[i+2]);
-	  normals_tightpacked[i  ] /=n;
-	  normals_tightpacked[i+1] /=n;
-	  normals_tightpacked[i+2] /=n;
+// The (unnormalized) normal at vertex v: the sum of the weighted normals
+// of its faces.  Gathering this per vertex, in order of face index, gives
+// the same result regardless of the number of threads.
+static inline vec vertex_normal(const TriMesh *mesh, ptrdiff_t v)
+{
+	vec norm;
+	AdjList::Range a = mesh->adjacentfaces[v];
+	for (size_t k = 0; k < a.size(); k++) {
+		const TriMesh::Face &f = mesh->faces[a[k]];
+		vec facenormal;
+		float w[3];
+		if (!face_normal(mesh, f, facenormal, w))
+			continue;
+		for (int j = 0; j < 3; j++)
+			if (f[j] == v)
+				norm += facenormal * w[j];
 	}
-	//	dprintf("Done.\n");
+	return norm;
 }
+
+
+// Recompute normals, even if they look up to date, e.g. after vertices
+// were changed in place without calling geometry_changed()
+void TriMesh::recompute_normals_tightpacked()
+{
+	normals.clear();
+	need_normals();
+}
+
+
 // Compute per-vertex normals
 void TriMesh::need_normals()
 {
-	// Nothing to do if we already have normals
-	int nv = vertices.size();
-	if (int(normals.size()) == nv)
+	// Compact meshes have encoded normals (see TriMesh_compact.cc)
+	if (is_compact()) {
+		need_compact_normals();
+		return;
+	}
+
+	// Nothing to do if we already have up-to-date normals
+	ptrdiff_t nv = vertices.size();
+	if (ptrdiff_t(normals.size()) == nv && is_current(normals_gen))
 		return;
 
 	dprintf("Computing normals... ");
@@ -110,35 +112,40 @@ void TriMesh::need_normals()
 				normals[* t   ] += facenormal * (1.0f / (l2c * l2b));
 			}
 		}
-	} else if (need_faces(), !faces.empty()) {
-		// Compute from faces
-		int nf = faces.size();
-#pragma omp parallel for
-		for (int i = 0; i < nf; i++) {
-			const point &p0 = vertices[faces[i][0]];
-			const point &p1 = vertices[faces[i][1]];
-			const point &p2 = vertices[faces[i][2]];
-			vec a = p0-p1, b = p1-p2, c = p2-p0;
-			float l2a = len2(a), l2b = len2(b), l2c = len2(c);
-			if (!l2a || !l2b || !l2c)
+	} else if (need_faces(), !faces.empty() && one_thread()) {
+		// Compute from faces, adding up the same values in the same
+		// order as vertex_normal, but without needing adjacentfaces
+		ptrdiff_t nf = faces.size();
+		const TriMesh *mesh = this;
+		std::vector<vec> &n = normals;
+		for (ptrdiff_t i = 0; i < nf; i++) {
+			const Face &f = mesh->faces[i];
+			vec facenormal;
+			float w[3];
+			if (!face_normal(mesh, f, facenormal, w))
 				continue;
-			vec facenormal = a CROSS b;
-			normals[faces[i][0]] += facenormal * (1.0f / (l2a * l2c));
-			normals[faces[i][1]] += facenormal * (1.0f / (l2b * l2a));
-			normals[faces[i][2]] += facenormal * (1.0f / (l2c * l2b));
+			for (int j = 0; j < 3; j++)
+				n[f[j]] += facenormal * w[j];
 		}
+	} else if (!faces.empty()) {
+		// Compute from faces
+		need_adjacentfaces();
+#pragma omp parallel for
+		for (ptrdiff_t i = 0; i < nv; i++)
+			normals[i] = vertex_normal(this, i);
 	} else {
 		// Find normals of a point cloud
 		const int k = 6;
 		const vec ref(0, 0, 1);
 		KDtree kd(vertices);
 #pragma omp parallel for
-		for (int i = 0; i < nv; i++) {
+		for (ptrdiff_t i = 0; i < nv; i++) {
 			std::vector<const float *> knn;
 			kd.find_k_closest_to_pt(knn, k, vertices[i]);
 			int actual_k = knn.size();
 			if (actual_k < 3) {
-				dprintf("Warning: not enough points for vertex %d\n", i);
+				dprintf("Warning: not enough points for vertex %lld\n",
+					(long long) i);
 				normals[i] = ref;
 				continue;
 			}
@@ -160,12 +167,38 @@ void TriMesh::need_normals()
 		}
 	}
 
-	// Make them all unit-length
-#pragma omp parallel for
-	for (int i = 0; i < nv; i++)
+	// Make them all unit-length.  Fixed-size chunks keep each
+	// vertex on the same (vectorized or not) code path for any
+	// number of threads.
+#pragma omp parallel for schedule(static, 4096)
+	for (ptrdiff_t i = 0; i < nv; i++)
 		normalize(normals[i]);
 
+	normals_gen = generation;
 	dprintf("Done.\n");
 }
 
+
+// Recompute the normals at just the given vertices, from their adjacent
+// faces.  Used by vertices_moved().
+void TriMesh::update_normals(const std::vector<index_t> &verts)
+{
+	ptrdiff_t nv = vertices.size();
+	if ((ptrdiff_t) normals.size() != nv)
+		return;
+	need_adjacentfaces();
+	if (adjacentfaces.empty())
+		return;
+
+	ptrdiff_t n = verts.size();
+#pragma omp parallel for schedule(dynamic, 256)
+	for (ptrdiff_t i = 0; i < n; i++) {
+		index_t v = verts[i];
+		if (v < 0 || v >= nv)
+			continue;
+		normals[v] = vertex_normal(this, v);
+		normalize(normals[v]);
+	}
+}
+
 } // end namespace trimesh
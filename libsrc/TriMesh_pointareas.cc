@@ -9,102 +9,240 @@ a vertex, or to the triangle).
 */
 
 #include "TriMesh.h"
+#include <algorithm>
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
 namespace trimesh {
 
 
+// Compute the areas of the corners of face i: the parts of the face's area
+// assigned to each of its vertices.
+static void corner_areas(const TriMesh *mesh, ptrdiff_t i, vec &ca)
+{
+	// Edges
+	const TriMesh::Face &f = mesh->faces[i];
+	vec e[3] = { mesh->vertices[f[2]] - mesh->vertices[f[1]],
+		     mesh->vertices[f[0]] - mesh->vertices[f[2]],
+		     mesh->vertices[f[1]] - mesh->vertices[f[0]] };
+
+	// Compute corner weights
+	float area = 0.5f * len(e[0] CROSS e[1]);
+	float l2[3] = { len2(e[0]), len2(e[1]), len2(e[2]) };
+	float ew[3] = { l2[0] * (l2[1] + l2[2] - l2[0]),
+			l2[1] * (l2[2] + l2[0] - l2[1]),
+			l2[2] * (l2[0] + l2[1] - l2[2]) };
+	if (ew[0] <= 0.0f) {
+		ca[1] = -0.25f * l2[2] * area / (e[0] DOT e[2]);
+		ca[2] = -0.25f * l2[1] * area / (e[0] DOT e[1]);
+		ca[0] = area - ca[1] - ca[2];
+	} else if (ew[1] <= 0.0f) {
+		ca[2] = -0.25f * l2[0] * area / (e[1] DOT e[0]);
+		ca[0] = -0.25f * l2[2] * area / (e[1] DOT e[2]);
+		ca[1] = area - ca[2] - ca[0];
+	} else if (ew[2] <= 0.0f) {
+		ca[0] = -0.25f * l2[1] * area / (e[2] DOT e[1]);
+		ca[1] = -0.25f * l2[0] * area / (e[2] DOT e[0]);
+		ca[2] = area - ca[0] - ca[1];
+	} else {
+		float ewscale = 0.5f * area / (ew[0] + ew[1] + ew[2]);
+		for (int j = 0; j < 3; j++)
+			ca[j] = ewscale * (ew[(j+1)%3] + ew[(j+2)%3]);
+	}
+}
+
+
 // Compute per-vertex point areas
 void TriMesh::need_pointareas()
 {
-	if (pointareas.size() == vertices.size())
+	need_vertices();
+	if (pointareas.size() == vertices.size() &&
+	    is_current(pointareas_gen))
 		return;
 	need_faces();
 
 	dprintf("Computing point areas... ");
 
-	int nf = faces.size(), nv = vertices.size();
+	ptrdiff_t nf = faces.size(), nv = vertices.size();
 	pointareas.clear();
 	pointareas.resize(nv);
 	cornerareas.clear();
 	cornerareas.resize(nf);
 
+	std::vector<vec> &ca = cornerareas;
 #pragma omp parallel for
-	for (int i = 0; i < nf; i++) {
-		// Edges
-		vec e[3] = { vertices[faces[i][2]] - vertices[faces[i][1]],
-			     vertices[faces[i][0]] - vertices[faces[i][2]],
-			     vertices[faces[i][1]] - vertices[faces[i][0]] };
-
-		// Compute corner weights
-		float area = 0.5f * len(e[0] CROSS e[1]);
-		float l2[3] = { len2(e[0]), len2(e[1]), len2(e[2]) };
-		float ew[3] = { l2[0] * (l2[1] + l2[2] - l2[0]),
-				l2[1] * (l2[2] + l2[0] - l2[1]),
-				l2[2] * (l2[0] + l2[1] - l2[2]) };
-		if (ew[0] <= 0.0f) {
-			cornerareas[i][1] = -0.25f * l2[2] * area /
-					    (e[0] DOT e[2]);
-			cornerareas[i][2] = -0.25f * l2[1] * area /
-					    (e[0] DOT e[1]);
-			cornerareas[i][0] = area - cornerareas[i][1] -
-					    cornerareas[i][2];
-		} else if (ew[1] <= 0.0f) {
-			cornerareas[i][2] = -0.25f * l2[0] * area /
-					    (e[1] DOT e[0]);
-			cornerareas[i][0] = -0.25f * l2[2] * area /
-					    (e[1] DOT e[2]);
-			cornerareas[i][1] = area - cornerareas[i][2] -
-					    cornerareas[i][0];
-		} else if (ew[2] <= 0.0f) {
-			cornerareas[i][0] = -0.25f * l2[1] * area /
-					    (e[2] DOT e[1]);
-			cornerareas[i][1] = -0.25f * l2[0] * area /
-					    (e[2] DOT e[0]);
-			cornerareas[i][2] = area - cornerareas[i][0] -
-					    cornerareas[i][1];
-		} else {
-			float ewscale = 0.5f * area / (ew[0] + ew[1] + ew[2]);
-			for (int j = 0; j < 3; j++)
-				cornerareas[i][j] = ewscale * (ew[(j+1)%3] +
-							       ew[(j+2)%3]);
-		}
-#pragma omp atomic
-		pointareas[faces[i][0]] += cornerareas[i][0];
-#pragma omp atomic
-		pointareas[faces[i][1]] += cornerareas[i][1];
-#pragma omp atomic
-		pointareas[faces[i][2]] += cornerareas[i][2];
-	}
+	for (ptrdiff_t i = 0; i < nf; i++)
+		corner_areas(this, i, ca[i]);
+	if (nf)
+		sum_corners(&ca[0][0], &pointareas[0]);
 
+	pointareas_gen = generation;
 	dprintf("Done.\n");
 }
 
-  void TriMesh::need_edgelengths(){
-    if (!edgelengths.empty())
-      return;
 
-    int nf = faces.size(); int nv = vertices.size();
-    
-    edgelengths.resize(nf, std::vector<float>(3));
+// Recompute the point areas at just the given vertices, and the corner
+// areas of all the faces touching them.  Used by vertices_moved().
+void TriMesh::update_pointareas(const std::vector<index_t> &verts)
+{
+	ptrdiff_t nv = vertices.size(), nf = faces.size();
+	if ((ptrdiff_t) pointareas.size() != nv ||
+	    (ptrdiff_t) cornerareas.size() != nf)
+		return;
+	need_adjacentfaces();
+	if (adjacentfaces.empty())
+		return;
 
+	std::vector<index_t> touched;
+	for (size_t i = 0; i < verts.size(); i++) {
+		index_t v = verts[i];
+		if (v >= 0 && v < nv)
+			touched.insert(touched.end(), adjacentfaces[v].begin(),
+				       adjacentfaces[v].end());
+	}
+	std::sort(touched.begin(), touched.end());
+	touched.erase(std::unique(touched.begin(), touched.end()),
+		      touched.end());
+
+	ptrdiff_t nt = touched.size();
 #pragma omp parallel for
-    for (int i=0; i<nf; ++i)
-      for (int j=0; j<3; ++j) {
-	edgelengths[i][j] = len(vertices[faces[i][(j+1)%3]] - vertices[faces[i][(j+2)%3]]);
-      }
-  }
-
-  void TriMesh::need_faceareas(){
-    if (faceareas.size() == faces.size()) 
-      return;
-    int nf = faces.size();
-    faceareas.resize(nf);
+	for (ptrdiff_t i = 0; i < nt; i++)
+		corner_areas(this, touched[i], cornerareas[touched[i]]);
+
+	ptrdiff_t n = verts.size();
+#pragma omp parallel for schedule(dynamic, 256)
+	for (ptrdiff_t i = 0; i < n; i++) {
+		index_t v = verts[i];
+		if (v < 0 || v >= nv)
+			continue;
+		float area = 0.0f;
+		AdjList::Range a = adjacentfaces[v];
+		for (size_t k = 0; k < a.size(); k++)
+			for (int j = 0; j < 3; j++)
+				if (faces[a[k]][j] == v)
+					area += cornerareas[a[k]][j];
+		pointareas[v] = area;
+	}
+}
+
+// Edge lengths and/or areas of faces [first, last).  Edge j of a face is
+// the one opposite vertex j.  With SSE2, four faces are done at a time,
+// gathered into one lane each.
+static void face_metrics(const TriMesh *mesh, ptrdiff_t first,
+	ptrdiff_t last, vec *edgelengths, float *faceareas)
+{
+	const point *v = &mesh->vertices[0];
+	const TriMesh::Face *f = &mesh->faces[0];
+	ptrdiff_t i = first;
+#ifdef __SSE2__
+	const __m128 half = _mm_set1_ps(0.5f);
+	for ( ; i + 4 <= last; i += 4) {
+		const point &a0 = v[f[i][0]], &a1 = v[f[i+1][0]],
+			&a2 = v[f[i+2][0]], &a3 = v[f[i+3][0]];
+		const point &b0 = v[f[i][1]], &b1 = v[f[i+1][1]],
+			&b2 = v[f[i+2][1]], &b3 = v[f[i+3][1]];
+		const point &c0 = v[f[i][2]], &c1 = v[f[i+1][2]],
+			&c2 = v[f[i+2][2]], &c3 = v[f[i+3][2]];
+		__m128 p[3][3];
+		for (int k = 0; k < 3; k++) {
+			p[0][k] = _mm_setr_ps(a0[k], a1[k], a2[k], a3[k]);
+			p[1][k] = _mm_setr_ps(b0[k], b1[k], b2[k], b3[k]);
+			p[2][k] = _mm_setr_ps(c0[k], c1[k], c2[k], c3[k]);
+		}
+
+		// e[j] is the edge opposite vertex j
+		__m128 e[3][3];
+		for (int k = 0; k < 3; k++) {
+			e[0][k] = _mm_sub_ps(p[1][k], p[2][k]);
+			e[1][k] = _mm_sub_ps(p[2][k], p[0][k]);
+			e[2][k] = _mm_sub_ps(p[0][k], p[1][k]);
+		}
+		if (edgelengths) {
+			float l[3][4];
+			for (int j = 0; j < 3; j++)
+				_mm_storeu_ps(l[j], _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(
+					_mm_mul_ps(e[j][0], e[j][0]),
+					_mm_mul_ps(e[j][1], e[j][1])),
+					_mm_mul_ps(e[j][2], e[j][2]))));
+			for (int k = 0; k < 4; k++)
+				edgelengths[i+k] = vec(l[0][k], l[1][k], l[2][k]);
+		}
+		if (faceareas) {
+			// Half the length of e[0] x e[1]
+			__m128 nx = _mm_sub_ps(_mm_mul_ps(e[0][1], e[1][2]),
+				_mm_mul_ps(e[0][2], e[1][1]));
+			__m128 ny = _mm_sub_ps(_mm_mul_ps(e[0][2], e[1][0]),
+				_mm_mul_ps(e[0][0], e[1][2]));
+			__m128 nz = _mm_sub_ps(_mm_mul_ps(e[0][0], e[1][1]),
+				_mm_mul_ps(e[0][1], e[1][0]));
+			_mm_storeu_ps(faceareas + i, _mm_mul_ps(half, _mm_sqrt_ps(
+				_mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx),
+				_mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz)))));
+		}
+	}
+#endif
+	for ( ; i < last; i++) {
+		const point &p0 = v[f[i][0]], &p1 = v[f[i][1]], &p2 = v[f[i][2]];
+		vec e[3] = { p1 - p2, p2 - p0, p0 - p1 };
+		if (edgelengths)
+			edgelengths[i] = vec(len(e[0]), len(e[1]), len(e[2]));
+		if (faceareas)
+			faceareas[i] = 0.5f * len(e[0] CROSS e[1]);
+	}
+}
 
+
+// Run face_metrics over all the faces, in parallel blocks
+static void sweep_face_metrics(const TriMesh *mesh, vec *edgelengths,
+	float *faceareas)
+{
+	const ptrdiff_t block = 4096;
+	ptrdiff_t nf = mesh->faces.size();
+	ptrdiff_t nblocks = (nf + block - 1) / block;
 #pragma omp parallel for
-    for (int i=0; i<nf; ++i) {
-      vec e[2] = { vertices[faces[i][2]] - vertices[faces[i][1]],
-		   vertices[faces[i][0]] - vertices[faces[i][2]] };
-      faceareas[i] = .5f * len(e[0] CROSS e[1]);
-    }
-  }
+	for (ptrdiff_t b = 0; b < nblocks; b++)
+		face_metrics(mesh, b * block, std::min(nf, (b + 1) * block),
+			edgelengths, faceareas);
+}
+
+
+// Compute and store the edge lengths of each face: edgelengths[i][j] is the
+// length of the edge opposite vertex j of face i.  The face areas are found
+// in the same sweep if they are not up to date as well.
+void TriMesh::need_edgelengths()
+{
+	if (edgelengths.size() == faces.size() && is_current(edgelengths_gen))
+		return;
+	need_vertices();
+	need_faces();
+	ptrdiff_t nf = faces.size();
+	bool areas = !(faceareas.size() == faces.size() &&
+		is_current(faceareas_gen));
+
+	edgelengths.resize(nf);
+	if (areas)
+		faceareas.resize(nf);
+	if (nf)
+		sweep_face_metrics(this, &edgelengths[0], areas ? &faceareas[0] : 0);
+	edgelengths_gen = generation;
+	if (areas)
+		faceareas_gen = generation;
+}
+
+
+// Compute and store the area of each face
+void TriMesh::need_faceareas()
+{
+	if (faceareas.size() == faces.size() && is_current(faceareas_gen))
+		return;
+	need_vertices();
+	need_faces();
+	ptrdiff_t nf = faces.size();
+
+	faceareas.resize(nf);
+	if (nf)
+		sweep_face_metrics(this, 0, &faceareas[0]);
+	faceareas_gen = generation;
+}
 
 } // end namespace trimesh
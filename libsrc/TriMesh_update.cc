@@ -0,0 +1,92 @@
+/*
+Szymon Rusinkiewicz
+Princeton University
+
+TriMesh_update.cc
+Incremental update of computed properties after moving a few vertices.
+*/
+
+#include "TriMesh.h"
+#include <algorithm>
+
+namespace trimesh {
+
+
+// The given vertices together with all their neighbors (through faces),
+// sorted and without duplicates
+static void grow_ring(const TriMesh *mesh,
+	const std::vector<index_t> &verts, std::vector<index_t> &ring)
+{
+	ptrdiff_t nv = mesh->vertices.size();
+	ring.clear();
+	for (size_t i = 0; i < verts.size(); i++) {
+		index_t v = verts[i];
+		if (v < 0 || v >= nv)
+			continue;
+		ring.push_back(v);
+		AdjList::Range a = mesh->adjacentfaces[v];
+		for (size_t k = 0; k < a.size(); k++) {
+			const TriMesh::Face &f = mesh->faces[a[k]];
+			ring.push_back(f[0]);
+			ring.push_back(f[1]);
+			ring.push_back(f[2]);
+		}
+	}
+	std::sort(ring.begin(), ring.end());
+	ring.erase(std::unique(ring.begin(), ring.end()), ring.end());
+}
+
+
+// Update normals, point areas, and curvatures after moving the given
+// vertices.  Moving a vertex changes the corner areas and normal weights
+// of its faces, hence normals and point areas throughout its 1-ring.
+// Curvatures depend on the normals of each adjacent face's vertices, so
+// they change throughout the 2-ring, and dcurv, which depends on the
+// curvatures of each adjacent face's vertices, throughout the 3-ring.
+void TriMesh::vertices_moved(const std::vector<index_t> &moved)
+{
+	size_t nv = vertices.size(), nf = faces.size();
+	bool have_normals = (normals.size() == nv && is_current(normals_gen));
+	bool have_pointareas = (pointareas.size() == nv &&
+		cornerareas.size() == nf && is_current(pointareas_gen));
+	bool have_curv = have_normals && have_pointareas &&
+		curv1.size() == nv && curv2.size() == nv &&
+		pdir1.size() == nv && pdir2.size() == nv &&
+		is_current(curv_gen);
+	bool have_dcurv = have_curv && dcurv.size() == nv &&
+		is_current(dcurv_gen);
+	geometry_changed();
+
+	// Point clouds have nothing to update incrementally
+	if (!nf || !(have_normals || have_pointareas))
+		return;
+	need_adjacentfaces();
+
+	dprintf("Updating %lu moved vertices... ",
+		(unsigned long) moved.size());
+	std::vector<index_t> ring1;
+	grow_ring(this, moved, ring1);
+	if (have_normals) {
+		update_normals(ring1);
+		normals_gen = generation;
+	}
+	if (have_pointareas) {
+		update_pointareas(ring1);
+		pointareas_gen = generation;
+	}
+	if (have_curv) {
+		std::vector<index_t> ring2;
+		grow_ring(this, ring1, ring2);
+		update_curvatures(ring2);
+		curv_gen = generation;
+		if (have_dcurv) {
+			std::vector<index_t> ring3;
+			grow_ring(this, ring2, ring3);
+			update_dcurv(ring3);
+			dcurv_gen = generation;
+		}
+	}
+	dprintf("Done.\n");
+}
+
+} // end namespace trimesh
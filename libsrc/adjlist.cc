@@ -0,0 +1,208 @@
+/*
+Szymon Rusinkiewicz
+Princeton University
+
+adjlist.cc
+Construction of vertex neighbor and incident-element lists.
+*/
+
+#include "adjlist.h"
+#include <algorithm>
+
+namespace trimesh {
+
+
+#define COARSE_BITS 12
+#define MAX_BLOCKS 64
+#define MIN_BLOCK 16384
+
+
+// A vertex and a value (an element or another vertex) to list for it
+struct VertVal {
+	index_t vert, val;
+	VertVal() {}
+	VertVal(index_t vert_, index_t val_) : vert(vert_), val(val_)
+		{}
+};
+
+
+// Sort a list of indices and remove duplicates, returning the number left.
+// Short lists, which is almost all of them, are insertion-sorted while
+// dropping duplicates, since most entries are repeats.
+static size_t sort_unique(index_t *begin, index_t *end)
+{
+	if (end - begin > 256) {
+		std::sort(begin, end);
+		return std::unique(begin, end) - begin;
+	}
+
+	index_t *last = begin;
+	for (index_t *p = begin; p != end; p++) {
+		index_t x = *p;
+		index_t *pos = std::lower_bound(begin, last, x);
+		if (pos != last && *pos == x)
+			continue;
+		std::copy_backward(pos, last, last + 1);
+		*pos = x;
+		last++;
+	}
+	return last - begin;
+}
+
+
+// Sort the (vertex, value) pairs contributed by elements (triangles,
+// tetrahedra, ...) of k vertices each by vertex, with an MSD radix sort.
+// Each element contributes, for each of its vertices, either the element
+// index itself (if incident) or each of its other vertices.
+//  - A first pass distributes the pairs among a few thousand coarse
+//    buckets, each covering a range of vertices.  Blocks of elements are
+//    handled in parallel, each with its own histogram, so no atomics are
+//    needed.
+//  - Each coarse bucket is then sorted by vertex, in parallel, with a
+//    counting sort small enough to stay in cache.
+// Both passes are stable, so each vertex's values come out in order of
+// element index, no matter the number of threads.  On return, the values
+// for vertex i are vals[start[i]] through vals[start[i+1]-1].
+template <class SA, class VA>
+static void sort_by_vertex(size_t n, const index_t *elems, size_t nelems,
+	int k, bool incident, std::vector<size_t, SA> &start,
+	std::vector<index_t, VA> &vals)
+{
+	int shift = 0;
+	while (((n - 1) >> shift) >= (1u << COARSE_BITS))
+		shift++;
+	long long nbuckets = ((n - 1) >> shift) + 1;
+	long long nblocks = std::min((size_t) MAX_BLOCKS,
+		(nelems + MIN_BLOCK - 1) / MIN_BLOCK);
+	int per_vertex = incident ? 1 : k - 1;
+
+	// Histogram coarse buckets for each block of elements
+	std::vector<size_t> hist(nblocks * nbuckets);
+#pragma omp parallel for
+	for (long long b = 0; b < nblocks; b++) {
+		size_t *h = &hist[b * nbuckets];
+		size_t bstart = nelems * b / nblocks;
+		size_t bend = nelems * (b + 1) / nblocks;
+		for (size_t i = bstart; i < bend; i++) {
+			const index_t *e = elems + i * k;
+			for (int j = 0; j < k; j++)
+				h[e[j] >> shift] += per_vertex;
+		}
+	}
+
+	// Where each block's share of each bucket starts
+	std::vector<size_t> bucketstart(nbuckets + 1);
+	size_t sum = 0;
+	for (long long d = 0; d < nbuckets; d++) {
+		bucketstart[d] = sum;
+		for (long long b = 0; b < nblocks; b++) {
+			size_t count = hist[b * nbuckets + d];
+			hist[b * nbuckets + d] = sum;
+			sum += count;
+		}
+	}
+	bucketstart[nbuckets] = sum;
+	start.clear();
+	start.resize(n + 1, 0);
+	vals.clear();
+	if (!sum)
+		return;
+
+	// Distribute the pairs
+	std::vector<VertVal> pairs(sum);
+#pragma omp parallel for
+	for (long long b = 0; b < nblocks; b++) {
+		size_t *h = &hist[b * nbuckets];
+		size_t bstart = nelems * b / nblocks;
+		size_t bend = nelems * (b + 1) / nblocks;
+		for (size_t i = bstart; i < bend; i++) {
+			const index_t *e = elems + i * k;
+			for (int j = 0; j < k; j++) {
+				size_t &pos = h[e[j] >> shift];
+				if (incident) {
+					pairs[pos++] = VertVal(e[j], (index_t) i);
+					continue;
+				}
+				for (int m = 1; m < k; m++)
+					pairs[pos++] = VertVal(e[j], e[(j + m) % k]);
+			}
+		}
+	}
+	std::vector<size_t>().swap(hist);
+
+	// Counting-sort each coarse bucket by vertex
+	vals.resize(sum);
+#pragma omp parallel
+	{
+		std::vector<size_t> count(1u << shift);
+#pragma omp for schedule(dynamic)
+		for (long long d = 0; d < nbuckets; d++) {
+			size_t first = d << shift;
+			size_t nv = std::min(n - first, count.size());
+			std::fill(count.begin(), count.begin() + nv, 0);
+			for (size_t i = bucketstart[d]; i < bucketstart[d+1]; i++)
+				count[size_t(pairs[i].vert) - first]++;
+			size_t pos = bucketstart[d];
+			for (size_t v = 0; v < nv; v++) {
+				start[first + v] = pos;
+				pos += count[v];
+				count[v] = start[first + v];
+			}
+			for (size_t i = bucketstart[d]; i < bucketstart[d+1]; i++)
+				vals[count[size_t(pairs[i].vert) - first]++] =
+					pairs[i].val;
+		}
+	}
+	start[n] = sum;
+}
+
+
+// Build the lists of neighbors of n vertices.  Every element contributes
+// a directed edge from each of its vertices to each of the others, which
+// are sorted by their "from" vertex (see sort_by_vertex).  Each vertex's
+// list is then sorted and duplicates removed.
+void AdjList::build_neighbors(size_t n, const index_t *elems, size_t nelems,
+	int k)
+{
+	clear();
+	if (!n)
+		return;
+	std::vector<size_t> start;
+	std::vector<index_t> buckets;
+	sort_by_vertex(n, elems, nelems, k, false, start, buckets);
+	if (buckets.empty()) {
+		offsets.resize(n + 1);
+		return;
+	}
+
+	// Sort each vertex's list and remove duplicates
+	long long nn = n;
+	std::vector<size_t> count(n);
+#pragma omp parallel for schedule(dynamic, 4096)
+	for (long long i = 0; i < nn; i++)
+		count[i] = sort_unique(&buckets[0] + start[i],
+				       &buckets[0] + start[i+1]);
+
+	build(n, &count[0]);
+#pragma omp parallel for schedule(dynamic, 4096)
+	for (long long i = 0; i < nn; i++)
+		std::copy(buckets.begin() + start[i],
+			  buckets.begin() + start[i] + count[i],
+			  items.begin() + offsets[i]);
+}
+
+
+// Build the lists of elements touching each of n vertices.  These come
+// out of sort_by_vertex in order already.
+void AdjList::build_incident(size_t n, const index_t *elems, size_t nelems,
+	int k)
+{
+	clear();
+	if (!n)
+		return;
+	sort_by_vertex< HookAlloc<size_t>, HookAlloc<index_t> >(n, elems, nelems,
+		k, true, offsets, items);
+}
+
+
+} // end namespace trimesh
@@ -17,9 +17,8 @@ namespace trimesh {
 
 #define NO_COMP -1
 #define FOR_EACH_ADJACENT_FACE(mesh,v,f) \
-	for (int f_ind = 0, f = mesh->adjacentfaces[v][0]; \
-	     (f_ind < mesh->adjacentfaces[v].size()) && \
-	     ((f = mesh->adjacentfaces[v][f_ind]) || 1); \
+	for (int f_ind = 0, f_num = mesh->adjacentfaces[v].size(), f = 0; \
+	     (f_ind < f_num) && ((f = mesh->adjacentfaces[v][f_ind]) || 1); \
 	     f_ind++)
 
 
@@ -89,7 +89,7 @@ static void diffuse_vert_field(TriMesh *themesh,
 
 	flag_curr++;
 	flags[v] = flag_curr;
-	std::vector<int> boundary = themesh->neighbors[v];
+	std::vector<index_t> boundary = themesh->neighbors[v];
 	while (!boundary.empty()) {
 		int n = boundary.back();
 		boundary.pop_back();
@@ -181,6 +181,7 @@ void smooth_mesh(TriMesh *themesh, float sigma)
 		for (int i = 0; i < nv; i++)
 			themesh->vertices[i] += dflt[i] - dflt2[i]; // second Laplacian
 	} // #pragma omp parallel
+	themesh->geometry_changed();
 
 	dprintf("Done.  Filtering took %f sec.\n", now() - t);
 }
@@ -202,7 +203,7 @@ static void jones_filter(TriMesh *themesh,
 	float sum_w = 0.0f;
 
 	flag_curr++;
-	std::vector<int> boundary = themesh->adjacentfaces[v];
+	std::vector<index_t> boundary = themesh->adjacentfaces[v];
 	while (!boundary.empty()) {
 		int f = boundary.back();
 		boundary.pop_back();
@@ -286,6 +287,7 @@ void bilateral_smooth_mesh(TriMesh *themesh, float sigma1, float sigma2)
 			jones_filter(themesh, flags, flag_curr,
 				i, invsigma2_1, invsigma2_2, false, mpoints);
 	}
+	themesh->geometry_changed();
 
 	dprintf("Done.  Filtering took %f sec.\n", now() - t);
 }
@@ -15,8 +15,7 @@ namespace trimesh {
 #define dprintf TriMesh::dprintf
 #define eprintf TriMesh::eprintf
 
-  typedef std::pair<int,int> TriMeshEdge; // (face, edge) pair
-  typedef std::pair<float, TriMeshEdge> TriMeshEdgeWithBenefit;
+  typedef std::pair<float, int> TriMeshEdgeWithBenefit; // (benefit, corner)
 
 
 // Cosine of the maximum angle in triangle (v1,v2,v3)
@@ -62,30 +61,20 @@ static float flip_benefit(const point &v1, const point &v2,
 }
 
 
-// Given a mesh edge defined as a (face, whichedge) pair, figure out whether
-// it is possible and desirable to do an edge flip.  This does some sanity
-// checks, figures out the four vertices involved, then calls the above
-// function to actually compute the benefit.
-static float flip_benefit(const TriMesh *mesh, int f, int e)
+// Given a mesh edge defined as the corner opposite it, figure out whether
+// it is possible and desirable to do an edge flip.  This figures out the
+// four vertices involved, then calls the above function to actually
+// compute the benefit.
+static float flip_benefit(const TriMesh *mesh, int c)
 {
-	int ae = mesh->across_edge[f][e];
-	if (ae < 0)
+	int o = mesh->corner_opposite[c];
+	if (o < 0)
 		return 0;
 
-	int v2 = mesh->faces[f][e];
-	int v3 = mesh->faces[f][(e+1)%3];
-	int v1 = mesh->faces[f][(e+2)%3];
-	int faei3 = mesh->faces[ae].indexof(v3);
-	if (mesh->across_edge[ae][(faei3+1)%3] != f) {
-		eprintf("Encountered error in flip_benefit()\n");
-		eprintf("f = %d: %d %d %d\n", f, v1, v2, v3);
-		eprintf("ae = %d\n", ae);
-		eprintf("aef = %d %d %d\n", mesh->faces[ae][0], mesh->faces[ae][1], mesh->faces[ae][2]);
-		eprintf("faei3 = %d\n", faei3);
-		eprintf("aeae = %d %d %d\n", mesh->across_edge[ae][0], mesh->across_edge[ae][1], mesh->across_edge[ae][2]);
-		return 0;	// Topological weirdness...
-	}
-	int v4 = mesh->faces[ae][(faei3+1)%3];
+	int v1 = mesh->corner_vertex(TriMesh::corner_prev(c));
+	int v2 = mesh->corner_vertex(c);
+	int v3 = mesh->corner_vertex(TriMesh::corner_next(c));
+	int v4 = mesh->corner_vertex(o);
 	if (v2 == v4)
 		return 0;
 	return flip_benefit(mesh->vertices[v1], mesh->vertices[v2],
@@ -93,35 +82,15 @@ static float flip_benefit(const TriMesh *mesh, int f, int e)
 }
 
 
-// Do an edge flip of edge e on face f, updating the across_edge map.
-// Returns the other face involved in the flip.
-static int edge_flip(TriMesh *mesh, int f1, int e)
+// Queue up flips of the edges of face f, if they would help
+static void push_flips(const TriMesh *mesh, int f,
+	std::priority_queue<TriMeshEdgeWithBenefit> &todo)
 {
-	int f2 = mesh->across_edge[f1][e];
-
-	int v2 = mesh->faces[f1][e];
-	int v3 = mesh->faces[f1][(e+1)%3];
-	int f2i3 = mesh->faces[f2].indexof(v3);
-	int v4 = mesh->faces[f2][(f2i3+1)%3];
-
-	int ae14 = mesh->across_edge[f2][f2i3];
-	int ae23 = mesh->across_edge[f1][(e+2)%3];
-
-	mesh->faces[f1][(e+1)%3] = v4;
-	mesh->faces[f2][(f2i3+2)%3] = v2;
-	mesh->across_edge[f1][e] = ae14;
-	mesh->across_edge[f1][(e+2)%3] = f2;
-	mesh->across_edge[f2][f2i3] = f1;
-	mesh->across_edge[f2][(f2i3+1)%3] = ae23;
-
-	int ae14iv4 = (ae14 >= 0) ? mesh->faces[ae14].indexof(v4) : -1;
-	if (ae14iv4 >= 0 && mesh->across_edge[ae14][(ae14iv4+1)%3] == f2)
-		mesh->across_edge[ae14][(ae14iv4+1)%3] = f1;
-	int ae23iv2 = (ae23 >= 0) ? mesh->faces[ae23].indexof(v2) : -1;
-	if (ae23iv2 >= 0 && mesh->across_edge[ae23][(ae23iv2+1)%3] == f1)
-		mesh->across_edge[ae23][(ae23iv2+1)%3] = f2;
-
-	return f2;
+	for (int j = 0; j < 3; j++) {
+		float b = flip_benefit(mesh, 3*f+j);
+		if (b > 0.0f)
+			todo.push(std::make_pair(b, 3*f+j));
+	}
 }
 
 
@@ -130,7 +99,7 @@ void edgeflip(TriMesh *mesh)
 {
 	mesh->need_faces();
 	mesh->tstrips.clear();
-	mesh->need_across_edge();
+	mesh->need_corners();
 
 	dprintf("Flipping edges... ");
 
@@ -138,36 +107,23 @@ void edgeflip(TriMesh *mesh)
 	// the to-do list
 	int nf = mesh->faces.size();
 	std::priority_queue<TriMeshEdgeWithBenefit> todo;
-	for (int i = 0; i < nf; i++) {
-		for (int j = 0; j < 3; j++) {
-			float b = flip_benefit(mesh, i, j);
-			if (b > 0.0f)
-				todo.push(std::make_pair(b, std::make_pair(i, j)));
-		}
-	}
-
+	for (int i = 0; i < nf; i++)
+		push_flips(mesh, i, todo);
 
 	// Process things in order of decreasing benefit
 	while (!todo.empty()) {
-		int f = todo.top().second.first;
-		int e = todo.top().second.second;
+		int c = todo.top().second;
 		todo.pop();
 		// Re-check in case the mesh has changed under us
-		if (flip_benefit(mesh, f, e) <= 0.0f)
+		if (flip_benefit(mesh, c) <= 0.0f)
 			continue;
 		// OK, do the edge flip
-		int f2 = edge_flip(mesh, f, e);
+		int o = mesh->corner_opposite[c];
+		if (!mesh->flip_edge(c))
+			continue;
 		// Insert new edges into queue, if necessary
-		for (int j = 0; j < 3; j++) {
-			float b = flip_benefit(mesh, f, j);
-			if (b > 0.0f)
-				todo.push(std::make_pair(b, std::make_pair(f, j)));
-		}
-		for (int j = 0; j < 3; j++) {
-			float b = flip_benefit(mesh, f2, j);
-			if (b > 0.0f)
-				todo.push(std::make_pair(b, std::make_pair(f2, j)));
-		}
+		push_flips(mesh, c / 3, todo);
+		push_flips(mesh, o / 3, todo);
 	}
 
 	dprintf("Done.\n");
@@ -24,6 +24,7 @@ void faceflip(TriMesh *mesh)
 #pragma omp parallel for
 	for (int i = 0; i < nf; i++)
 	  std::swap(mesh->faces[i][0], mesh->faces[i][2]);
+	mesh->topology_changed();
 	dprintf("Done.\n");
 
 	if (had_tstrips)
@@ -41,6 +41,7 @@ void inflate(TriMesh *mesh, float amount)
 	for (int i = 0; i < nv; i++)
 		mesh->vertices[i] += amount * mesh->normals[i];
 	dprintf("Done.\n");
+	mesh->geometry_changed();
 	mesh->bbox.valid = false;
 	mesh->bsphere.valid = false;
 }
@@ -50,10 +51,20 @@ void inflate(TriMesh *mesh, float amount)
 void apply_xform(TriMesh *mesh, const xform &xf)
 {
 	int nv = mesh->vertices.size();
+	bool normals_current = mesh->is_current(mesh->normals_gen);
+
+	if (mesh->is_compact()) {
+		// Just compose with the decoding transforms
+		xform pxf = xf * xform(mesh->compact.pos_xf);
+		xform nxf = norm_xf(xf) * xform(mesh->compact.norm_xf);
+		std::copy(pxf.begin(), pxf.end(), mesh->compact.pos_xf);
+		std::copy(nxf.begin(), nxf.end(), mesh->compact.norm_xf);
+	}
 
 #pragma omp parallel for
 	for (int i = 0; i < nv; i++)
 		mesh->vertices[i] = xf * mesh->vertices[i];
+	mesh->geometry_changed();
 
 	if (!mesh->normals.empty()) {
 		xform nxf = norm_xf(xf);
@@ -63,14 +74,20 @@ void apply_xform(TriMesh *mesh, const xform &xf)
 			normalize(mesh->normals[i]);
 		}
 	}
+	// Transformed along with the vertices, so still good
+	if (normals_current &&
+	    !(mesh->normals.empty() && mesh->compact.norms.empty()))
+		mesh->normals_gen = mesh->generation;
 
 	if (mesh->bbox.valid) {
 		mesh->bbox.valid = false;
 		mesh->need_bbox();
 	}
+	// (Left for later on compact meshes, since it needs the vertices)
 	if (mesh->bsphere.valid) {
 		mesh->bsphere.valid = false;
-		mesh->need_bsphere();
+		if (!mesh->is_compact())
+			mesh->need_bsphere();
 	}
 }
 
@@ -409,7 +426,7 @@ void orient(TriMesh *mesh)
 			for (int j = 0; j < 3; j++) {
 				int v0 = mesh->faces[f][j];
 				int v1 = mesh->faces[f][(j+1)%3];
-				const std::vector<int> &a = mesh->adjacentfaces[v0];
+				AdjList::Range a = mesh->adjacentfaces[v0];
 				for (int k = 0; k < a.size(); k++) {
 					int f1 = a[k];
 					if (mesh->flags[f1] != NONE)
@@ -445,7 +462,7 @@ void orient(TriMesh *mesh)
 		else
 			if (v2[0] > v0[0]) j = 2;
 		int v = mesh->faces[f][j];
-		const std::vector<int> &a = mesh->adjacentfaces[v];
+		AdjList::Range a = mesh->adjacentfaces[v];
 		vec n;
 		for (int k = 0; k < a.size(); k++) {
 			int f1 = a[k];
@@ -462,6 +479,7 @@ void orient(TriMesh *mesh)
 		if (cc_flip[mesh->flags[i]])
 		  std::swap(mesh->faces[i][1], mesh->faces[i][2]);
 	}
+	mesh->topology_changed();
 	dprintf("Done.\n");
 }
 
@@ -501,6 +519,7 @@ void noisify(TriMesh *mesh, float amount)
 	}
 	for (int i = 0; i < nv; i++)
 		mesh->vertices[i] += disp[i];
+	mesh->geometry_changed();
 }
 
 } // end namespace trimesh
@@ -65,6 +65,7 @@ void umbrella(TriMesh *mesh, float stepsize, bool tangent /* = false */)
 			mesh->vertices[i] += stepsize * disp[i];
 	}
 
+	mesh->geometry_changed();
 	mesh->bbox.valid = false;
 	mesh->bsphere.valid = false;
 }
@@ -99,6 +99,8 @@ void find_overlap(TriMesh *mesh1, TriMesh *mesh2,
 // Easy-to-use interfaces
 void find_overlap(TriMesh *mesh1, TriMesh *mesh2, float &area, float &rmsdist)
 {
+	mesh1->need_vertices();
+	mesh2->need_vertices();
 	KDtree *kd1 = new KDtree(mesh1->vertices);
 	KDtree *kd2 = new KDtree(mesh2->vertices);
 	find_overlap(mesh1, mesh2, xform(), xform(), kd1, kd2, area, rmsdist);
@@ -110,6 +112,8 @@ void find_overlap(TriMesh *mesh1, TriMesh *mesh2,
         	  const xform &xf1, const xform &xf2,
 		  float &area, float &rmsdist)
 {
+	mesh1->need_vertices();
+	mesh2->need_vertices();
 	KDtree *kd1 = new KDtree(mesh1->vertices);
 	KDtree *kd2 = new KDtree(mesh2->vertices);
 	find_overlap(mesh1, mesh2, xf1, xf2, kd1, kd2, area, rmsdist);
@@ -80,6 +80,8 @@ void remove_faces(TriMesh *mesh, const std::vector<bool> &toremove)
 	mesh->adjacentfaces.clear();
 	mesh->neighbors.clear();
 	mesh->across_edge.clear();
+	mesh->corner_opposite.clear();
+	mesh->vertex_corner.clear();
 	mesh->cornerareas.clear();
 	mesh->pointareas.clear();
 
@@ -96,6 +98,7 @@ void remove_faces(TriMesh *mesh, const std::vector<bool> &toremove)
 	}
 
 	mesh->faces.erase(mesh->faces.begin() + next, mesh->faces.end());
+	mesh->topology_changed();
 	dprintf("%d faces removed... Done.\n", numfaces - next);
 
 	if (had_tstrips)
@@ -3,12 +3,14 @@ Szymon Rusinkiewicz
 Princeton University
 
 reorder_verts.cc
-Reorder and remap vertices.
+Reorder and remap vertices, and reorder faces.
 */
 
 #include "TriMesh.h"
 #include "TriMesh_algo.h"
+#include "radixsort.h"
 #include <vector>
+#include <algorithm>
 
 namespace trimesh {
 #define dprintf TriMesh::dprintf
@@ -72,10 +74,27 @@ void remap_verts(TriMesh *mesh, const std::vector<int> &remap_table)
 	bool have_curv1 = !mesh->curv1.empty();
 	bool have_curv2 = !mesh->curv2.empty();
 	bool have_dcurv = !mesh->dcurv.empty();
+	bool normals_current = mesh->is_current(mesh->normals_gen);
+	bool curv_current = mesh->is_current(mesh->curv_gen);
+	bool dcurv_current = mesh->is_current(mesh->dcurv_gen);
 
-	// Remap the vertices and per-vertex properties
+	// Remap the vertices and per-vertex properties.  The old values come
+	// from a copy of just what is remapped (not the connectivity, etc.)
 	TriMesh *oldmesh = new TriMesh;
-	*oldmesh = *mesh;
+#define COPY(property) oldmesh->property = mesh->property
+	COPY(vertices);
+	COPY(faces);
+	COPY(grid);
+	COPY(tstrips);
+	if (have_col) COPY(colors);
+	if (have_conf) COPY(confidences);
+	if (have_flags) COPY(flags);
+	if (have_normals) COPY(normals);
+	if (have_pdir1) COPY(pdir1);
+	if (have_pdir2) COPY(pdir2);
+	if (have_curv1) COPY(curv1);
+	if (have_curv2) COPY(curv2);
+	if (have_dcurv) COPY(dcurv);
 
 #define REMAP(property) mesh->property[remap_table[i]] = oldmesh->property[i]
 
@@ -107,6 +126,24 @@ void remap_verts(TriMesh *mesh, const std::vector<int> &remap_table)
 	if (have_curv2) ERASE(curv2);
 	if (have_dcurv) ERASE(dcurv);
 
+	// Named channels, with ncomp values per vertex
+	oldmesh->channels = mesh->channels;
+	for (size_t c = 0; c < mesh->channels.size(); c++) {
+		SharedArray<float> &values = mesh->channels[c].values;
+		const SharedArray<float> &oldvalues = oldmesh->channels[c].values;
+		int ncomp = mesh->channels[c].ncomp;
+		if (values.size() != ncomp * size_t(nv))
+			continue;
+		for (int i = 0; i < nv; i++) {
+			if (remap_table[i] < 0 || remap_table[i] == i)
+				continue;
+			for (int j = 0; j < ncomp; j++)
+				values[size_t(remap_table[i]) * ncomp + j] =
+					oldvalues[size_t(i) * ncomp + j];
+		}
+		values.resize(size_t(last + 1) * ncomp);
+	}
+
 	// Renumber faces
 	int nf = mesh->faces.size(), nextface = 0;
 	for (int i = 0; i < nf; i++) {
@@ -118,6 +155,17 @@ void remap_verts(TriMesh *mesh, const std::vector<int> &remap_table)
 	}
 	mesh->faces.erase(mesh->faces.begin() + nextface, mesh->faces.end());
 
+	// Everything is renumbered, but per-vertex properties that were
+	// remapped above are still good
+	mesh->geometry_changed();
+	mesh->topology_changed();
+	if (normals_current)
+		mesh->normals_gen = mesh->generation;
+	if (curv_current)
+		mesh->curv_gen = mesh->generation;
+	if (dcurv_current)
+		mesh->dcurv_gen = mesh->generation;
+
 	// Renumber grid
 	if (have_grid) {
 		int ng = mesh->grid.size();
@@ -168,6 +216,11 @@ void remap_verts(TriMesh *mesh, const std::vector<int> &remap_table)
 		mesh->across_edge.clear();
 		mesh->need_across_edge();
 	}
+	if (!mesh->vertex_corner.empty()) {
+		mesh->corner_opposite.clear();
+		mesh->vertex_corner.clear();
+		mesh->need_corners();
+	}
 
 	// Must recompute tstrips after connectivity is recomputed...
 	if (have_tstrips)
@@ -229,4 +282,332 @@ void reorder_verts(TriMesh *mesh)
 	dprintf("Done.\n");
 }
 
+
+// Spread the low 21 bits of x out to every third bit
+static inline unsigned long long spread3(unsigned long long x)
+{
+	x &= 0x1fffffull;
+	x = (x | x << 32) & 0x1f00000000ffffull;
+	x = (x | x << 16) & 0x1f0000ff0000ffull;
+	x = (x | x <<  8) & 0x100f00f00f00f00full;
+	x = (x | x <<  4) & 0x10c30c30c30c30c3ull;
+	x = (x | x <<  2) & 0x1249249249249249ull;
+	return x;
+}
+
+
+// Position along the Morton (Z-order) curve of a point on a grid with
+// 2^SFC_BITS cells on a side: the bits of x, y, and z interleaved
+#define SFC_BITS 16
+static inline unsigned long long morton_key(const unsigned *q)
+{
+	return spread3(q[0]) << 2 | spread3(q[1]) << 1 | spread3(q[2]);
+}
+
+
+// Position along the Hilbert curve, using Skilling's method ("Programming
+// the Hilbert curve", AIP Conf. Proc. 707, 2004): convert to the
+// "transposed" Hilbert index in place, then interleave like Morton.
+static inline unsigned long long hilbert_key(const unsigned *q)
+{
+	unsigned x[3] = { q[0], q[1], q[2] };
+	const unsigned M = 1u << (SFC_BITS - 1);
+
+	// Inverse undo
+	for (unsigned Q = M; Q > 1; Q >>= 1) {
+		unsigned P = Q - 1;
+		for (int i = 0; i < 3; i++) {
+			if (x[i] & Q) {
+				x[0] ^= P;
+			} else {
+				unsigned t = (x[0] ^ x[i]) & P;
+				x[0] ^= t;
+				x[i] ^= t;
+			}
+		}
+	}
+
+	// Gray encode
+	x[1] ^= x[0];
+	x[2] ^= x[1];
+	unsigned t = 0;
+	for (unsigned Q = M; Q > 1; Q >>= 1)
+		if (x[2] & Q)
+			t ^= Q - 1;
+	x[0] ^= t; x[1] ^= t; x[2] ^= t;
+
+	return morton_key(x);
+}
+
+
+// Reorder vertices along a space-filling curve through the bounding box,
+// so that vertices that are close in space are also close in memory, then
+// reorder faces to match.
+void reorder_verts_spatial(TriMesh *mesh, int curve /* = REORDER_HILBERT */)
+{
+	int nv = mesh->vertices.size();
+	if (!nv)
+		return;
+	mesh->need_bbox();
+
+	dprintf("Reordering vertices along %s curve... ",
+		curve == REORDER_MORTON ? "Morton" : "Hilbert");
+
+	// Quantize to a grid of cubical cells (so that the curve doesn't
+	// wander back and forth across thin dimensions), and find the keys
+	// in parallel
+	const float cells = float((1 << SFC_BITS) - 1);
+	float size = mesh->bbox.size().max();
+	float scale = (size > 0.0f) ? cells / size : 0.0f;
+	std::vector<unsigned long long> keys(nv);
+#pragma omp parallel for
+	for (int i = 0; i < nv; i++) {
+		unsigned q[3];
+		for (int j = 0; j < 3; j++)
+			q[j] = (unsigned) clamp((mesh->vertices[i][j] -
+				mesh->bbox.min[j]) * scale, 0.0f, cells);
+		keys[i] = (curve == REORDER_MORTON) ? morton_key(q) :
+			hilbert_key(q);
+	}
+
+	// Stable sort on the keys, of 3 * SFC_BITS <= 64 bits
+	std::vector<index_t> order(nv);
+	for (int i = 0; i < nv; i++)
+		order[i] = i;
+	radix_sort(keys, order, std::min(3 * SFC_BITS, 32),
+		std::max(3 * SFC_BITS - 32, 0));
+	std::vector<unsigned long long>().swap(keys);
+	std::vector<int> remap(nv);
+	for (int i = 0; i < nv; i++)
+		remap[order[i]] = i;
+	dprintf("Done.\n");
+
+	remap_verts(mesh, remap);
+	reorder_faces(mesh);
+}
+
+
+// Put the faces in the given order (order[i] is the old number of new
+// face i).  Per-face data is kept, or recomputed if it depends on face
+// numbers.
+static void permute_faces(TriMesh *mesh, const std::vector<int> &order)
+{
+	int nf = mesh->faces.size();
+	bool normals_current = mesh->is_current(mesh->normals_gen);
+	bool pointareas_current = mesh->is_current(mesh->pointareas_gen) &&
+		(int) mesh->cornerareas.size() == nf;
+	bool curv_current = mesh->is_current(mesh->curv_gen);
+	bool dcurv_current = mesh->is_current(mesh->dcurv_gen);
+	bool neighbors_current = mesh->is_current(mesh->neighbors_gen);
+	bool had_tstrips = !mesh->tstrips.empty();
+
+	std::vector<TriMesh::Face> oldfaces(mesh->faces);
+#pragma omp parallel for
+	for (int i = 0; i < nf; i++)
+		mesh->faces[i] = oldfaces[order[i]];
+	std::vector<TriMesh::Face>().swap(oldfaces);
+	if ((int) mesh->cornerareas.size() == nf) {
+		std::vector<vec> oldareas(mesh->cornerareas);
+#pragma omp parallel for
+		for (int i = 0; i < nf; i++)
+			mesh->cornerareas[i] = oldareas[order[i]];
+	}
+
+	// Faces were renumbered, but per-vertex properties (and vertex
+	// neighbors) are still good
+	mesh->topology_changed();
+	if (normals_current)
+		mesh->normals_gen = mesh->generation;
+	if (pointareas_current)
+		mesh->pointareas_gen = mesh->generation;
+	if (curv_current)
+		mesh->curv_gen = mesh->generation;
+	if (dcurv_current)
+		mesh->dcurv_gen = mesh->generation;
+	if (neighbors_current)
+		mesh->neighbors_gen = mesh->generation;
+	mesh->tstrips.clear();
+	mesh->edgelengths.clear();
+	mesh->faceareas.clear();
+
+	// Recompute whatever needs recomputing...
+	if (!mesh->adjacentfaces.empty()) {
+		mesh->adjacentfaces.clear();
+		mesh->need_adjacentfaces();
+	}
+	if (!mesh->across_edge.empty()) {
+		mesh->across_edge.clear();
+		mesh->need_across_edge();
+	}
+	if (!mesh->vertex_corner.empty()) {
+		mesh->corner_opposite.clear();
+		mesh->vertex_corner.clear();
+		mesh->need_corners();
+	}
+	if (had_tstrips)
+		mesh->need_tstrips();
+}
+
+
+// Reorder faces by their lowest-numbered vertex, keeping the existing
+// order among faces that share it, so that faces are visited in about the
+// same order as vertices.
+void reorder_faces(TriMesh *mesh)
+{
+	int nv = mesh->vertices.size(), nf = mesh->faces.size();
+	if (!nf)
+		return;
+
+	dprintf("Reordering faces... ");
+
+	// Counting sort by lowest vertex
+	std::vector<int> start(nv + 1);
+	for (int i = 0; i < nf; i++) {
+		const TriMesh::Face &f = mesh->faces[i];
+		start[std::min(std::min(f[0], f[1]), f[2]) + 1]++;
+	}
+	for (int i = 0; i < nv; i++)
+		start[i+1] += start[i];
+	std::vector<int> order(nf);
+	for (int i = 0; i < nf; i++) {
+		const TriMesh::Face &f = mesh->faces[i];
+		order[start[std::min(std::min(f[0], f[1]), f[2])]++] = i;
+	}
+	std::vector<int>().swap(start);
+
+	permute_faces(mesh, order);
+	dprintf("Done.\n");
+}
+
+
+// Next vertex to fan around in Tipsify: of the candidates (the vertices of
+// the faces just emitted), the one with live faces that will be oldest in
+// the cache without having been evicted after emitting them.  At a dead
+// end, go back to recently-used vertices, and then to the input order.
+static int tipsify_next(const std::vector<int> &candidates,
+	const std::vector<int> &live, const std::vector<int> &cachetime,
+	int time, int cache_size, std::vector<int> &deadend, int &cursor)
+{
+	int best = -1, bestpriority = -1;
+	for (size_t i = 0; i < candidates.size(); i++) {
+		int v = candidates[i];
+		if (live[v] <= 0)
+			continue;
+		int priority = 0;
+		if (time - cachetime[v] + 2 * live[v] <= cache_size)
+			priority = time - cachetime[v];
+		if (priority > bestpriority) {
+			bestpriority = priority;
+			best = v;
+		}
+	}
+	if (best >= 0)
+		return best;
+
+	while (!deadend.empty()) {
+		int v = deadend.back();
+		deadend.pop_back();
+		if (live[v] > 0)
+			return v;
+	}
+	int nv = live.size();
+	for ( ; cursor < nv; cursor++)
+		if (live[cursor] > 0)
+			return cursor;
+	return -1;
+}
+
+
+// Reorder faces for a vertex cache of the given size, using Tipsify
+// (Sander, Nehab, and Barczak, "Fast Triangle Reordering for Vertex
+// Locality and Reduced Overdraw," SIGGRAPH 2007): fan out around one vertex
+// at a time, choosing each next vertex among those just used so that its
+// faces can be emitted while it is still in the cache.  This takes linear
+// time.  Vertices are then renumbered in the order the faces use them.
+void optimize_vertex_cache(TriMesh *mesh, int cache_size /* = 16 */)
+{
+	mesh->need_faces();
+	int nv = mesh->vertices.size(), nf = mesh->faces.size();
+	if (!nf)
+		return;
+	bool had_adjacentfaces = !mesh->adjacentfaces.empty();
+	mesh->need_adjacentfaces();
+
+	dprintf("Optimizing face order for a vertex cache of %d... ",
+		cache_size);
+	std::vector<int> live(nv), cachetime(nv, 0);
+	for (int i = 0; i < nv; i++)
+		live[i] = mesh->adjacentfaces[i].size();
+	std::vector<bool> emitted(nf, false);
+	std::vector<int> order, candidates, deadend;
+	order.reserve(nf);
+	candidates.reserve(64);
+	int time = cache_size + 1, cursor = 0;
+
+	int v = tipsify_next(candidates, live, cachetime, time, cache_size,
+		deadend, cursor);
+	while (v >= 0) {
+		candidates.clear();
+		AdjList::Range a = mesh->adjacentfaces[v];
+		for (size_t k = 0; k < a.size(); k++) {
+			int f = a[k];
+			if (emitted[f])
+				continue;
+			emitted[f] = true;
+			order.push_back(f);
+			for (int j = 0; j < 3; j++) {
+				int w = mesh->faces[f][j];
+				deadend.push_back(w);
+				candidates.push_back(w);
+				live[w]--;
+				if (time - cachetime[w] > cache_size)
+					cachetime[w] = time++;
+			}
+		}
+		v = tipsify_next(candidates, live, cachetime, time, cache_size,
+			deadend, cursor);
+	}
+	dprintf("Done.\n");
+
+	// Strips and grids would determine the order of faces themselves
+	if (!had_adjacentfaces)
+		mesh->adjacentfaces.clear();
+	mesh->grid.clear();
+	mesh->tstrips.clear();
+	permute_faces(mesh, order);
+	reorder_verts(mesh);
+}
+
+
+// Simulate a FIFO vertex cache of the given size on the faces, in order,
+// and return the average cache miss ratio (misses per face, at best 0.5
+// for big meshes) and the average transform to vertex ratio (misses per
+// vertex used, at best 1)
+void vertex_cache_stats(TriMesh *mesh, int cache_size,
+	float &acmr, float &atvr)
+{
+	mesh->need_faces();
+	int nv = mesh->vertices.size(), nf = mesh->faces.size();
+	acmr = atvr = 0.0f;
+	if (!nf || cache_size <= 0)
+		return;
+
+	// A vertex is in the cache if fewer than cache_size misses happened
+	// since it was last loaded
+	std::vector<int> loaded(nv, -1);
+	int misses = 0, used = 0;
+	for (int i = 0; i < nf; i++) {
+		for (int j = 0; j < 3; j++) {
+			int v = mesh->faces[i][j];
+			if (loaded[v] < 0)
+				used++;
+			else if (misses - loaded[v] < cache_size)
+				continue;
+			loaded[v] = misses++;
+		}
+	}
+	acmr = float(misses) / nf;
+	atvr = float(misses) / used;
+}
+
 } // end namespace trimesh
@@ -37,11 +37,9 @@ static point loop(TriMesh *mesh, int /* f1 */, int /* f2 */,
 static point opposite(TriMesh *mesh, int f, int v)
 {
 	int ind = mesh->faces[f].indexof(v);
-	int ae = mesh->across_edge[f][ind];
-	if (ae) {
-		int j = mesh->faces[ae].indexof(mesh->faces[f][NEXT(ind)]);
-		return mesh->vertices[mesh->faces[ae][NEXT(j)]];
-	}
+	index_t o = mesh->corner_opposite[3*f+ind];
+	if (o >= 0)
+		return mesh->vertices[mesh->corner_vertex(o)];
 	return mesh->vertices[mesh->faces[f][NEXT(ind)]] +
 	       mesh->vertices[mesh->faces[f][PREV(ind)]] -
 	       mesh->vertices[v];
@@ -61,8 +59,8 @@ static point butterfly(TriMesh *mesh, int f1, int f2,
 
 
 // Compute Loop's new edge mask for an extraordinary vertex for SUBDIV_LOOP_NEW
-static point new_loop_edge(TriMesh *mesh, int f1, int f2,
-			   int v0, int v1, int v2, int v3)
+static point new_loop_edge(TriMesh *mesh, const std::vector<int> &valence,
+			   int f1, int f2, int v0, int v1, int v2, int v3)
 {
 	static const float wts[6][5] = {
 		{ 0, 0, 0, 0, 0 },
@@ -73,23 +71,22 @@ static point new_loop_edge(TriMesh *mesh, int f1, int f2,
 		{ 0.3945288f, 0.1215267f, 0.01074729f, 0.01074729f, 0.1215267f }, 
 	};
 
-	int n = mesh->adjacentfaces[v1].size();
+	int n = valence[v1];
 	if (n <= 3)
 		return loop(mesh, f1, f2, v0, v1, v2, v3);
+	int ind = mesh->faces[f1].indexof(v1);
+	if (ind == -1)
+		return loop(mesh, f1, f2, v0, v1, v2, v3);
 	point p;
 	float sumwts = 0.0f;
-	int f = f1;
+	index_t c = 3*f1 + ind;
 	float s1 = 1.0f / n;
 	float s2 = M_TWOPIf * s1;
 	float l = 0.375f + 0.25f * std::cos(s2);
 	float a = (2.0f * l*l*l) / ((1.0f - l) * n);
 	float b = (1.0f / l) - 1.5f;
 	for (int i = 0; i < n; i++) {
-		int ind = mesh->faces[f].indexof(v1);
-		if (ind == -1)
-			return loop(mesh, f1, f2, v0, v1, v2, v3);
-		ind = NEXT(ind);
-		int v = mesh->faces[f][ind];
+		int v = mesh->corner_vertex(TriMesh::corner_next(c));
 		float wt;
 		if (n < 6) {
 			wt = wts[n][i];
@@ -99,11 +96,11 @@ static point new_loop_edge(TriMesh *mesh, int f1, int f2,
 		}
 		p += wt * mesh->vertices[v];
 		sumwts += wt;
-		f = mesh->across_edge[f][ind];
-		if (f == -1)
+		c = mesh->corner_swing(c);
+		if (c < 0)
 			return loop(mesh, f1, f2, v0, v1, v2, v3);
 	}
-	if (f != f1)
+	if (c / 3 != f1)
 		return loop(mesh, f1, f2, v0, v1, v2, v3);
 	return p + (1.0f - sumwts) * mesh->vertices[v1];
 }
@@ -111,8 +108,8 @@ static point new_loop_edge(TriMesh *mesh, int f1, int f2,
 
 // Compute Zorin's edge mask for an extraordinary vertex for
 // SUBDIV_BUTTERFLY_MODIFIED
-static point zorin_edge(TriMesh *mesh, int f1, int f2,
-			int v0, int v1, int v2, int v3)
+static point zorin_edge(TriMesh *mesh, const std::vector<int> &valence,
+			int f1, int f2, int v0, int v1, int v2, int v3)
 {
 	static const float wts[6][5] = {
 		{ 0, 0, 0, 0, 0 },
@@ -123,20 +120,19 @@ static point zorin_edge(TriMesh *mesh, int f1, int f2,
 		{ 0.35f, 0.0309017f, -0.0809017f, -0.0809017f, 0.0309017f },
 	};
 
-	int n = mesh->adjacentfaces[v1].size();
+	int n = valence[v1];
 	if (n < 3)
 		return butterfly(mesh, f1, f2, v0, v1, v2, v3);
+	int ind = mesh->faces[f1].indexof(v1);
+	if (ind == -1)
+		return butterfly(mesh, f1, f2, v0, v1, v2, v3);
 	point p;
 	float sumwts = 0.0f;
-	int f = f1;
+	index_t c = 3*f1 + ind;
 	float s1 = 1.0f / n;
 	float s2 = M_TWOPIf * s1;
 	for (int i = 0; i < n; i++) {
-		int ind = mesh->faces[f].indexof(v1);
-		if (ind == -1)
-			return butterfly(mesh, f1, f2, v0, v1, v2, v3);
-		ind = NEXT(ind);
-		int v = mesh->faces[f][ind];
+		int v = mesh->corner_vertex(TriMesh::corner_next(c));
 		float wt;
 		if (n < 6) {
 			wt = wts[n][i];
@@ -146,11 +142,11 @@ static point zorin_edge(TriMesh *mesh, int f1, int f2,
 		}
 		p += wt * mesh->vertices[v];
 		sumwts += wt;
-		f = mesh->across_edge[f][ind];
-		if (f == -1)
+		c = mesh->corner_swing(c);
+		if (c < 0)
 			return butterfly(mesh, f1, f2, v0, v1, v2, v3);
 	}
-	if (f != f1)
+	if (c / 3 != f1)
 		return butterfly(mesh, f1, f2, v0, v1, v2, v3);
 	return p + (1.0f - sumwts) * mesh->vertices[v1];
 }
@@ -161,17 +157,18 @@ static point avg_bdy(TriMesh *mesh, int v)
 {
 	point p;
 	int n = 0;
-	const std::vector<int> &a = mesh->adjacentfaces[v];
-	for (int i = 0; i < a.size(); i++) {
-		int f = a[i];
+	index_t c0 = mesh->vertex_corner[v], c = c0;
+	if (c0 >= 0) do {
+		int f = c / 3;
 		for (int j = 0; j < 3; j++) {
-			if (mesh->across_edge[f][j] == -1) {
+			if (mesh->corner_opposite[3*f+j] < 0) {
 				p += mesh->vertices[mesh->faces[f][NEXT(j)]];
 				p += mesh->vertices[mesh->faces[f][PREV(j)]];
 				n += 2;
 			}
 		}
-	}
+		c = mesh->corner_swing(c);
+	} while (c >= 0 && c != c0);
 	return p * (1.0f / n);
 }
 
@@ -204,8 +201,10 @@ static inline float loop_update_alpha(int scheme, int n)
 }
 
 
-// Insert a new vertex
-static void insert_vert(TriMesh *mesh, int scheme, int f, int e)
+// Insert a new vertex.  valence holds the number of faces touching each
+// of the original vertices.
+static void insert_vert(TriMesh *mesh, const std::vector<int> &valence,
+			int scheme, int f, int e)
 {
 	int v1 = mesh->faces[f][NEXT(e)], v2 = mesh->faces[f][PREV(e)];
 	if (scheme == SUBDIV_PLANAR) {
@@ -215,8 +214,8 @@ static void insert_vert(TriMesh *mesh, int scheme, int f, int e)
 		return;
 	}
 
-	int ae = mesh->across_edge[f][e];
-	if (ae == -1) {
+	index_t o = mesh->corner_opposite[3*f+e];
+	if (o < 0) {
 		// Boundary
 		point p = 0.5f * (mesh->vertices[v1] +
 				  mesh->vertices[v2]);
@@ -229,36 +228,44 @@ static void insert_vert(TriMesh *mesh, int scheme, int f, int e)
 		return;
 	}
 
+	int ae = o / 3;
 	int v0 = mesh->faces[f][e];
-	const TriMesh::Face &aef = mesh->faces[ae];
-	int v3 = aef[NEXT(aef.indexof(v1))];
+	int v3 = mesh->corner_vertex(o);
 	point p;
 	if (scheme == SUBDIV_LOOP || scheme == SUBDIV_LOOP_ORIG) {
 		p = loop(mesh, f, ae, v0, v1, v2, v3);
 	} else if (scheme == SUBDIV_LOOP_NEW) {
-		bool e1 = (mesh->adjacentfaces[v1].size() != 6);
-		bool e2 = (mesh->adjacentfaces[v2].size() != 6);
+		bool e1 = (valence[v1] != 6);
+		bool e2 = (valence[v2] != 6);
 		if (e1 && e2)
-			p = 0.5f * (new_loop_edge(mesh, f, ae, v0, v1, v2, v3) +
-				    new_loop_edge(mesh, ae, f, v3, v2, v1, v0));
+			p = 0.5f * (new_loop_edge(mesh, valence, f, ae,
+						  v0, v1, v2, v3) +
+				    new_loop_edge(mesh, valence, ae, f,
+						  v3, v2, v1, v0));
 		else if (e1)
-			p = new_loop_edge(mesh, f, ae, v0, v1, v2, v3);
+			p = new_loop_edge(mesh, valence, f, ae,
+					  v0, v1, v2, v3);
 		else if (e2)
-			p = new_loop_edge(mesh, ae, f, v3, v2, v1, v0);
+			p = new_loop_edge(mesh, valence, ae, f,
+					  v3, v2, v1, v0);
 		else
 			p = loop(mesh, f, ae, v0, v1, v2, v3);
 	} else if (scheme == SUBDIV_BUTTERFLY) {
 		p = butterfly(mesh, f, ae, v0, v1, v2, v3);
 	} else if (scheme == SUBDIV_BUTTERFLY_MODIFIED) {
-		bool e1 = (mesh->adjacentfaces[v1].size() != 6);
-		bool e2 = (mesh->adjacentfaces[v2].size() != 6);
+		bool e1 = (valence[v1] != 6);
+		bool e2 = (valence[v2] != 6);
 		if (e1 && e2)
-			p = 0.5f * (zorin_edge(mesh, f, ae, v0, v1, v2, v3) +
-				    zorin_edge(mesh, ae, f, v3, v2, v1, v0));
+			p = 0.5f * (zorin_edge(mesh, valence, f, ae,
+						  v0, v1, v2, v3) +
+				    zorin_edge(mesh, valence, ae, f,
+						  v3, v2, v1, v0));
 		else if (e1)
-			p = zorin_edge(mesh, f, ae, v0, v1, v2, v3);
+			p = zorin_edge(mesh, valence, f, ae,
+					  v0, v1, v2, v3);
 		else if (e2)
-			p = zorin_edge(mesh, ae, f, v3, v2, v1, v0);
+			p = zorin_edge(mesh, valence, ae, f,
+					  v3, v2, v1, v0);
 		else
 			p = butterfly(mesh, f, ae, v0, v1, v2, v3);
 	}
@@ -283,8 +290,8 @@ void subdiv(TriMesh *mesh, int scheme /* = SUBDIV_LOOP */)
 	mesh->need_faces(); mesh->tstrips.clear(); mesh->grid.clear();
 	mesh->grid_width = mesh->grid_height = -1;
 	mesh->neighbors.clear();
-	mesh->need_adjacentfaces();
-	mesh->need_across_edge();
+	mesh->adjacentfaces.clear(); mesh->across_edge.clear();
+	mesh->need_corners();
 
 
 	dprintf("Subdividing mesh... ");
@@ -295,6 +302,10 @@ void subdiv(TriMesh *mesh, int scheme /* = SUBDIV_LOOP */)
 	int old_nv = mesh->vertices.size();
 	mesh->vertices.reserve(4 * old_nv);
 	std::vector<int> newvert_count(old_nv + 3*nf);
+	std::vector<int> valence(old_nv);
+	for (int i = 0; i < nf; i++)
+		for (int j = 0; j < 3; j++)
+			valence[mesh->faces[i][j]]++;
 	if (have_col)
 		mesh->colors.reserve(4 * old_nv);
 	if (have_conf)
@@ -304,28 +315,11 @@ void subdiv(TriMesh *mesh, int scheme /* = SUBDIV_LOOP */)
 		for (int j = 0; j < 3; j++) {
 			if (newverts[i][j] != -1)
 				continue;
-			int ae = mesh->across_edge[i][j];
-			if (ae != -1) {
-				if (mesh->across_edge[ae][0] == i)
-					newverts[i][j] = newverts[ae][0];
-				else if (mesh->across_edge[ae][1] == i)
-					newverts[i][j] = newverts[ae][1];
-				else if (mesh->across_edge[ae][2] == i)
-					newverts[i][j] = newverts[ae][2];
-			}
-			if (newverts[i][j] != -1)
-				continue;
-
-			insert_vert(mesh, scheme, i, j);
+			insert_vert(mesh, valence, scheme, i, j);
 			newverts[i][j] = mesh->vertices.size() - 1;
-			if (ae != -1) {
-				if (mesh->across_edge[ae][0] == i)
-					newverts[ae][0] = newverts[i][j];
-				else if (mesh->across_edge[ae][1] == i)
-					newverts[ae][1] = newverts[i][j];
-				else if (mesh->across_edge[ae][2] == i)
-					newverts[ae][2] = newverts[i][j];
-			}
+			index_t o = mesh->corner_opposite[3*i+j];
+			if (o >= 0)
+				newverts[o/3][o%3] = newverts[i][j];
 			const TriMesh::Face &v = mesh->faces[i];
 			if (have_col) {
 				mesh->colors.push_back(0.5f *
@@ -344,34 +338,35 @@ void subdiv(TriMesh *mesh, int scheme /* = SUBDIV_LOOP */)
 	    scheme == SUBDIV_LOOP_ORIG ||
 	    scheme == SUBDIV_LOOP_NEW) {
 
+		// At a non-manifold vertex, this only sees the fan that
+		// starts at vertex_corner.
 		std::vector<point> oldvertices = mesh->vertices;
 #pragma omp parallel for
 		for (int i = 0; i < old_nv; i++) {
 			point bdyavg, nbdyavg;
 			int nbdy = 0, nnbdy = 0;
-			int naf = mesh->adjacentfaces[i].size();
-			if (!naf)
+			index_t c0 = mesh->vertex_corner[i], c = c0;
+			if (c0 < 0)
 				continue;
-			for (int j = 0; j < naf; j++) {
-				int af = mesh->adjacentfaces[i][j];
-				int afi = mesh->faces[af].indexof(i);
-				int n1 = NEXT(afi);
-				int n2 = PREV(afi);
-				if (mesh->across_edge[af][n1] == -1) {
-					bdyavg += oldvertices[mesh->faces[af][n2]];
+			do {
+				index_t n1 = TriMesh::corner_next(c);
+				index_t n2 = TriMesh::corner_prev(c);
+				if (mesh->corner_opposite[n1] < 0) {
+					bdyavg += oldvertices[mesh->corner_vertex(n2)];
 					nbdy++;
 				} else {
-					nbdyavg += oldvertices[mesh->faces[af][n2]];
+					nbdyavg += oldvertices[mesh->corner_vertex(n2)];
 					nnbdy++;
 				}
-				if (mesh->across_edge[af][n2] == -1) {
-					bdyavg += oldvertices[mesh->faces[af][n1]];
+				if (mesh->corner_opposite[n2] < 0) {
+					bdyavg += oldvertices[mesh->corner_vertex(n1)];
 					nbdy++;
 				} else {
-					nbdyavg += oldvertices[mesh->faces[af][n1]];
+					nbdyavg += oldvertices[mesh->corner_vertex(n1)];
 					nnbdy++;
 				}
-			}
+				c = mesh->corner_swing(c);
+			} while (c >= 0 && c != c0);
 
 			float alpha;
 			point newpt;
@@ -390,7 +385,7 @@ void subdiv(TriMesh *mesh, int scheme /* = SUBDIV_LOOP */)
 	}
 
 	// Insert new faces
-	mesh->adjacentfaces.clear(); mesh->across_edge.clear();
+	mesh->corner_opposite.clear(); mesh->vertex_corner.clear();
 	mesh->faces.reserve(4*nf);
 	for (int i = 0; i < nf; i++) {
 		TriMesh::Face &v = mesh->faces[i];
@@ -400,6 +395,8 @@ void subdiv(TriMesh *mesh, int scheme /* = SUBDIV_LOOP */)
 		mesh->faces.push_back(TriMesh::Face(v[2], n[1], n[0]));
 		v = n;
 	}
+	mesh->geometry_changed();
+	mesh->topology_changed();
 
 	dprintf("Done.\n");
 }
@@ -0,0 +1,173 @@
+/*
+Szymon Rusinkiewicz
+Princeton University
+
+mesh_bench.cc
+Time the computation of normals, curvatures, connectivity, etc. on a mesh
+with its vertices and faces in the order they were read, and again after
+reordering them along a space-filling curve.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "TriMesh.h"
+#include "TriMesh_algo.h"
+#include "timestamp.h"
+using namespace trimesh;
+using namespace std;
+
+
+// The passes being timed
+enum { NEIGHBORS, ADJACENTFACES, ACROSS_EDGE, CORNERS, NORMALS, POINTAREAS,
+	CURVATURES, DIFFUSE, SUBDIV, NPASSES };
+static const char *passnames[NPASSES] = {
+	"need_neighbors", "need_adjacentfaces", "need_across_edge",
+	"need_corners", "need_normals", "need_pointareas",
+	"need_curvatures", "diffuse_normals", "subdiv"
+};
+
+
+// Time one pass, on a copy of the mesh that has whatever the pass needs
+// (but nothing else) computed already
+static float time_pass(const TriMesh *mesh, int pass)
+{
+	TriMesh *m = new TriMesh(*mesh);
+	switch (pass) {
+		case NORMALS:
+		case POINTAREAS:
+			m->need_adjacentfaces();
+			break;
+		case CURVATURES:
+			m->need_normals();
+			m->need_pointareas();
+			break;
+		case DIFFUSE:
+			m->need_normals();
+			m->need_pointareas();
+			m->need_neighbors();
+			m->need_across_edge();
+			break;
+		case SUBDIV:
+			m->need_adjacentfaces();
+			m->need_across_edge();
+			break;
+	}
+
+	timestamp t0 = now();
+	switch (pass) {
+		case NEIGHBORS: m->need_neighbors(); break;
+		case ADJACENTFACES: m->need_adjacentfaces(); break;
+		case ACROSS_EDGE: m->need_across_edge(); break;
+		case CORNERS: m->need_corners(); break;
+		case NORMALS: m->need_normals(); break;
+		case POINTAREAS: m->need_pointareas(); break;
+		case CURVATURES: m->need_curvatures(); break;
+		case DIFFUSE: diffuse_normals(m, 2.0f * m->feature_size()); break;
+		case SUBDIV: subdiv(m); break;
+	}
+	float t = now() - t0;
+
+	delete m;
+	return t;
+}
+
+
+// Best of nreps times for each pass
+static void time_passes(const TriMesh *mesh, int nreps, vector<float> &times)
+{
+	times.resize(NPASSES);
+	for (int pass = 0; pass < NPASSES; pass++) {
+		times[pass] = time_pass(mesh, pass);
+		for (int i = 1; i < nreps; i++)
+			times[pass] = min(times[pass], time_pass(mesh, pass));
+	}
+}
+
+
+// Randomly permute the vertices and faces
+static void scramble(TriMesh *mesh)
+{
+	int nv = mesh->vertices.size(), nf = mesh->faces.size();
+	vector<int> remap(nv);
+	for (int i = 0; i < nv; i++)
+		remap[i] = i;
+	srand(1);
+	for (int i = nv - 1; i > 0; i--)
+		swap(remap[i], remap[rand() % (i + 1)]);
+	remap_verts(mesh, remap);
+	for (int i = nf - 1; i > 0; i--)
+		swap(mesh->faces[i], mesh->faces[rand() % (i + 1)]);
+	mesh->topology_changed();
+}
+
+
+void usage(const char *myname)
+{
+	fprintf(stderr, "Usage: %s [options] in.ply\n", myname);
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "	-scramble	Randomly permute vertices and faces first\n");
+	fprintf(stderr, "	-morton		Reorder along a Morton curve (default Hilbert)\n");
+	fprintf(stderr, "	-firstref	Reorder vertices by first reference (as mesh_filter -reorder)\n");
+	fprintf(stderr, "	-reps n		Report the best of n runs (default 3)\n");
+	exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	bool scramble_first = false;
+	int order = REORDER_HILBERT, nreps = 3;
+	const char *filename = NULL;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-scramble"))
+			scramble_first = true;
+		else if (!strcmp(argv[i], "-morton"))
+			order = REORDER_MORTON;
+		else if (!strcmp(argv[i], "-firstref"))
+			order = -1;
+		else if (!strcmp(argv[i], "-reps") && i < argc - 1)
+			nreps = max(atoi(argv[++i]), 1);
+		else if (argv[i][0] == '-' || filename)
+			usage(argv[0]);
+		else
+			filename = argv[i];
+	}
+	if (!filename)
+		usage(argv[0]);
+
+	TriMesh::set_verbose(0);
+	TriMesh *mesh = TriMesh::read(filename);
+	if (!mesh)
+		usage(argv[0]);
+	mesh->need_faces();
+	mesh->tstrips.clear();
+	mesh->grid.clear();
+	mesh->normals.clear();
+	if (scramble_first)
+		scramble(mesh);
+
+	vector<float> before, after;
+	time_passes(mesh, nreps, before);
+
+	timestamp t0 = now();
+	if (order < 0)
+		reorder_verts(mesh);
+	else
+		reorder_verts_spatial(mesh, order);
+	float treorder = now() - t0;
+	time_passes(mesh, nreps, after);
+
+	printf("%d vertices, %d faces.  Reordering took %.3f sec.\n",
+		(int) mesh->vertices.size(), (int) mesh->faces.size(),
+		treorder);
+	printf("%-20s %10s %10s %8s\n", "", "before", "after", "speedup");
+	float totbefore = 0, totafter = 0;
+	for (int pass = 0; pass < NPASSES; pass++) {
+		printf("%-20s %10.4f %10.4f %7.2fx\n", passnames[pass],
+			before[pass], after[pass], before[pass] / after[pass]);
+		totbefore += before[pass];
+		totafter += after[pass];
+	}
+	printf("%-20s %10.4f %10.4f %7.2fx\n", "total",
+		totbefore, totafter, totbefore / totafter);
+}
@@ -93,6 +93,8 @@ void usage(const char *myname)
 	fprintf(stderr, "	-notstrip	Unpack triangle strips to faces\n");
 	fprintf(stderr, "	-nogrid		Unpack range grid to faces\n");
 	fprintf(stderr, "	-reorder	Optimize order of vertices\n");
+	fprintf(stderr, "	-spatialorder	Order vertices and faces along a Hilbert curve\n");
+	fprintf(stderr, "	-cacheopt	Order faces and vertices for the GPU vertex cache\n");
 	fprintf(stderr, "	-orient		Auto-orient faces within the mesh\n");
 	fprintf(stderr, "	-faceflip	Flip the order of vertices within each face\n");
 	fprintf(stderr, "	-edgeflip	Optimize triangle connectivity by flipping edges\n");
@@ -182,6 +184,11 @@ int main(int argc, char *argv[])
 			themesh->grid.clear();
 		} else if (!strcmp(argv[i], "-reorder")) {
 			reorder_verts(themesh);
+		} else if (!strcmp(argv[i], "-spatialorder")) {
+			reorder_verts_spatial(themesh);
+		} else if (!strcmp(argv[i], "-cacheopt")) {
+			optimize_vertex_cache(themesh);
+			have_tstrips = false;
 		} else if (!strcmp(argv[i], "-orient")) {
 			orient(themesh);
 		} else if (!strcmp(argv[i], "-faceflip")) {
@@ -110,21 +110,21 @@ void update_neighbor(FaceStruct &f, int i, int j)
 }
 
 
-// Find all the boundary edges
-edgeset *find_boundary_edges(const TriMesh *themesh)
+// Find all the boundary edges: the ones opposite corners that have no
+// opposite corner in the corner table
+edgeset *find_boundary_edges(TriMesh *themesh)
 {
+	themesh->need_corners();
 	printf("Finding boundary edges... "); fflush(stdout);
 	edgeset *edges = new edgeset;
 
-	for (size_t f = 0; f < themesh->faces.size(); f++) {
-		for (int i = 0; i < 3; i++) {
-			int v1 = themesh->faces[f][i];
-			int v2 = themesh->faces[f][(i+1) % 3];
-
-			// Opposite-pointing edges cancel each other
-			if (!edges->erase(make_pair(v2,v1)))
-				edges->insert(make_pair(v1,v2));
-		}
+	size_t nc = themesh->corner_opposite.size();
+	for (size_t c = 0; c < nc; c++) {
+		if (themesh->corner_opposite[c] >= 0)
+			continue;
+		int v1 = themesh->corner_vertex(TriMesh::corner_next(c));
+		int v2 = themesh->corner_vertex(TriMesh::corner_prev(c));
+		edges->insert(make_pair(v1,v2));
 	}
 
 	printf("Done.\n");
@@ -29,6 +29,9 @@ void usage(const char *myname)
 	fprintf(stderr, "	csize		Bounding box center and size\n");
 	fprintf(stderr, "	bsphere		Bounding sphere\n");
 	fprintf(stderr, "	overlap infile2	Overlap area and RMS distance to other mesh\n");
+	fprintf(stderr, "	memory		Bytes of memory used by the mesh, by member\n");
+	fprintf(stderr, "	cache [n]	Vertex cache miss ratios (ACMR and ATVR) of the\n");
+	fprintf(stderr, "			face order, for a FIFO cache of n (default 16)\n");
 	fprintf(stderr, "\nStatistical operations:\n");
 	fprintf(stderr, "	min		Minimum\n");
 	fprintf(stderr, "	max		Maximum\n");
@@ -61,12 +64,27 @@ int main(int argc, char *argv[])
 	if (argc < 3)
 		usage(argv[0]);
 
+	// Counts can often be had from just the header
+	if (argc == 3 && (!strcmp(argv[2], "faces") ||
+			  !strcmp(argv[2], "vertices"))) {
+		TriMesh::FileInfo info;
+		if (TriMesh::probe(argv[1], info)) {
+			if (!strcmp(argv[2], "vertices")) {
+				printf("%d\n", info.nverts);
+				return 0;
+			} else if (info.ntris >= 0) {
+				printf("%d\n", info.ntris);
+				return 0;
+			}
+		}
+	}
+
 	TriMesh *mesh = TriMesh::read(argv[1]);
 	if (!mesh)
 		usage(argv[0]);
 
 	// Display information
-	if (argc == 3) {
+	if (argc == 3 && strcmp(argv[2], "cache")) {
 		if (!strcmp(argv[2], "faces")) {
 			mesh->need_faces();
 			printf("%d\n", (int) mesh->faces.size());
@@ -87,6 +105,13 @@ int main(int argc, char *argv[])
 			printf("%g %g %g\n%g\n",
 				mesh->bsphere.center[0], mesh->bsphere.center[1], mesh->bsphere.center[2],
 				mesh->bsphere.r);
+		} else if (!strcmp(argv[2], "memory")) {
+			vector<TriMesh::MemoryItem> items;
+			size_t total = mesh->memory_usage(&items);
+			for (size_t i = 0; i < items.size(); i++)
+				printf("%-20s %lu\n", items[i].first,
+					(unsigned long) items[i].second);
+			printf("%-20s %lu\n", "total", (unsigned long) total);
 		} else {
 			usage(argv[0]);
 		}
@@ -94,6 +119,18 @@ int main(int argc, char *argv[])
 		return 0;
 	}
 
+	// Vertex cache efficiency
+	if ((argc == 3 || argc == 4) && !strcmp(argv[2], "cache")) {
+		int cache_size = (argc == 4) ? atoi(argv[3]) : 16;
+		if (cache_size <= 0)
+			usage(argv[0]);
+		float acmr, atvr;
+		vertex_cache_stats(mesh, cache_size, acmr, atvr);
+		printf("ACMR %g\nATVR %g\n", acmr, atvr);
+
+		return 0;
+	}
+
 	// Overlap calculation
 	if (argc == 4 && !strcmp(argv[2], "overlap")) {
 		TriMesh *mesh2 = TriMesh::read(argv[3]);
@@ -273,7 +273,7 @@ bool find_closest_pt(const TriMesh *mesh, const KDtree *kd, const point &p,
 	if (ind < 0 || ind >= mesh->vertices.size())
 		return false;
 
-	const vector<int> &a = mesh->adjacentfaces[ind];
+	AdjList::Range a = mesh->adjacentfaces[ind];
 	if (a.empty()) {
 		pmatch = mesh->vertices[ind];
 		return true;